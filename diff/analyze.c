@@ -47,6 +47,21 @@ static int too_expensive;	/* Edit scripts longer than this are too
 
 #define SNAKE_LIMIT 20	/* Snakes bigger than this are considered `big'.  */
 
+/* Tables for the histogram algorithm.  */
+static int *hist_count;		/* Vector, indexed by equivalence class,
+				   containing the number of times the class
+				   occurs in the part of file 0 being
+				   examined.  */
+static int *hist_head;		/* Vector, indexed by equivalence class,
+				   containing the first line of the class in
+				   the part of file 0 being examined.  */
+static int *hist_next;		/* Vector, indexed by line of file 0,
+				   containing the next line of the same
+				   class, or -1.  */
+
+#define MAX_CHAIN_LENGTH 64	/* Lines occurring more often than this
+				   are never used as anchors.  */
+
 struct partition
 {
   int xmid, ymid;	/* Midpoints of this partition.  */
@@ -60,6 +75,7 @@ static struct change *build_reverse_script PARAMS((struct file_data const[]));
 static struct change *build_script PARAMS((struct file_data const[]));
 static void briefly_report PARAMS((int, struct file_data const[]));
 static void compareseq PARAMS((int, int, int, int, int));
+static void histseq PARAMS((int, int, int, int));
 static void discard_confusing_lines PARAMS((struct file_data[]));
 static void shift_boundaries PARAMS((struct file_data[]));
 
@@ -389,6 +405,132 @@ compareseq (xoff, xlim, yoff, ylim, minimal)
     }
 }
 
+/* Like compareseq, but use the histogram algorithm (--histogram).
+
+   Rather than looking for a shortest edit script, find the longest run
+   of lines common to both subsequences that contains the rarest line of
+   file 0, take that run as matching, and repeat on each side of it.
+   Lines that occur more than MAX_CHAIN_LENGTH times are never used as
+   anchors, so a file full of repeated lines (blank lines, braces,
+   generated boilerplate) can't make the search blow up the way it can
+   in `diag', and the changes found tend to follow the structure of the
+   file more closely.  A subsequence with no usable anchor is handed to
+   compareseq.  */
+
+static void
+histseq (xoff, xlim, yoff, ylim)
+     int xoff, xlim, yoff, ylim;
+{
+  int * const xv = xvec; /* Help the compiler.  */
+  int * const yv = yvec;
+
+  for (;;)
+    {
+      int i, j, jnext;
+      int best_len, low_count;
+      int best_xoff = 0, best_xlim = 0, best_yoff = 0, best_ylim = 0;
+
+      /* Slide down the bottom initial diagonal. */
+      while (xoff < xlim && yoff < ylim && xv[xoff] == yv[yoff])
+	++xoff, ++yoff;
+      /* Slide up the top initial diagonal. */
+      while (xlim > xoff && ylim > yoff && xv[xlim - 1] == yv[ylim - 1])
+	--xlim, --ylim;
+
+      /* Handle simple cases. */
+      if (xoff == xlim)
+	{
+	  while (yoff < ylim)
+	    files[1].changed_flag[files[1].realindexes[yoff++]] = 1;
+	  return;
+	}
+      if (yoff == ylim)
+	{
+	  while (xoff < xlim)
+	    files[0].changed_flag[files[0].realindexes[xoff++]] = 1;
+	  return;
+	}
+
+      /* Chain together the lines of each class in file 0, in order.  */
+      for (i = xlim; xoff < i; )
+	{
+	  int e = xv[--i];
+	  hist_next[i] = hist_count[e] ? hist_head[e] : -1;
+	  hist_head[e] = i;
+	  hist_count[e]++;
+	}
+
+      /* Look for the best anchor: the longest common run among those
+	 whose rarest line is rarest.  */
+      best_len = 0;
+      low_count = MAX_CHAIN_LENGTH;
+      for (j = yoff; j < ylim; j = jnext)
+	{
+	  int e = yv[j];
+
+	  jnext = j + 1;
+	  if (hist_count[e] == 0 || low_count < hist_count[e])
+	    continue;
+
+	  for (i = hist_head[e]; i != -1; i = hist_next[i])
+	    {
+	      int xs = i, xe = i + 1, ys = j, ye = j + 1;
+	      int count = hist_count[e];
+
+	      while (xoff < xs && yoff < ys && xv[xs - 1] == yv[ys - 1])
+		{
+		  --xs, --ys;
+		  count = min (count, hist_count[xv[xs]]);
+		}
+	      while (xe < xlim && ye < ylim && xv[xe] == yv[ye])
+		{
+		  count = min (count, hist_count[xv[xe]]);
+		  ++xe, ++ye;
+		}
+
+	      if (jnext < ye)
+		jnext = ye;
+	      if (best_len < xe - xs || count < low_count)
+		{
+		  best_len = xe - xs;
+		  low_count = count;
+		  best_xoff = xs, best_xlim = xe;
+		  best_yoff = ys, best_ylim = ye;
+		}
+
+	      /* Skip the lines of this class inside the run just found.  */
+	      while (hist_next[i] != -1 && hist_next[i] < xe)
+		i = hist_next[i];
+	    }
+	}
+
+      for (i = xoff; i < xlim; i++)
+	hist_count[xv[i]] = 0;
+
+      if (best_len == 0)
+	{
+	  compareseq (xoff, xlim, yoff, ylim, no_discards);
+	  return;
+	}
+
+      /* Recurse on the smaller side of the anchor and loop on the larger,
+	 so that the depth of recursion stays logarithmic.  */
+      if (best_xoff - xoff + best_yoff - yoff
+	  < xlim - best_xlim + ylim - best_ylim)
+	{
+	  histseq (xoff, best_xoff, yoff, best_yoff);
+	  xoff = best_xlim;
+	  yoff = best_ylim;
+	}
+      else
+	{
+	  histseq (best_xlim, xlim, best_ylim, ylim);
+	  xlim = best_xoff;
+	  ylim = best_yoff;
+	}
+    }
+}
+
 /* Discard lines from one file that have no matches in the other file.
 
    A line which is discarded will not be considered by the actual
@@ -853,6 +995,11 @@ diff_2_files (filevec, depth)
 	  && (filevec[1].desc < 0 || S_ISREG (filevec[1].stat.st_mode)))
 	changes = 1;
 
+      /* Buffers from diff_run_buffers are already complete.  */
+      else if (filevec[0].membuf)
+	changes = memcmp (filevec[0].buffer, filevec[1].buffer,
+			  filevec[0].buffered_chars) != 0;
+
       /* Standard input equals itself.  */
       else if (filevec[0].desc == filevec[1].desc)
 	changes = 0;
@@ -948,8 +1095,29 @@ diff_2_files (filevec, depth)
       files[0] = filevec[0];
       files[1] = filevec[1];
 
-      compareseq (0, filevec[0].nondiscarded_lines,
-		  0, filevec[1].nondiscarded_lines, no_discards);
+      if (histogram_flag)
+	{
+	  int classes = 0;
+
+	  for (i = 0; i < filevec[0].nondiscarded_lines; i++)
+	    classes = max (classes, xvec[i] + 1);
+	  for (i = 0; i < filevec[1].nondiscarded_lines; i++)
+	    classes = max (classes, yvec[i] + 1);
+	  hist_count = (int *) xmalloc (classes * (2 * sizeof (int)));
+	  bzero (hist_count, classes * sizeof (int));
+	  hist_head = hist_count + classes;
+	  hist_next = (int *) xmalloc ((filevec[0].nondiscarded_lines + 1)
+				       * sizeof (int));
+
+	  histseq (0, filevec[0].nondiscarded_lines,
+		   0, filevec[1].nondiscarded_lines);
+
+	  free (hist_next);
+	  free (hist_count);
+	}
+      else
+	compareseq (0, filevec[0].nondiscarded_lines,
+		    0, filevec[1].nondiscarded_lines, no_discards);
 
       free (fdiag - (filevec[1].nondiscarded_lines + 1));
 
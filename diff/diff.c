@@ -48,6 +48,8 @@ static char *option_list PARAMS((char **, int));
 static int add_exclude_file PARAMS((char const *));
 static int ck_atoi PARAMS((char const *, int *));
 static int compare_files PARAMS((char const *, char const *, char const *, char const *, int));
+static int compare_buffers PARAMS((void));
+static int diff_run_1 PARAMS((int, char **, const char *, const struct diff_callbacks *));
 static int specify_format PARAMS((char **, char *));
 static void add_exclude PARAMS((char const *));
 static void add_regexp PARAMS((struct regexp_list **, char const *));
@@ -71,6 +73,11 @@ int no_discards;
 static int binary_I_O;
 #endif
 
+/* The buffers being compared by diff_run_buffers, if any.  */
+
+static char const *membufs[2];
+static size_t memlens[2];
+
 /* Return a string containing the command options with which diff was invoked.
    Spaces appear between what were separate ARGV-elements.
    There is a space at the beginning but none at the end.
@@ -231,6 +238,7 @@ static struct option const longopts[] =
   {"horizon-lines", 1, 0, 140},
   {"help", 0, 0, 141},
   {"binary", 0, 0, 142},
+  {"histogram", 0, 0, 143},
   {0, 0, 0, 0}
 };
 
@@ -242,6 +250,43 @@ diff_run (argc, argv, out, callbacks_arg)
      char *argv[];
      const char *out;
      const struct diff_callbacks *callbacks_arg;
+{
+  membufs[0] = membufs[1] = 0;
+  return diff_run_1 (argc, argv, out, callbacks_arg);
+}
+
+/* Compare BUF0 and BUF1, of LEN0 and LEN1 bytes, with the options in ARGV.
+   This saves callers which already have both texts in memory, such as
+   CVS generating the delta for a checkin, from writing them out just so
+   that diff can read them back.  */
+
+int
+diff_run_buffers (argc, argv, buf0, len0, buf1, len1, callbacks_arg)
+     int argc;
+     char *argv[];
+     char const *buf0;
+     size_t len0;
+     char const *buf1;
+     size_t len1;
+     const struct diff_callbacks *callbacks_arg;
+{
+  int val;
+
+  membufs[0] = buf0;
+  memlens[0] = len0;
+  membufs[1] = buf1;
+  memlens[1] = len1;
+  val = diff_run_1 (argc, argv, 0, callbacks_arg);
+  membufs[0] = membufs[1] = 0;
+  return val;
+}
+
+static int
+diff_run_1 (argc, argv, out, callbacks_arg)
+     int argc;
+     char *argv[];
+     const char *out;
+     const struct diff_callbacks *callbacks_arg;
 {
   int val;
   int c;
@@ -606,14 +651,20 @@ diff_run (argc, argv, out, callbacks_arg)
 #endif
 	  break;
 
+	case 143:
+	  /* Match lines up with the histogram algorithm.  */
+	  histogram_flag = 1;
+	  break;
+
 	default:
 	  return try_help (0);
 	}
       prev = c;
     }
 
-  if (argc - optind != 2)
-    return try_help (argc - optind < 2 ? "missing operand" : "extra operand");
+  if (argc - optind != (membufs[0] ? 0 : 2))
+    return try_help (argc - optind < 2 && !membufs[0]
+		     ? "missing operand" : "extra operand");
 
   {
     /*
@@ -704,7 +755,10 @@ diff_run (argc, argv, out, callbacks_arg)
 	}
     }
 
-  val = compare_files (0, argv[optind], 0, argv[optind + 1], 0);
+  if (membufs[0])
+    val = compare_buffers ();
+  else
+    val = compare_files (0, argv[optind], 0, argv[optind + 1], 0);
 
   /* Print any messages that were saved up for last.  */
   print_message_queue ();
@@ -822,6 +876,7 @@ static char const * const option_help[] = {
 "-S FILE  --starting-file=FILE  Start with FILE when comparing directories.\n",
 "--horizon-lines=NUM  Keep NUM lines of the common prefix and suffix.",
 "-d  --minimal  Try hard to find a smaller set of changes.",
+"--histogram  Match up lines with the histogram algorithm.",
 "-H  --speed-large-files  Assume large files and many scattered small changes.\n",
 "-v  --version  Output version info.",
 "--help  Output this help.",
@@ -1210,6 +1265,39 @@ compare_files (dir0, name0, dir1, name1, depth)
   return val;
 }
 
+/* Compare the buffers given to diff_run_buffers.  They are named by
+   their labels, if any, in the output.
+
+   Value is 0 if they are the same, 1 if different, 2 on trouble.  */
+
+static int
+compare_buffers ()
+{
+  struct file_data inf[2];
+  int i;
+  int val;
+
+  bzero (inf, sizeof (inf));
+
+  for (i = 0; i <= 1; i++)
+    {
+      inf[i].desc = -1;
+      inf[i].membuf = membufs[i];
+      inf[i].name = file_label[i] ? file_label[i] : "-";
+      inf[i].stat.st_mode = S_IFREG;
+      inf[i].stat.st_size = memlens[i];
+    }
+
+  val = diff_2_files (inf, 0);
+
+  if (val == 0 && print_file_same_flag)
+    message ("Files %s and %s are identical\n", inf[0].name, inf[1].name);
+  else
+    flush_output ();
+
+  return val;
+}
+
 /* Initialize status variables and flag variables used in libdiff,
    to permit repeated calls to diff_run. */
 
@@ -1263,5 +1351,6 @@ initialize_main (argcp, argvp)
   sdiff_column2_offset = 0;
   switch_string = NULL;
   heuristic = 0;
+  histogram_flag = 0;
   bzero (files, sizeof (files));
 }
@@ -178,6 +178,9 @@ EXTERN char *	switch_string;
 /* Nonzero means use heuristics for better speed.  */
 EXTERN int	heuristic;
 
+/* Nonzero means use the histogram algorithm rather than Myers'.  */
+EXTERN int	histogram_flag;
+
 /* Name of program the user invoked (for error messages).  */
 EXTERN char *diff_program_name;
 
@@ -213,6 +216,7 @@ struct change
 struct file_data {
     int             desc;	/* File descriptor  */
     char const      *name;	/* File name  */
+    char const      *membuf;	/* Contents supplied by the caller, or 0.  */
     struct stat     stat;	/* File status from fstat()  */
     int             dir_p;	/* nonzero if file is a directory  */
 
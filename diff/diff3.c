@@ -41,8 +41,6 @@ void printf_output PARAMS((char const *, ...))
      ;
 void flush_output PARAMS((void));
 
-char * cvs_temp_name PARAMS((void));
-
 /*
  * Internal data structures and macros for the diff3 program; includes
  * data structures for both diff3 diffs and normal diffs.
@@ -194,20 +192,36 @@ static int merge;
 
 extern char *diff_program_name;
 
-static char *read_diff PARAMS((char const *, char const *, char **));
+/* The operands, and the texts being compared by diff3_run_buffers,
+   if any.  */
+static char **operands;
+static char const * const *memtexts;
+static size_t const *memlens;
+
+/* The output of the subsidiary diff, collected by read_diff.  */
+static char *diff_result;
+static size_t diff_result_size;
+static size_t diff_result_len;
+
+static char *read_diff PARAMS((int, int, char **));
+static char *read_file PARAMS((char const *, size_t *));
+static void read_diff_write_output PARAMS((char const *, size_t));
+static void read_diff_flush_output PARAMS((void));
+static char const *skip_lines PARAMS((char const *, char const *, int));
+static int diff3_run_1 PARAMS((int, char **, char *, const struct diff_callbacks *));
 static char *scan_diff_line PARAMS((char *, char **, size_t *, char *, int));
 static enum diff_type process_diff_control PARAMS((char **, struct diff_block *));
 static int compare_line_list PARAMS((char * const[], size_t const[], char * const[], size_t const[], int));
 static int copy_stringlist PARAMS((char * const[], size_t const[], char *[], size_t[], int));
 static int dotlines PARAMS((struct diff3_block *, int));
 static int output_diff3_edscript PARAMS((struct diff3_block *, int const[3], int const[3], char const *, char const *, char const *));
-static int output_diff3_merge PARAMS((FILE *, struct diff3_block *, int const[3], int const[3], char const *, char const *, char const *));
+static int output_diff3_merge PARAMS((char const *, char const *, struct diff3_block *, int const[3], int const[3], char const *, char const *, char const *));
 static size_t myread PARAMS((int, char *, size_t));
 static struct diff3_block *create_diff3_block PARAMS((int, int, int, int, int, int));
 static struct diff3_block *make_3way_diff PARAMS((struct diff_block *, struct diff_block *));
 static struct diff3_block *reverse_diff3_blocklist PARAMS((struct diff3_block *));
 static struct diff3_block *using_to_diff3_block PARAMS((struct diff_block *[2], struct diff_block *[2], int, int, struct diff3_block const *));
-static struct diff_block *process_diff PARAMS((char const *, char const *, struct diff_block **, char **));
+static struct diff_block *process_diff PARAMS((int, int, struct diff_block **, char **));
 static void check_output PARAMS((FILE *));
 static void diff3_fatal PARAMS((char const *));
 static void output_diff3 PARAMS((struct diff3_block *, int const[3], int const[3]));
@@ -255,6 +269,39 @@ diff3_run (argc, argv, out, callbacks_arg)
      char **argv;
      char *out;
      const struct diff_callbacks *callbacks_arg;
+{
+  memtexts = 0;
+  return diff3_run_1 (argc, argv, out, callbacks_arg);
+}
+
+/* Compare the three TEXTS, of LENS bytes, with the options in ARGV.
+   TEXTS are in the order the file operands would be given to diff3_run.
+   This lets CVS merge revisions it has checked out into memory without
+   writing them to temporary files.  */
+
+int
+diff3_run_buffers (argc, argv, texts, lens, callbacks_arg)
+     int argc;
+     char **argv;
+     char const * const *texts;
+     size_t const *lens;
+     const struct diff_callbacks *callbacks_arg;
+{
+  int val;
+
+  memtexts = texts;
+  memlens = lens;
+  val = diff3_run_1 (argc, argv, 0, callbacks_arg);
+  memtexts = 0;
+  return val;
+}
+
+static int
+diff3_run_1 (argc, argv, out, callbacks_arg)
+     int argc;
+     char **argv;
+     char *out;
+     const struct diff_callbacks *callbacks_arg;
 {
   int c, i;
   int mapping[3];
@@ -267,8 +314,8 @@ diff3_run (argc, argv, out, callbacks_arg)
   struct diff3_block *diff3;
   int tag_count = 0;
   char *tag_strings[3];
-  char *commonname;
   char **file;
+  static char *buffer_names[3] = { "-", "-", "-" };
   struct stat statb;
   int optind_old;
   int opened_file = 0;
@@ -354,10 +401,12 @@ diff3_run (argc, argv, out, callbacks_arg)
       || (tag_count && ! flagging)) /* -L requires one of -AEX.  */
     return try_help ("incompatible options");
 
-  if (argc - optind != 3)
-    return try_help (argc - optind < 3 ? "missing operand" : "extra operand");
+  if (argc - optind != (memtexts ? 0 : 3))
+    return try_help (argc - optind < 3 && !memtexts
+		     ? "missing operand" : "extra operand");
 
-  file = &argv[optind];
+  file = memtexts ? buffer_names : &argv[optind];
+  operands = file;
 
   optind = optind_old;
 
@@ -391,7 +440,7 @@ diff3_run (argc, argv, out, callbacks_arg)
       {
 	common = 2;
       }
-    if (strcmp (file[common], "-") == 0)
+    if (!memtexts && strcmp (file[common], "-") == 0)
       {
 	/* Sigh.  We've got standard input as the arg corresponding to
 	   the desired common file.  We can't call diff twice on
@@ -412,7 +461,7 @@ diff3_run (argc, argv, out, callbacks_arg)
   for (i = 0; i < 3; i++)
     rev_mapping[mapping[i]] = i;
 
-  for (i = 0; i < 3; i++)
+  for (i = 0; i < 3 && !memtexts; i++)
     if (strcmp (file[i], "-") != 0)
       {
 	if (stat (file[i], &statb) < 0)
@@ -457,9 +506,8 @@ diff3_run (argc, argv, out, callbacks_arg)
   if (status != 0)
       return status;
 
-  commonname = file[rev_mapping[FILEC]];
-  thread1 = process_diff (file[rev_mapping[FILE1]], commonname, &last_block,
-			  &content1);
+  thread1 = process_diff (rev_mapping[FILE1], rev_mapping[FILEC],
+			  &last_block, &content1);
   /* What is the intention behind determining horizon_lines from first
      diff?  I think it is better to use the same parameters for each
      diff so that equal differences in each diff will appear the
@@ -472,8 +520,8 @@ diff3_run (argc, argv, out, callbacks_arg)
 	horizon_lines = max (horizon_lines, D_NUMLINES (last_block, i));
       }
   */
-  thread0 = process_diff (file[rev_mapping[FILE0]], commonname, &last_block,
-			  &content0);
+  thread0 = process_diff (rev_mapping[FILE0], rev_mapping[FILEC],
+			  &last_block, &content0);
   diff3 = make_3way_diff (thread0, thread1);
   if (edscript)
     conflicts_found
@@ -481,15 +529,22 @@ diff3_run (argc, argv, out, callbacks_arg)
 			       tag_strings[0], tag_strings[1], tag_strings[2]);
   else if (merge)
     {
-      FILE *mfp = fopen (file[rev_mapping[FILE0]], "r");
-      if (! mfp)
-	diff3_perror_with_exit (file[rev_mapping[FILE0]]);
-      conflicts_found = output_diff3_merge (mfp, diff3, mapping, rev_mapping,
+      char *input = 0;
+      char const *text;
+      size_t len;
+
+      if (memtexts)
+	{
+	  text = memtexts[rev_mapping[FILE0]];
+	  len = memlens[rev_mapping[FILE0]];
+	}
+      else
+	text = input = read_file (file[rev_mapping[FILE0]], &len);
+      conflicts_found = output_diff3_merge (text, text + len, diff3,
+			      mapping, rev_mapping,
 			      tag_strings[0], tag_strings[1], tag_strings[2]);
-      if (ferror (mfp))
-	diff3_fatal ("read error");
-      if (fclose(mfp) != 0)
-	perror_with_name (file[rev_mapping[FILE0]]);
+      if (input)
+	free (input);
     }
   else
     {
@@ -1074,7 +1129,7 @@ extern char **environ;
 
 static struct diff_block *
 process_diff (filea, fileb, last_block, diff_contents)
-     char const *filea, *fileb;
+     int filea, fileb;
      struct diff_block **last_block;
      char **diff_contents;
 {
@@ -1264,19 +1319,19 @@ process_diff_control (string, db)
   return type;
 }
 
+/* Run diff on the operands numbered FILEA and FILEB, and collect its
+   output in memory.  Set *OUTPUT_PLACEMENT to the output, which the
+   caller should free, and return a pointer to its end.  */
+
 static char *
 read_diff (filea, fileb, output_placement)
-     char const *filea, *fileb;
+     int filea, fileb;
      char **output_placement;
 {
-  char *diff_result;
-  size_t bytes, current_chunk_size, total;
-  int fd, wstatus;
-  struct stat pipestat;
+  int wstatus;
   FILE *outfile_hold;
   const struct diff_callbacks *callbacks_hold;
   struct diff_callbacks my_callbacks;
-  struct diff_callbacks *my_callbacks_arg;
 
   /* 302 / 1000 is log10(2.0) rounded up.  Subtract 1 for the sign bit;
      add 1 for integer division truncation; add 1 more for a minus sign.  */
@@ -1285,7 +1340,6 @@ read_diff (filea, fileb, output_placement)
   char const *argv[7];
   char horizon_arg[17 + INT_STRLEN_BOUND (int)];
   char const **ap;
-  char *diffout;
 
   ap = argv;
   *ap++ = "diff";
@@ -1294,75 +1348,118 @@ read_diff (filea, fileb, output_placement)
   sprintf (horizon_arg, "--horizon-lines=%d", horizon_lines);
   *ap++ = horizon_arg;
   *ap++ = "--";
-  *ap++ = filea;
-  *ap++ = fileb;
+  if (! memtexts)
+    {
+      *ap++ = operands[filea];
+      *ap++ = operands[fileb];
+    }
   *ap = 0;
 
-  diffout = cvs_temp_name ();
-
   outfile_hold = outfile;
   callbacks_hold = callbacks;
 
   /* We want to call diff_run preserving any stdout and stderr
-     callbacks, but discarding any callbacks to handle file output,
-     since we want the file output to go to our temporary file.
-     FIXME: We should use callbacks to just read it into a memory
-     buffer; that's we do with the temporary file just below anyhow.  */
+     callbacks, but collecting the file output in memory.  */
   if (callbacks == NULL)
-    my_callbacks_arg = NULL;
-  else
     {
-      my_callbacks = *callbacks;
-      my_callbacks.write_output = NULL;
-      my_callbacks.flush_output = NULL;
-      my_callbacks_arg = &my_callbacks;
+      my_callbacks.write_stdout = NULL;
+      my_callbacks.error = NULL;
     }
-
-  wstatus = diff_run (ap - argv, (char **) argv, diffout, my_callbacks_arg);
+  else
+    my_callbacks = *callbacks;
+  my_callbacks.write_output = read_diff_write_output;
+  my_callbacks.flush_output = read_diff_flush_output;
+
+  diff_result_size = 8 * 1024;
+  diff_result = xmalloc (diff_result_size);
+  diff_result_len = 0;
+
+  if (memtexts)
+    wstatus = diff_run_buffers (ap - argv, (char **) argv,
+				memtexts[filea], memlens[filea],
+				memtexts[fileb], memlens[fileb],
+				&my_callbacks);
+  else
+    wstatus = diff_run (ap - argv, (char **) argv, NULL, &my_callbacks);
 
   outfile = outfile_hold;
   callbacks = callbacks_hold;
 
+  *output_placement = diff_result;
+
   if (wstatus == 2)
     diff3_fatal ("subsidiary diff failed");
 
-  if (-1 == (fd = open (diffout, O_RDONLY)))
-    diff3_fatal ("could not open temporary diff file");
+  if (diff_result_len != 0 && diff_result[diff_result_len - 1] != '\n')
+    diff3_fatal ("invalid diff format; incomplete last line");
 
-  current_chunk_size = 8 * 1024;
-  if (fstat (fd, &pipestat) == 0)
-    current_chunk_size = max (current_chunk_size, STAT_BLOCKSIZE (pipestat));
+  return diff_result + diff_result_len;
+}
 
-  diff_result = xmalloc (current_chunk_size);
-  total = 0;
-  do {
-    bytes = myread (fd,
-		    diff_result + total,
-		    current_chunk_size - total);
-    total += bytes;
-    if (total == current_chunk_size)
-      {
-	if (current_chunk_size < 2 * current_chunk_size)
-	  current_chunk_size = 2 * current_chunk_size;
-	else if (current_chunk_size < (size_t) -1)
-	  current_chunk_size = (size_t) -1;
-	else
-	  diff3_fatal ("files are too large to fit into memory");
-	diff_result = xrealloc (diff_result, (current_chunk_size *= 2));
-      }
-  } while (bytes);
+/* Append the LEN bytes at TEXT to the output collected by read_diff.  */
 
-  if (total != 0 && diff_result[total-1] != '\n')
-    diff3_fatal ("invalid diff format; incomplete last line");
+static void
+read_diff_write_output (text, len)
+     char const *text;
+     size_t len;
+{
+  while (diff_result_size - diff_result_len < len)
+    {
+      if (diff_result_size * 2 < diff_result_size)
+	diff3_fatal ("files are too large to fit into memory");
+      diff_result_size *= 2;
+      diff_result = xrealloc (diff_result, diff_result_size);
+    }
+  memcpy (diff_result + diff_result_len, text, len);
+  diff_result_len += len;
+}
 
-  *output_placement = diff_result;
+/* read_diff has nothing to flush.  */
+
+static void
+read_diff_flush_output ()
+{
+}
+
+/* Read the whole of the file NAME into memory.  Set *LENP to its size
+   and return the contents, which the caller should free.  */
+
+static char *
+read_file (name, lenp)
+     char const *name;
+     size_t *lenp;
+{
+  char *contents;
+  size_t bytes, size, total;
+  int fd;
+  struct stat statb;
+
+  if ((fd = open (name, O_RDONLY)) == -1)
+    diff3_perror_with_exit (name);
+
+  size = 8 * 1024;
+  if (fstat (fd, &statb) == 0 && S_ISREG (statb.st_mode))
+    size = max (size, (size_t) statb.st_size + 1);
+
+  contents = xmalloc (size);
+  total = 0;
+  while ((bytes = myread (fd, contents + total, size - total)) != 0)
+    {
+      total += bytes;
+      if (total == size)
+	{
+	  if (size * 2 < size)
+	    diff3_fatal ("files are too large to fit into memory");
+	  size *= 2;
+	  contents = xrealloc (contents, size);
+	}
+    }
 
   if (close (fd) != 0)
-    diff3_perror_with_exit ("pipe close");
-  unlink (diffout);
-  free( diffout );
+    perror_with_name (name);
 
-  return diff_result + total;
+  *lenp = total;
+  return contents;
 }
 
 
@@ -1695,7 +1792,8 @@ output_diff3_edscript (diff, mapping, rev_mapping, file0, file1, file2)
 }
 
 /*
- * Read from INFILE and output to the standard output file a set of
+ * Read from the text at INPUT, which ends at LIMIT, and output to the
+ * standard output file a set of
  * diff3_ blocks DIFF as a merged file.  This acts like 'ed file0
  * <[output_diff3_edscript]', except that it works even for binary
  * data or incomplete lines.
@@ -1708,18 +1806,18 @@ output_diff3_edscript (diff, mapping, rev_mapping, file0, file1, file2)
  */
 
 static int
-output_diff3_merge (infile, diff, mapping, rev_mapping,
+output_diff3_merge (input, limit, diff, mapping, rev_mapping,
 		    file0, file1, file2)
-     FILE *infile;
+     char const *input, *limit;
      struct diff3_block *diff;
      int const mapping[3], rev_mapping[3];
      char const *file0, *file1, *file2;
 {
-  int c, i;
-  char cc;
+  int i;
   int conflicts_found = 0, conflict;
   struct diff3_block *b;
   int linesread = 0;
+  char const *next;
 
   for (b = diff; b; b = b->next)
     {
@@ -1746,19 +1844,11 @@ output_diff3_merge (infile, diff, mapping, rev_mapping,
       /* Copy I lines from file 0.  */
       i = D_LOWLINE (b, FILE0) - linesread - 1;
       linesread += i;
-      while (0 <= --i)
-	do
-	  {
-	    c = getc (infile);
-	    if (c == EOF)
-	      if (ferror (infile))
-		diff3_perror_with_exit ("input file");
-	      else if (feof (infile))
-		diff3_fatal ("input file shrank");
-	    cc = c;
-	    write_output (&cc, 1);
-	  }
-	while (c != '\n');
+      next = skip_lines (input, limit, i);
+      if (! next || (input < next && next[-1] != '\n'))
+	diff3_fatal ("input file shrank");
+      write_output (input, next - input);
+      input = next;
 
       if (conflict)
 	{
@@ -1802,25 +1892,39 @@ output_diff3_merge (infile, diff, mapping, rev_mapping,
       /* Skip I lines in file 0.  */
       i = D_NUMLINES (b, FILE0);
       linesread += i;
-      while (0 <= --i)
-	while ((c = getc (infile)) != '\n')
-	  if (c == EOF)
-	    if (ferror (infile))
-	      diff3_perror_with_exit ("input file");
-	    else if (feof (infile))
-	      {
-		if (i || b->next)
-		  diff3_fatal ("input file shrank");
-		return conflicts_found;
-	      }
+      next = skip_lines (input, limit, i);
+      if (! next || (next == limit && input < next && next[-1] != '\n'))
+	{
+	  if (! next || b->next)
+	    diff3_fatal ("input file shrank");
+	  return conflicts_found;
+	}
+      input = next;
     }
   /* Copy rest of common file.  */
-  while ((c = getc (infile)) != EOF || !(ferror (infile) | feof (infile)))
+  write_output (input, limit - input);
+  return conflicts_found;
+}
+
+/* Return the position just past the first N lines of the text at P,
+   which ends at LIMIT, or 0 if it has fewer than N lines.  An incomplete
+   last line counts as a line.  */
+
+static char const *
+skip_lines (p, limit, n)
+     char const *p, *limit;
+     int n;
+{
+  while (0 <= --n)
     {
-      cc = c;
-      write_output (&cc, 1);
+      char const *nl;
+
+      if (p == limit)
+	return 0;
+      nl = memchr (p, '\n', limit - p);
+      p = nl ? nl + 1 : limit;
     }
-  return conflicts_found;
+  return p;
 }
 
 /*
@@ -59,11 +59,25 @@ struct diff_callbacks
 extern int diff_run DIFFPARAMS((int, char **, const char *,
 				const struct diff_callbacks *));
 
+/* Run a diff between two buffers rather than two files.  The
+   arguments are options only; the output goes to the write_output
+   callback, or to stdout if there is none.  */
+
+extern int diff_run_buffers DIFFPARAMS((int, char **, char const *, size_t,
+					char const *, size_t,
+					const struct diff_callbacks *));
+
 /* Run a diff3.  */
 
 extern int diff3_run DIFFPARAMS((int, char **, char *,
 				 const struct diff_callbacks *));
 
+/* Run a diff3 on three buffers rather than three files.  */
+
+extern int diff3_run_buffers DIFFPARAMS((int, char **, char const * const *,
+					 size_t const *,
+					 const struct diff_callbacks *));
+
 #undef DIFFPARAMS
 
 #endif /* DIFFRUN_H */
@@ -24,6 +24,15 @@ GNU General Public License for more details.
 /* Given a hash value and a new character, return a new hash value. */
 #define HASH(h, c) ((c) + ROL (h, 7))
 
+/* Odd multiplier with well-mixed bits, used by hash_line to fold in a
+   word of text at a time.  */
+#if ULONG_MAX >> 31 >> 31 > 1
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15UL
+#else
+#define HASH_MULTIPLIER 0x9E3779B1UL
+#endif
+#define ULONG_BIT (sizeof (unsigned long) * CHAR_BIT)
+
 /* Guess remaining number of lines from number N of lines so far,
    size S so far, and total size T.  */
 #define GUESS_LINES(n,s,t) (((t) - (s)) / ((n) < 10 ? 32 : (s) / ((n)-1)) + 5)
@@ -63,6 +72,41 @@ static int equivs_index;
 /* Number of elements allocated in the array `equivs'.  */
 static int equivs_alloc;
 
+/* Largest primes less than some power of two, for nbuckets.  Values range
+   from useful to preposterous.  If one of these numbers isn't prime
+   after all, don't blame it on me, blame it on primes (6) . . . */
+static int const primes[] =
+{
+  509,
+  1021,
+  2039,
+  4093,
+  8191,
+  16381,
+  32749,
+#if 32767 < INT_MAX
+  65521,
+  131071,
+  262139,
+  524287,
+  1048573,
+  2097143,
+  4194301,
+  8388593,
+  16777213,
+  33554393,
+  67108859,			/* Preposterously large . . . */
+  134217689,
+  268435399,
+  536870909,
+  1073741789,
+  2147483647,
+#endif
+  0
+};
+
+static unsigned hash_line PARAMS((char const *, size_t));
+static void rehash_equivs PARAMS((struct equivclass *, int));
 static void find_and_hash_each_line PARAMS((struct file_data *));
 static void find_identical_ends PARAMS((struct file_data[]));
 static void prepare_text_end PARAMS((struct file_data *));
@@ -83,6 +127,18 @@ sip (current, skip_test)
      struct file_data *current;
      int skip_test;
 {
+  if (current->membuf)
+    {
+      /* Copy the caller's text, leaving room for an appended newline
+	 and a sentinel as slurp does.  */
+      size_t size = current->stat.st_size;
+      current->bufsize = size + 1 + sizeof (word);
+      current->buffer = xmalloc (current->bufsize);
+      memcpy (current->buffer, current->membuf, size);
+      current->buffered_chars = size;
+      return skip_test ? 0 : binary_file_p (current->buffer, size);
+    }
+
   /* If we have a nonexistent file at this stage, treat it as empty.  */
   if (current->desc < 0)
     {
@@ -181,6 +237,82 @@ slurp (current)
     }
 }
 
+/* Return a hash of the LENGTH bytes at P.  This is used instead of HASH
+   when no options ask for lines to be compared loosely, and consumes a
+   word of the line at a time.  */
+
+static unsigned
+hash_line (p, length)
+     char const *p;
+     size_t length;
+{
+  unsigned long h = length;
+  unsigned long w;
+  char const *lim = p + length;
+
+  while ((size_t) (lim - p) >= sizeof w)
+    {
+      memcpy (&w, p, sizeof w);
+      h = (h ^ w) * HASH_MULTIPLIER;
+      h ^= h >> (ULONG_BIT / 2);
+      p += sizeof w;
+    }
+  if (p != lim)
+    {
+      /* Fold in the last few bytes without a variable-length memcpy,
+	 which costs more than the rest of a short line.  */
+      int shift = 0;
+      w = 0;
+      do
+	{
+	  w |= (unsigned long) (unsigned char) *p++ << shift;
+	  shift += CHAR_BIT;
+	}
+      while (p != lim);
+      h = (h ^ w) * HASH_MULTIPLIER;
+      h ^= h >> (ULONG_BIT / 2);
+    }
+  return h;
+}
+
+/* The equivalence classes EQS[1] through EQS[EQS_INDEX - 1] have
+   outgrown the hash table.  Replace it with one large enough that the
+   chains are short again, moving each class into its new bucket.
+   The chain for incomplete lines in buckets[-1] is left alone.  */
+
+static void
+rehash_equivs (eqs, eqs_index)
+     struct equivclass *eqs;
+     int eqs_index;
+{
+  int *newbuckets;
+  int newnbuckets;
+  int b, i, next;
+
+  for (b = 0;  primes[b] && primes[b] < eqs_index;  b++)
+    ;
+  if (! primes[b])
+    return;
+  newnbuckets = primes[b];
+
+  newbuckets = (int *) xmalloc ((newnbuckets + 1) * sizeof (*newbuckets));
+  bzero (newbuckets++, (newnbuckets + 1) * sizeof (*newbuckets));
+  newbuckets[-1] = buckets[-1];
+
+  for (b = 0;  b < nbuckets;  b++)
+    for (i = buckets[b];  i;  i = next)
+      {
+	int *bucket = &newbuckets[eqs[i].hash % newnbuckets];
+	next = eqs[i].next;
+	eqs[i].next = *bucket;
+	*bucket = i;
+      }
+
+  free (buckets - 1);
+  buckets = newbuckets;
+  nbuckets = newnbuckets;
+}
+
 /* Split the file into lines, simultaneously computing the equivalence class for
    each line. */
 
@@ -216,7 +348,15 @@ find_and_hash_each_line (current)
       h = 0;
 
       /* Hash this line until we find a newline. */
-      if (ignore_case_flag)
+      if (! use_line_cmp)
+	{
+	  /* Lines must match exactly, so let memchr find the newline
+	     and hash the whole line a word at a time.  */
+	  char const *nl = memchr (ip, '\n', bufend - ip);
+	  h = hash_line (ip, nl - ip);
+	  p = (unsigned char const *) nl + 1;
+	}
+      else if (ignore_case_flag)
 	{
 	  if (ignore_all_space_flag)
 	    while ((c = *p++) != '\n')
@@ -254,7 +394,7 @@ find_and_hash_each_line (current)
 		if (! ISSPACE (c))
 		  h = HASH (h, c);
 	      }
-	  else if (ignore_space_change_flag)
+	  else
 	    while ((c = *p++) != '\n')
 	      {
 		if (ISSPACE (c))
@@ -272,9 +412,6 @@ find_and_hash_each_line (current)
 		/* C is now the first non-space.  */
 		h = HASH (h, c);
 	      }
-	  else
-	    while ((c = *p++) != '\n')
-	      h = HASH (h, c);
 	}
    hashing_done:;
 
@@ -308,6 +445,11 @@ find_and_hash_each_line (current)
 	    eqs[i].line = ip;
 	    eqs[i].length = length;
 	    *bucket = i;
+
+	    /* Grow the table if the guess at the number of lines that
+	       sized it fell well short.  */
+	    if (nbuckets < eqs_index / 4)
+	      rehash_equivs (eqs, eqs_index);
 	    break;
 	  }
 	else if (eqs[i].hash == h)
@@ -367,8 +509,8 @@ find_and_hash_each_line (current)
 
       line++;
 
-      while (*p++ != '\n')
-	;
+      p = memchr (p, '\n', bufend - (char const *) p);
+      p++;
     }
 
   /* Done with cache in local variables.  */
@@ -423,7 +565,7 @@ find_identical_ends (filevec)
   int buffered_prefix, prefix_count, prefix_mask;
 
   slurp (&filevec[0]);
-  if (filevec[0].desc != filevec[1].desc)
+  if (filevec[0].desc != filevec[1].desc || filevec[0].membuf)
     slurp (&filevec[1]);
   else
     {
@@ -507,7 +649,12 @@ find_identical_ends (filevec)
 	 of the identical prefix.  */
       beg0 = filevec[0].prefix_end + (n0 < n1 ? 0 : n0 - n1);
 
-      /* Scan back until chars don't match or we reach that point.  */
+      /* Scan back until chars don't match or we reach that point,
+	 skipping over matching words first.  */
+      while ((size_t) (p0 - beg0) >= sizeof (word)
+	     && memcmp (p0 - sizeof (word) + 1, p1 - sizeof (word) + 1,
+			sizeof (word)) == 0)
+	p0 -= sizeof (word), p1 -= sizeof (word);
       for (; p0 != beg0; p0--, p1--)
 	if (*p0 != *p1)
 	  {
@@ -581,8 +728,7 @@ find_identical_ends (filevec)
 	    linbuf0 = (char const **) xrealloc (linbuf0, (alloc_lines0 *= 2)
 							 * sizeof(*linbuf0));
 	  linbuf0[l] = p0;
-	  while (*p0++ != '\n')
-	    ;
+	  p0 = (char *) memchr (p0, '\n', end0 - p0) + 1;
 	}
     }
   buffered_prefix = prefix_count && context < lines ? context : lines;
@@ -619,39 +765,6 @@ find_identical_ends (filevec)
   filevec[0].prefix_lines = filevec[1].prefix_lines = lines;
 }
 
-/* Largest primes less than some power of two, for nbuckets.  Values range
-   from useful to preposterous.  If one of these numbers isn't prime
-   after all, don't blame it on me, blame it on primes (6) . . . */
-static int const primes[] =
-{
-  509,
-  1021,
-  2039,
-  4093,
-  8191,
-  16381,
-  32749,
-#if 32767 < INT_MAX
-  65521,
-  131071,
-  262139,
-  524287,
-  1048573,
-  2097143,
-  4194301,
-  8388593,
-  16777213,
-  33554393,
-  67108859,			/* Preposterously large . . . */
-  134217689,
-  268435399,
-  536870909,
-  1073741789,
-  2147483647,
-#endif
-  0
-};
-
 /* Given a vector of two file_data objects, read the file associated
    with each one, and build the table of equivalence classes.
    Return 1 if either file appears to be a binary file.
@@ -666,7 +779,7 @@ read_files (filevec, pretend_binary)
   int skip_test = always_text_flag | pretend_binary;
   int appears_binary = pretend_binary | sip (&filevec[0], skip_test);
 
-  if (filevec[0].desc != filevec[1].desc)
+  if (filevec[0].desc != filevec[1].desc || filevec[0].membuf)
     appears_binary |= sip (&filevec[1], skip_test | appears_binary);
   else
     {
@@ -248,6 +248,359 @@ base_deregister (const char *update_dir, const char *file)
 
 
 
+/* The checkout cache.
+ *
+ * When $CVS_CHECKOUT_CACHE names a directory, base_checkout keeps a copy of
+ * each base file it builds in a subdirectory of it which is private to the
+ * user, named after the user's ID.  Later checkouts of the same text link to
+ * the copy rather than building it again.  Each copy is named after a digest
+ * of its archive's stat information and everything else its expansion
+ * depends on (see RCS_checkout_key), so copies made from an archive which
+ * has since changed are simply never used again.
+ *
+ * Copies are touched each time they are used.  At most once an hour, the
+ * least recently used are removed until the rest fit in
+ * $CVS_CHECKOUT_CACHE_SIZE bytes.
+ */
+
+/* The file in each user's cache directory whose modification time is when
+ * the cache was last pruned.
+ */
+#define CHECKOUT_CACHE_STAMP	".pruned"
+
+/* How many seconds go by between prunings of the checkout cache, and how old
+ * a temporary file left there has to be before it is removed.
+ */
+#define CHECKOUT_CACHE_INTERVAL	(60 * 60)
+
+/* How many bytes each user may keep in the checkout cache by default.  */
+#define CHECKOUT_CACHE_SIZE	((uintmax_t) 1024 * 1024 * 1024)
+
+struct checkout_cache_entry
+{
+    char *name;
+    off_t size;
+    time_t mtime;
+};
+
+static int
+checkout_cache_entry_cmp (const void *a, const void *b)
+{
+    const struct checkout_cache_entry *ea = a, *eb = b;
+
+    return ea->mtime < eb->mtime ? -1 : ea->mtime > eb->mtime;
+}
+
+
+
+/* Return how many bytes each user may keep in the checkout cache: the
+ * number in $CVS_CHECKOUT_CACHE_SIZE, which may end in k, M, G or T or be
+ * "unlimited", or else CHECKOUT_CACHE_SIZE.
+ */
+static uintmax_t
+checkout_cache_size (void)
+{
+    const char *env = getenv (CHECKOUT_CACHE_SIZE_ENV);
+    uintmax_t size, factor = 1;
+    char *end;
+
+    if (!env || !*env)
+	return CHECKOUT_CACHE_SIZE;
+    if (!strcasecmp (env, "unlimited"))
+	return UINTMAX_MAX;
+
+    errno = 0;
+    size = strtoumax (env, &end, 10);
+    switch (*end)
+    {
+	case 'T':
+	    factor *= 1024;
+	case 'G':
+	    factor *= 1024;
+	case 'M':
+	    factor *= 1024;
+	case 'k':
+	    factor *= 1024;
+	    end++;
+	    break;
+    }
+    if (!isdigit ((unsigned char) *env) || *end || errno)
+    {
+	error (0, 0, "warning: ignoring invalid %s `%s'",
+	       CHECKOUT_CACHE_SIZE_ENV, env);
+	return CHECKOUT_CACHE_SIZE;
+    }
+    return size > UINTMAX_MAX / factor ? UINTMAX_MAX : size * factor;
+}
+
+
+
+/* If DIR has not been pruned for CHECKOUT_CACHE_INTERVAL seconds, remove
+ * abandoned temporary files from it, and then the least recently used
+ * copies until the rest fit within checkout_cache_size bytes.
+ */
+static void
+checkout_cache_prune (const char *dir)
+{
+    struct checkout_cache_entry *entries = NULL;
+    size_t nentries = 0, nalloc = 0, i;
+    uintmax_t total = 0, max;
+    struct dirent *dp;
+    struct stat sb;
+    time_t now;
+    char *stamp;
+    DIR *dirp;
+    int fd;
+
+    now = time (NULL);
+    stamp = dir_append (dir, CHECKOUT_CACHE_STAMP);
+    if (stat (stamp, &sb) == 0 && sb.st_mtime > now - CHECKOUT_CACHE_INTERVAL)
+    {
+	free (stamp);
+	return;
+    }
+
+    /* Touch the stamp first, so that other processes leave this to us.  */
+    fd = CVS_OPEN (stamp, O_WRONLY | O_CREAT, 0600);
+    if (fd < 0 || close (fd) < 0 || utime (stamp, NULL) < 0)
+    {
+	error (0, errno, "warning: cannot update `%s'", stamp);
+	free (stamp);
+	return;
+    }
+    free (stamp);
+
+    TRACE (TRACE_FUNCTION, "checkout_cache_prune (%s)", dir);
+
+    if ((dirp = CVS_OPENDIR (dir)) == NULL)
+    {
+	error (0, errno, "warning: cannot open directory `%s'", dir);
+	return;
+    }
+    errno = 0;
+    while ((dp = CVS_READDIR (dirp)) != NULL)
+    {
+	char *path;
+
+	if (dp->d_name[0] == '.')
+	    continue;
+	path = dir_append (dir, dp->d_name);
+	if (lstat (path, &sb) < 0 || !S_ISREG (sb.st_mode))
+	    free (path);
+	else if (strchr (dp->d_name, '.'))
+	{
+	    /* A temporary file from checkout_cache_add.  */
+	    if (sb.st_mtime <= now - CHECKOUT_CACHE_INTERVAL)
+		CVS_UNLINK (path);
+	    free (path);
+	}
+	else
+	{
+	    if (nentries == nalloc)
+		entries = x2nrealloc (entries, &nalloc, sizeof *entries);
+	    entries[nentries].name = path;
+	    entries[nentries].size = sb.st_size;
+	    entries[nentries].mtime = sb.st_mtime;
+	    nentries++;
+	    total += sb.st_size;
+	}
+	errno = 0;
+    }
+    if (errno != 0)
+	error (0, errno, "warning: cannot read directory `%s'", dir);
+    CVS_CLOSEDIR (dirp);
+
+    max = checkout_cache_size ();
+    qsort (entries, nentries, sizeof *entries, checkout_cache_entry_cmp);
+    for (i = 0; i < nentries; i++)
+    {
+	if (total > max)
+	{
+	    TRACE (TRACE_DATA, "checkout_cache_prune: removing `%s'",
+		   entries[i].name);
+	    if (CVS_UNLINK (entries[i].name) == 0)
+		total -= entries[i].size;
+	}
+	free (entries[i].name);
+    }
+    if (entries)
+	free (entries);
+}
+
+
+
+/* Return this user's directory in the checkout cache, or NULL when there is
+ * none or it is not safe to use.  The cache directory itself may be shared,
+ * but only if nobody else can remove or replace what is in it, as in a
+ * directory like /tmp with its sticky bit set.  The user's own directory
+ * must be writable only by the user.
+ */
+static const char *
+checkout_cache_dir (void)
+{
+    static bool checked;
+    static char *userdir;
+    const char *dir;
+    struct stat sb;
+    uid_t uid;
+
+    if (checked)
+	return userdir;
+    checked = true;
+
+    dir = getenv (CHECKOUT_CACHE_ENV);
+    if (!dir || !*dir)
+	return NULL;
+
+    uid = geteuid ();
+    if (!ISABSOLUTE (dir) || lstat (dir, &sb) < 0)
+    {
+	error (0, ISABSOLUTE (dir) ? errno : 0,
+	       "warning: cannot use checkout cache `%s'", dir);
+	return NULL;
+    }
+    if (!S_ISDIR (sb.st_mode)
+	|| (sb.st_uid != uid && sb.st_uid != 0)
+	|| (sb.st_mode & (S_IWGRP | S_IWOTH) && !(sb.st_mode & S_ISVTX)))
+    {
+	error (0, 0,
+"warning: not using checkout cache `%s', which others may change",
+	       dir);
+	return NULL;
+    }
+
+    userdir = Xasprintf ("%s/%lu", dir, (unsigned long) uid);
+    if (CVS_MKDIR (userdir, 0700) < 0 && errno != EEXIST)
+    {
+	error (0, errno, "warning: cannot make directory `%s'", userdir);
+	free (userdir);
+	userdir = NULL;
+	return NULL;
+    }
+    if (lstat (userdir, &sb) < 0
+	|| !S_ISDIR (sb.st_mode)
+	|| sb.st_uid != uid
+	|| sb.st_mode & (S_IRWXG | S_IRWXO))
+    {
+	error (0, 0,
+"warning: not using checkout cache `%s', which others may change",
+	       userdir);
+	free (userdir);
+	userdir = NULL;
+	return NULL;
+    }
+
+    checkout_cache_prune (userdir);
+    return userdir;
+}
+
+
+
+/* Return the name of the file in the checkout cache which holds REV of RCS as
+ * checked out with TAG and OPTIONS, or NULL when there is no cache.
+ */
+static char *
+checkout_cache_name (RCSNode *rcs, const char *rev, const char *tag,
+		     const char *options)
+{
+    const char *dir = checkout_cache_dir ();
+    char *key, *name;
+
+    if (!dir || !(key = RCS_checkout_key (rcs, rev, tag, options)))
+	return NULL;
+    name = dir_append (dir, key);
+    free (key);
+    return name;
+}
+
+
+
+/* Make TO, which must not exist, a copy of the read-only file FROM for the
+ * checkout cache: a hard link if possible, else a real copy.  Return false,
+ * leaving no TO behind, if neither works.  Failing is never fatal, since the
+ * cache may be full.
+ */
+static bool
+checkout_cache_copy (const char *from, const char *to)
+{
+    char buf[8192];
+    int fdin, fdout;
+    ssize_t n;
+    bool ok;
+
+    if (link (from, to) == 0)
+	return true;
+    /* Copy only across file systems.  */
+    if (errno != EXDEV && errno != EPERM && errno != EMLINK)
+	return false;
+
+    if ((fdin = CVS_OPEN (from, O_RDONLY | OPEN_BINARY)) < 0)
+	return false;
+    if ((fdout = CVS_OPEN (to, O_WRONLY | O_CREAT | O_EXCL | OPEN_BINARY,
+			   0444)) < 0)
+    {
+	close (fdin);
+	return false;
+    }
+
+    ok = true;
+    while ((n = read (fdin, buf, sizeof buf)) > 0)
+	if (write (fdout, buf, n) != n)
+	{
+	    ok = false;
+	    break;
+	}
+    if (n < 0)
+	ok = false;
+    close (fdin);
+    if (close (fdout) < 0)
+	ok = false;
+
+    if (!ok)
+	CVS_UNLINK (to);
+    return ok;
+}
+
+
+
+/* Make BASEFILE, which must not exist, a copy of CACHEFILE, if that is a
+ * read-only file belonging to this user, and mark CACHEFILE as used.
+ */
+static bool
+checkout_cache_get (const char *cachefile, const char *basefile)
+{
+    struct stat sb;
+
+    if (lstat (cachefile, &sb) < 0
+	|| !S_ISREG (sb.st_mode)
+	|| sb.st_uid != geteuid ()
+	|| sb.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)
+	|| !checkout_cache_copy (cachefile, basefile))
+	return false;
+
+    /* For checkout_cache_prune.  */
+    (void) utime (cachefile, NULL);
+    return true;
+}
+
+
+
+/* Put a copy of the new base file BASEFILE into the checkout cache as
+ * CACHEFILE, replacing anything checkout_cache_get refused to use.
+ */
+static void
+checkout_cache_add (const char *basefile, const char *cachefile)
+{
+    char *tmp = Xasprintf ("%s.%ld", cachefile, (long) getpid ());
+
+    if (checkout_cache_copy (basefile, tmp)
+	&& CVS_RENAME (tmp, cachefile) < 0)
+	CVS_UNLINK (tmp);
+    free (tmp);
+}
+
+
+
 int
 base_checkout (RCSNode *rcs, struct file_info *finfo,
 	       const char *prev, const char *rev, const char *ptag,
@@ -255,6 +608,7 @@ base_checkout (RCSNode *rcs, struct file_info *finfo,
 {
     int status;
     char *basefile;
+    char *cachefile;
 
     TRACE (TRACE_FUNCTION, "base_checkout (%s, %s, %s, %s, %s, %s, %s)",
 	   finfo->fullname, prev, rev, ptag, tag, poptions, options);
@@ -267,13 +621,33 @@ base_checkout (RCSNode *rcs, struct file_info *finfo,
     assert (!current_parsed_root->isremote);
 
     basefile = make_base_file_name (finfo->file, rev);
-    status = RCS_checkout (rcs, basefile, rev, tag, options,
-			   NULL, NULL, NULL);
 
-    /* Always mark base files as read-only, to make disturbing them
-     * accidentally at least slightly challenging.
+    /* Any old base file may be a link into the checkout cache, so remove it
+     * rather than letting RCS_checkout write through it.
      */
-    xchmod (basefile, false);
+    if (unlink_file (basefile) < 0 && !existence_error (errno))
+	error (1, errno, "cannot remove `%s'", basefile);
+
+    cachefile = checkout_cache_name (rcs, rev, tag, options);
+    if (cachefile && checkout_cache_get (cachefile, basefile))
+    {
+	TRACE (TRACE_DATA, "base_checkout: using `%s'", cachefile);
+	status = 0;
+    }
+    else
+    {
+	status = RCS_checkout (rcs, basefile, rev, tag, options,
+			       NULL, NULL, NULL);
+
+	/* Always mark base files as read-only, to make disturbing them
+	 * accidentally at least slightly challenging.
+	 */
+	xchmod (basefile, false);
+
+	if (cachefile && status == 0)
+	    checkout_cache_add (basefile, cachefile);
+    }
+    free (cachefile);
     free (basefile);
 
     /* FIXME: Verify the signature in local mode.  */
@@ -443,6 +817,12 @@ ibase_copy (struct file_info *finfo, const char *rev, const char *flags,
     copy_file (basefile, finfo->file);
     if (flags[1] == 'y')
 	xchmod (finfo->file, true);
+    /* A base file from the checkout cache may be much older than this
+     * checkout, and copy_file gives the working file the same time, which
+     * could leave it looking older than things built from what it replaced.
+     */
+    if (checkout_cache_dir ())
+	(void) utime (finfo->file, NULL);
 
 #ifdef SERVER_SUPPORT
     if (server_active && !STREQ (cvs_cmd_name, "export"))
@@ -503,6 +883,80 @@ base_remove (const char *file, const char *rev)
 
 
 
+/* Announce the merge of revisions REV1 and REV2 into FINFO.  */
+static void
+merge_message (const struct file_info *finfo, const char *rev1,
+	       const char *rev2)
+{
+    if (really_quiet)
+	return;
+
+    cvs_output ("Merging differences between ", 0);
+    cvs_output (rev1, 0);
+    cvs_output (" and ", 5);
+    cvs_output (rev2, 0);
+    cvs_output (" into `", 7);
+    if (!finfo->update_dir || STREQ (finfo->update_dir, "."))
+	cvs_output (finfo->file, 0);
+    else
+	cvs_output (finfo->fullname, 0);
+    cvs_output ("'\n", 2);
+}
+
+
+
+/* Merge revisions REV1 and REV2 for base_merge when there is no client to
+ * keep informed.  The revisions are checked out into memory and merged there
+ * rather than via temp files.
+ */
+static int
+local_merge (RCSNode *rcs, struct file_info *finfo, const char *ptag,
+	     const char *poptions, const char *options, const char *urev,
+	     const char *rev1, const char *rev2, bool join)
+{
+    char *text1, *text2;
+    size_t len1, len2;
+    int retval;
+
+    TRACE (TRACE_FUNCTION, "local_merge (%s, %s, %s)",
+	   finfo->fullname, rev1, rev2);
+
+    if (RCS_checkout_buffer (rcs, rev1, rev1, options, &text1, &len1))
+	error (1, 0, "checkout of revision %s of `%s' failed.\n",
+	       rev1, finfo->fullname);
+    if (join || noexec || suppress_bases)
+    {
+	if (RCS_checkout_buffer (rcs, rev2, rev2, options, &text2, &len2))
+	    error (1, 0, "checkout of revision %s of `%s' failed.\n",
+		   rev2, finfo->fullname);
+    }
+    else
+    {
+	/* The base file is wanted anyhow, so read REV2 back from it.  */
+	char *basefile;
+	size_t size = 0;
+
+	if (base_checkout (rcs, finfo, urev, rev2, ptag, rev2, poptions,
+			   options))
+	    error (1, 0, "checkout of revision %s of `%s' failed.\n",
+		   rev2, finfo->fullname);
+	basefile = make_base_file_name (finfo->file, rev2);
+	text2 = NULL;
+	get_file (basefile, basefile, "r", &text2, &size, &len2);
+	free (basefile);
+    }
+
+    merge_message (finfo, rev1, rev2);
+    retval = merge_buffers (finfo->file, finfo->file, text1, len1, rev1,
+			    text2, len2, rev2);
+
+    free (text1);
+    free (text2);
+    return retval;
+}
+
+
+
 /* Merge revisions REV1 and REV2. */
 int
 base_merge (RCSNode *rcs, struct file_info *finfo, const char *ptag,
@@ -515,6 +969,10 @@ base_merge (RCSNode *rcs, struct file_info *finfo, const char *ptag,
     assert (!options || !options[0]
 	    || (options[0] == '-' && options[1] == 'k'));
 
+    if (!server_active)
+	return local_merge (rcs, finfo, ptag, poptions, options, urev,
+			    rev1, rev2, join);
+
     /* Check out chosen revisions.  The error message when RCS_checkout
        fails is not very informative -- it is taken verbatim from RCS 5.7,
        and relies on RCS_checkout saying something intelligent upon failure. */
@@ -540,27 +998,14 @@ base_merge (RCSNode *rcs, struct file_info *finfo, const char *ptag,
     }
 
 
-    if (!server_active || !server_use_bases())
+    if (!server_use_bases())
     {
 	/* Merge changes. */
 	/* It may violate the current abstraction to fail to generate the same
 	 * files on the server as will be generated on the client, but I do not
 	 * believe that they are being used currently and it saves server CPU.
 	 */
-	if (!really_quiet)
-	{
-	    cvs_output ("Merging differences between ", 0);
-	    cvs_output (rev1, 0);
-	    cvs_output (" and ", 5);
-	    cvs_output (rev2, 0);
-	    cvs_output (" into `", 7);
-	    if (!finfo->update_dir || STREQ (finfo->update_dir, "."))
-		cvs_output (finfo->file, 0);
-	    else
-		cvs_output (finfo->fullname, 0);
-	    cvs_output ("'\n", 2);
-	}
-
+	merge_message (finfo, rev1, rev2);
 	retval = merge (finfo->file, finfo->file, f1, rev1, f2, rev2);
     }
     else
@@ -727,12 +727,25 @@ buf_length (struct buffer *buf)
 int
 buf_input_data (struct buffer *buf, size_t *countp)
 {
+    return buf_input_data_max (buf, SIZE_MAX, countp);
+}
+
+
+
+/*
+ * Like buf_input_data, but read no more than MAX bytes.
+ */
+int
+buf_input_data_max (struct buffer *buf, size_t max, size_t *countp)
+{
+    size_t count = 0;
+
     assert (buf->input != NULL);
 
     if (countp != NULL)
 	*countp = 0;
 
-    while (1)
+    while (count < max)
     {
 	int status;
 	size_t get, nbytes;
@@ -763,6 +776,8 @@ buf_input_data (struct buffer *buf, size_t *countp)
 
 	get = ((buf->last->text + BUFFER_DATA_SIZE)
 	       - (buf->last->bufp + buf->last->size));
+	if (get > max - count)
+	    get = max - count;
 
 	status = (*buf->input) (buf->closure,
 				buf->last->bufp + buf->last->size,
@@ -771,8 +786,9 @@ buf_input_data (struct buffer *buf, size_t *countp)
 	    return status;
 
 	buf->last->size += nbytes;
+	count += nbytes;
 	if (countp != NULL)
-	    *countp += nbytes;
+	    *countp = count;
 
 	if (nbytes < get)
 	{
@@ -782,7 +798,7 @@ buf_input_data (struct buffer *buf, size_t *countp)
 	}
     }
 
-    /*NOTREACHED*/
+    return 0;
 }
 
 
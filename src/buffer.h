@@ -170,6 +170,7 @@ int buf_read_file (FILE *, long, struct buffer_data **, struct buffer_data **);
 int buf_read_file_to_eof (FILE *, struct buffer_data **,
 			  struct buffer_data **);
 int buf_input_data (struct buffer *, size_t *);
+int buf_input_data_max (struct buffer *, size_t, size_t *);
 int buf_read_line (struct buffer *, char **, size_t *);
 int buf_read_short_line (struct buffer *buf, char **line, size_t *lenp,
                          size_t max);
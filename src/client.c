@@ -114,6 +114,7 @@ int tag (int argc, char **argv);
 int update (int argc, char **argv);
 
 static size_t try_read_from_server (char *, size_t);
+static void read_ahead_from_server (void);
 
 static void auth_server (cvsroot_t *, struct buffer *, struct buffer *,
 			 int, int, struct hostent *);
@@ -711,6 +712,47 @@ int is_valid_client_path (const char *pathname)
 
 
 
+/* The entries list of the directory the last response was for, kept open so
+ * that a run of responses for files in one directory appends to its
+ * Entries.Log rather than rewriting its Entries file for every file.
+ * BATCH_DIR is relative to TOPLEVEL_WD.
+ */
+static List *batch_entries;
+static char *batch_dir;
+static char *batch_update_dir;
+
+
+
+/* Close the entries list kept open by call_in_directory, if any.  */
+static void
+close_batch_entries (void)
+{
+    struct saved_cwd cwd;
+
+    if (!batch_entries)
+	return;
+
+    if (save_cwd (&cwd))
+	error (1, errno, "Failed to save current directory.");
+    if (CVS_CHDIR (toplevel_wd) < 0)
+	error (1, errno, "could not chdir to %s", toplevel_wd);
+    if (CVS_CHDIR (batch_dir) < 0)
+	error (1, errno, "could not chdir to %s", batch_dir);
+    Entries_Close (batch_entries, batch_update_dir);
+    if (restore_cwd (&cwd))
+	error (1, errno, "Failed to restore current directory, `%s'.",
+	       cwd.name);
+    free_cwd (&cwd);
+
+    batch_entries = NULL;
+    free (batch_dir);
+    batch_dir = NULL;
+    free (batch_update_dir);
+    batch_update_dir = NULL;
+}
+
+
+
 /*
  * Do all the processing for PATHNAME, where pathname consists of the
  * repository and the filename.  When this function is called, it is expected
@@ -843,6 +885,13 @@ call_in_directory (const char *pathname,
     else if (CVS_CHDIR (toplevel_wd) < 0)
 	error (1, errno, "could not chdir to %s", toplevel_wd);
 
+    /* Done with the previous directory?  This needs to happen before
+     * Subdir_Register below writes to a parent's Entries.Log behind the back
+     * of its open list.
+     */
+    if (batch_entries && !STREQ (batch_dir, dir))
+	close_batch_entries ();
+
     pdir = dir_name (dir);
     if (!STREQ (pdir, ".") /* Make an exception for the top level directory.  */
 	&& !(STREQ (cvs_cmd_name, "export") ? isdir (pdir) : hasAdmin (pdir)))
@@ -875,7 +924,9 @@ call_in_directory (const char *pathname,
     if (CVS_CHDIR (dir) < 0)
 	error (1, errno, "could not chdir to %s", dir);
 
-    if (!STREQ (cvs_cmd_name, "export"))
+    if (batch_entries)
+	last_entries = batch_entries;
+    else if (!STREQ (cvs_cmd_name, "export"))
     {
 	last_entries = Entries_Open (0, update_dir);
 
@@ -909,8 +960,15 @@ call_in_directory (const char *pathname,
     finfo.entries = last_entries;
 
     (*func) (data, &finfo);
-    if (last_entries)
-	Entries_Close (last_entries, update_dir);
+    if (last_entries && !batch_entries)
+    {
+	/* Leave it open for the next response.  get_server_responses closes
+	 * it once there are no more.
+	 */
+	batch_entries = last_entries;
+	batch_dir = xstrdup (dir);
+	batch_update_dir = xstrdup (update_dir);
+    }
     free (dir);
     free (bdir);
     free (pdir);
@@ -1290,12 +1348,13 @@ newfilename (const char *filename)
 
 
 
-static char *
-read_file_from_server (const char *fullname, char **mode_string, size_t *size)
+/* Read the mode and size lines which precede a file sent by the server.
+   Return true if the contents which follow are gzipped.  */
+static bool
+read_file_header (char **mode_string, size_t *size)
 {
     char *size_string;
     bool use_gzip;
-    char *buf;
     char *s;
 
     read_line (mode_string);
@@ -1314,6 +1373,19 @@ read_file_from_server (const char *fullname, char **mode_string, size_t *size)
     *size = strto_file_size (s);
     free (size_string);
 
+    return use_gzip;
+}
+
+
+
+static char *
+read_file_from_server (const char *fullname, char **mode_string, size_t *size)
+{
+    bool use_gzip;
+    char *buf;
+
+    use_gzip = read_file_header (mode_string, size);
+
     buf = xmalloc (*size);
     read_from_server (buf, *size);
 
@@ -1333,6 +1405,82 @@ read_file_from_server (const char *fullname, char **mode_string, size_t *size)
 
 
 
+/* Write LEN bytes of BUF to FD, which was opened for FULLNAME, retrying
+   after short writes.  */
+static void
+write_all (int fd, const char *fullname, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+	ssize_t n = write (fd, buf, len);
+
+	if (n < 0)
+	{
+#ifdef EINTR
+	    if (errno == EINTR)
+		continue;
+#endif
+	    error (1, errno, "writing %s", quote (fullname));
+	}
+	buf += n;
+	len -= n;
+    }
+}
+
+
+
+/* Like read_file_from_server, but write the contents to FD a block at a
+   time as they arrive, so that large files need not fit in memory.  If
+   CK is non-NULL, store the MD5 checksum of the contents there.  */
+static void
+write_file_from_server (int fd, const char *fullname, char **mode_string,
+			checksum_t *ck)
+{
+    struct md5_ctx context;
+    size_t size;
+
+    if (ck)
+	md5_init_ctx (&context);
+
+    if (read_file_header (mode_string, &size))
+    {
+	/* Only servers which predate Gzip-stream compress files one at a
+	   time.  Don't bother streaming those.  */
+	char *buf, *outbuf;
+
+	buf = xmalloc (size);
+	read_from_server (buf, size);
+	if (gunzip_in_mem (fullname, (unsigned char *) buf, &size, &outbuf))
+	    error (1, 0, "aborting due to compression error");
+	free (buf);
+
+	write_all (fd, fullname, outbuf, size);
+	if (ck)
+	    md5_process_bytes (outbuf, size, &context);
+	free (outbuf);
+    }
+    else
+    {
+	char buf[32768];
+
+	while (size > 0)
+	{
+	    size_t len = size < sizeof buf ? size : sizeof buf;
+
+	    read_from_server (buf, len);
+	    write_all (fd, fullname, buf, len);
+	    if (ck)
+		md5_process_bytes (buf, len, &context);
+	    size -= len;
+	}
+    }
+
+    if (ck)
+	md5_finish_ctx (&context, ck->char_checksum);
+}
+
+
+
 /* Cache for OpenPGP signatures so they may be written to a file only on a
  * successful commit.
  */
@@ -1366,6 +1514,7 @@ update_entries (void *data_arg, const struct file_info *finfo)
 
     TRACE (TRACE_FUNCTION, "update_entries (%s)", finfo->fullname);
 
+    read_ahead_from_server ();
     read_line (&entries_line);
 
     /*
@@ -1415,6 +1564,7 @@ update_entries (void *data_arg, const struct file_info *finfo)
 	size_t size;
 	char *buf;
 	bool patch_failed;
+	checksum_t ck;
 
 	if (get_verify_checkouts (true) && !STREQ (cvs_cmd_name, "export"))
 	    error (get_verify_checkouts_fatal (), 0,
@@ -1448,8 +1598,6 @@ update_entries (void *data_arg, const struct file_info *finfo)
 	    return;
 	}
 
-	buf = read_file_from_server (finfo->fullname, &mode_string, &size);
-
         /* Some systems, like OS/2 and Windows NT, end lines with CRLF
            instead of just LF.  Format translation is done in the C
            library I/O funtions.  Here we tell them whether or not to
@@ -1461,7 +1609,9 @@ update_entries (void *data_arg, const struct file_info *finfo)
 	else
 	    bin = false;
 
-	if (data->contents != UPDATE_ENTRIES_RCS_DIFF)
+	if (data->contents == UPDATE_ENTRIES_RCS_DIFF)
+	    buf = read_file_from_server (finfo->fullname, &mode_string, &size);
+	else
 	{
 	    int fd;
 
@@ -1481,12 +1631,11 @@ update_entries (void *data_arg, const struct file_info *finfo)
 		   the same problem.  */
 		error (0, errno, "cannot write %s", quote (finfo->fullname));
 		free (temp_filename);
-		free (buf);
 		goto discard_file_and_return;
 	    }
 
-	    if (write (fd, buf, size) != size)
-		error (1, errno, "writing %s", quote (finfo->fullname));
+	    write_file_from_server (fd, finfo->fullname, &mode_string, &ck);
+	    buf = NULL;
 
 	    if (close (fd) < 0)
 		error (1, errno, "writing %s", quote (finfo->fullname));
@@ -1591,35 +1740,9 @@ update_entries (void *data_arg, const struct file_info *finfo)
 
 	if (stored_checksum_valid && !patch_failed)
 	{
-	    FILE *e;
-	    struct md5_ctx context;
-	    unsigned char buf[8192];
-	    unsigned len;
-	    checksum_t ck;
-
-	    /*
-	     * Compute the MD5 checksum.  This will normally only be
-	     * used when receiving a patch, so we always compute it
-	     * here on the final file, rather than on the received
-	     * data.
-	     *
-	     * Note that if the file is a text file, we should read it
-	     * here using text mode, so its lines will be terminated the same
-	     * way they were transmitted.
-	     */
-	    e = CVS_FOPEN (finfo->file, "r");
-	    if (!e)
-	        error (1, errno, "could not open %s", quote (finfo->fullname));
-
-	    md5_init_ctx (&context);
-	    while ((len = fread (buf, 1, sizeof buf, e)) != 0)
-		md5_process_bytes (buf, len, &context);
-	    if (ferror (e))
-		error (1, errno, "could not read %s", quote (finfo->fullname));
-	    md5_finish_ctx (&context, ck.char_checksum);
-
-	    fclose (e);
-
+	    /* A patch which applied has had its checksum checked
+	       already, so CK is the checksum of the data received,
+	       computed as it was written out.  */
 	    stored_checksum_valid = 0;
 
 	    if (memcmp (ck.char_checksum, stored_ck.char_checksum, 16) != 0)
@@ -2117,8 +2240,11 @@ client_base_checkout (void *data_arg, const struct file_info *finfo)
     char *basefile;
     char *fullbase;
 
-    /* File buf from net.  May be an RCS diff from PREV to REV.  */
-    char *buf;
+    /* Whether the server sends an RCS diff from PREV to REV, and the
+     * patched file once it has been applied.
+     */
+    bool patch;
+    char *buf = NULL;
     char *mode_string;
     size_t size;
 
@@ -2128,6 +2254,8 @@ client_base_checkout (void *data_arg, const struct file_info *finfo)
 
     TRACE (TRACE_FUNCTION, "client_base_checkout (%s)", finfo->fullname);
 
+    read_ahead_from_server ();
+
     /* Read OPTIONS, PREV, and REV from the server.  */
     read_line (&options);
     read_line (&prev);
@@ -2148,25 +2276,17 @@ client_base_checkout (void *data_arg, const struct file_info *finfo)
     else
 	basefile = make_base_file_name (finfo->file, rev);
 
-    /* FIXME?  It might be nice to verify that base files aren't being
-     * overwritten except when the keyword mode has changed.
-     */
-    if (!*istemp && isfile (basefile))
-	force_xchmod (basefile, true);
-
     if (*istemp) fullbase = xstrdup (basefile);
     else fullbase = dir_append (finfo->update_dir, basefile);
 
-    /* Read the file or patch from the server.  */
-    /* FIXME: Read/write to file is repeated and could be optimized to
-     * write directly to disk without using so much mem.
-     */
-    buf = read_file_from_server (fullbase, &mode_string, &size);
-
     if (options) bin = STREQ (options, "-kb");
     else bin = false;
 
-    if (*prev && !STREQ (prev, rev))
+    /* Read the patch from the server.  Whole files are written straight
+     * to disk below.
+     */
+    patch = *prev && !STREQ (prev, rev);
+    if (patch)
     {
 	char *filebuf;
 	size_t filebufsize;
@@ -2178,6 +2298,8 @@ client_base_checkout (void *data_arg, const struct file_info *finfo)
 
 	/* Handle UPDATE_ENTRIES_RCS_DIFF.  */
 
+	buf = read_file_from_server (fullbase, &mode_string, &size);
+
 	pbasefile = make_base_file_name (finfo->file, prev);
 	pfullbase = dir_append (finfo->update_dir, pbasefile);
 
@@ -2223,12 +2345,38 @@ client_base_checkout (void *data_arg, const struct file_info *finfo)
 	bool verify = get_verify_checkouts (true);
 
 	if (!*istemp)
+	{
 	    cvs_xmkdir (CVSADM_BASE, NULL, MD_EXIST_OK);
-	e = xfopen (basefile, bin ? FOPEN_BINARY_WRITE : "w");
-	if (fwrite (buf, sizeof *buf, size, e) != size)
-	    error (1, errno, "cannot write `%s'", fullbase);
-	if (fclose (e) == EOF)
-	    error (0, errno, "cannot close `%s'", fullbase);
+
+	    /* FIXME?  It might be nice to verify that base files aren't being
+	     * overwritten except when the keyword mode has changed.
+	     *
+	     * Replace rather than write through the old base file, which a
+	     * local checkout may have linked into the checkout cache.
+	     */
+	    if (unlink_file (basefile) < 0 && !existence_error (errno))
+		error (1, errno, "cannot remove `%s'", fullbase);
+	}
+	if (patch)
+	{
+	    e = xfopen (basefile, bin ? FOPEN_BINARY_WRITE : "w");
+	    if (fwrite (buf, sizeof *buf, size, e) != size)
+		error (1, errno, "cannot write `%s'", fullbase);
+	    if (fclose (e) == EOF)
+		error (0, errno, "cannot close `%s'", fullbase);
+	}
+	else
+	{
+	    int fd = CVS_OPEN (basefile,
+			       O_WRONLY | O_CREAT | O_TRUNC
+			       | (bin ? OPEN_BINARY : 0),
+			       0666);
+	    if (fd < 0)
+		error (1, errno, "cannot write `%s'", fullbase);
+	    write_file_from_server (fd, fullbase, &mode_string, NULL);
+	    if (close (fd) < 0)
+		error (0, errno, "cannot close `%s'", fullbase);
+	}
 
 	status = change_mode (basefile, mode_string, 1);
 	if (status != 0)
@@ -3958,6 +4106,44 @@ read_from_server (char *buf, size_t len)
 
 
 
+/* How much read_ahead_from_server will buffer.  */
+#define READ_AHEAD_MAX	(1024 * 1024)
+
+/*
+ * Read whatever the server has sent so far without waiting for more, until
+ * READ_AHEAD_MAX bytes are buffered.  Called before writing files to disk,
+ * so that the server can go on sending, rather than stalling on a full pipe
+ * or TCP window, while we are busy.
+ */
+static void
+read_ahead_from_server (void)
+{
+    size_t have = buf_length (global_from_server);
+    int status;
+
+    if (have >= READ_AHEAD_MAX)
+	return;
+
+    status = set_nonblock (global_from_server);
+    if (status == 0)
+    {
+	status = buf_input_data_max (global_from_server,
+				     READ_AHEAD_MAX - have, NULL);
+	if (status == -1)
+	    /* Leave end of file for the next read to report.  */
+	    status = 0;
+    }
+    if (status == 0)
+	status = set_block (global_from_server);
+
+    if (status == -2)
+	error (1, 0, "out of memory");
+    else if (status != 0)
+	error (1, status, "reading from server");
+}
+
+
+
 /* Get some server responses and process them.
  *
  * RETURNS
@@ -4011,6 +4197,8 @@ get_server_responses (void)
 	free (cmd);
     } while (rs->type == response_type_normal);
 
+    close_batch_entries ();
+
     if (updated_fname)
     {
 	/* Output the previous message now.  This can happen
@@ -5065,6 +5253,9 @@ send_arg (const char *string)
 
 
 
+/* How much of a modified file send_modified reads at a time.  */
+#define SEND_BLOCK_SIZE	65536
+
 /* VERS->OPTIONS specifies whether the file is binary or not.  NOTE: BEFORE
    using any other fields of the struct vers, we would need to fix
    client_process_import_file to set them up.  */
@@ -5078,6 +5269,7 @@ send_modified (const char *file, const char *short_pathname, Vers_TS *vers)
     char *mode_string;
     size_t bufsize;
     int bin;
+    bool stream;
 
     TRACE (TRACE_FUNCTION, "Sending file `%s' to server", file);
 
@@ -5087,14 +5279,6 @@ send_modified (const char *file, const char *short_pathname, Vers_TS *vers)
 
     mode_string = mode_to_string (sb.st_mode);
 
-    /* Beware: on systems using CRLF line termination conventions,
-       the read and write functions will convert CRLF to LF, so the
-       number of characters read is not the same as sb.st_size.  Text
-       files should always be transmitted using the LF convention, so
-       we don't want to disable this conversion.  */
-    bufsize = sb.st_size;
-    buf = xmalloc (bufsize);
-
     /* Is the file marked as containing binary data by the "-kb" flag?
        If so, make sure to open it in binary mode: */
 
@@ -5127,10 +5311,25 @@ send_modified (const char *file, const char *short_pathname, Vers_TS *vers)
     if (fd < 0)
 	error (1, errno, "reading %s", short_pathname);
 
+    /* Beware: on systems using CRLF line termination conventions,
+       the read and write functions will convert CRLF to LF, so the
+       number of characters read is not the same as sb.st_size.  Text
+       files should always be transmitted using the LF convention, so
+       we don't want to disable this conversion.  Elsewhere, the size
+       is known up front and the file can be sent a block at a time.  */
+    stream = bin || !OPEN_BINARY;
+#ifdef BROKEN_READWRITE_CONVERSION
+    if (!bin)
+	/* FD is for the converted copy.  */
+	stream = false;
+#endif
+
     if (file_gzip_level && sb.st_size > 100)
     {
 	size_t newsize = 0;
 
+	bufsize = sb.st_size;
+	buf = xmalloc (bufsize);
 	if (read_and_gzip (fd, short_pathname, &buf,
 			   &bufsize, &newsize,
 			   file_gzip_level))
@@ -5152,11 +5351,48 @@ send_modified (const char *file, const char *short_pathname, Vers_TS *vers)
 
           send_to_server ((char *) buf, newsize);
         }
+	free (buf);
+    }
+    else if (stream)
+    {
+	off_t left = sb.st_size;
+	char tmp[80];
+
+	send_to_server ("Modified ", 0);
+	send_to_server (file, 0);
+	send_to_server ("\012", 1);
+	send_to_server (mode_string, 0);
+	send_to_server ("\012", 1);
+	sprintf (tmp, "%" PRIuMAX "\012", (uintmax_t) left);
+	send_to_server (tmp, 0);
+
+	bufsize = left < SEND_BLOCK_SIZE ? left : SEND_BLOCK_SIZE;
+	buf = xmalloc (bufsize ? bufsize : 1);
+	while (left > 0)
+	{
+	    ssize_t len = read (fd, buf, left < bufsize ? left : bufsize);
+
+	    if (len < 0)
+		error (1, errno, "reading %s", short_pathname);
+	    if (len == 0)
+		/* The server has been promised more than this.  */
+		error (1, 0, "%s got shorter while it was being sent",
+		       quote (short_pathname));
+	    send_to_server ((char *) buf, len);
+	    left -= len;
+	}
+	free (buf);
+
+	if (close (fd) < 0)
+	    error (0, errno, "warning: can't close %s", short_pathname);
     }
     else
     {
     	int newsize;
 
+	bufsize = sb.st_size;
+	buf = xmalloc (bufsize);
+
         {
 	    unsigned char *bufp = buf;
 	    int len;
@@ -5204,8 +5440,8 @@ send_modified (const char *file, const char *short_pathname, Vers_TS *vers)
 	 */
 	if (newsize > 0)
 	    send_to_server ((char *) buf, newsize);
+	free (buf);
     }
-    free (buf);
     free (mode_string);
 }
 
@@ -5256,8 +5492,121 @@ struct send_data
     bool no_contents;
     bool backup_modified;
     bool force_signatures;
+    /* Whether to read ahead the files of each directory which look
+       modified; see send_prefetch.  */
+    bool prefetch;
 };
 
+
+
+#ifdef POSIX_FADV_WILLNEED
+/* How many bytes of files send_prefetch_file may ask for at a time.  */
+#define PREFETCH_MAX	(64 * 1024 * 1024)
+
+/* The directory send_prefetch last looked at.  */
+static char *prefetch_dir;
+
+/* Ask the system to start reading FILE, if it is a regular file of no more
+ * than *LEFT bytes, and take its size off *LEFT.
+ */
+static void
+send_prefetch_file (const char *file, size_t *left)
+{
+    struct stat sb;
+    int fd;
+
+    if (stat (file, &sb) < 0
+	|| !S_ISREG (sb.st_mode)
+	|| (uintmax_t) sb.st_size > *left)
+	return;
+
+    fd = CVS_OPEN (file, O_RDONLY | OPEN_BINARY);
+    if (fd < 0)
+	return;
+    TRACE (TRACE_DATA, "send_prefetch_file: reading ahead `%s'", file);
+    if (posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED) == 0)
+	*left -= sb.st_size;
+    close (fd);
+}
+
+
+
+/* Read ahead the file of NODE, an Entries node of the current directory, if
+ * its time stamp no longer matches.  CLOSURE points to the number of bytes
+ * which may still be asked for.
+ */
+static int
+send_prefetch_proc (Node *node, void *closure)
+{
+    Entnode *entdata = node->data;
+    struct stat sb;
+
+    if (entdata->type == ENT_FILE
+	&& (entdata->mtime == (time_t) -1
+	    || (stat (node->key, &sb) == 0 && sb.st_mtime != entdata->mtime)))
+	send_prefetch_file (node->key, closure);
+    return 0;
+}
+#endif /* POSIX_FADV_WILLNEED */
+
+
+
+/* On the first file of each directory, ask the system to start reading every
+ * file there which looks modified, so that while send_fileproc is busy
+ * sending one file, the disk or network file system is already fetching the
+ * next.  Nothing waits for the reads, which only warm the page cache.
+ */
+static void
+send_prefetch (const struct file_info *finfo)
+{
+#ifdef POSIX_FADV_WILLNEED
+    size_t left = PREFETCH_MAX;
+
+    if (prefetch_dir && STREQ (prefetch_dir, finfo->update_dir))
+	return;
+    if (prefetch_dir)
+	free (prefetch_dir);
+    prefetch_dir = xstrdup (finfo->update_dir);
+
+    walklist (finfo->entries, send_prefetch_proc, &left);
+#endif /* POSIX_FADV_WILLNEED */
+}
+
+
+
+/* Start a new send_files.  Read ahead the files named in ARGV, which callers
+ * such as commit only name when they are going to be sent.  Return true if
+ * every argument is a directory, so that send_prefetch should look at each
+ * directory instead.
+ */
+static bool
+send_prefetch_args (int argc, char **argv)
+{
+#ifdef POSIX_FADV_WILLNEED
+    size_t left = PREFETCH_MAX;
+    bool dirs = true;
+    int i;
+
+    if (prefetch_dir)
+    {
+	free (prefetch_dir);
+	prefetch_dir = NULL;
+    }
+
+    for (i = 0; i < argc; i++)
+	if (!isdir (argv[i]))
+	{
+	    dirs = false;
+	    send_prefetch_file (argv[i], &left);
+	}
+    return dirs;
+#else /* !POSIX_FADV_WILLNEED */
+    return false;
+#endif /* POSIX_FADV_WILLNEED */
+}
+
+
+
 /* Deal with one file.  */
 static int
 send_fileproc (void *callerdat, struct file_info *finfo)
@@ -5272,6 +5621,9 @@ send_fileproc (void *callerdat, struct file_info *finfo)
 
     TRACE (TRACE_FLOW, "send_fileproc (%s)", finfo->fullname);
 
+    if (args->prefetch && finfo->entries)
+	send_prefetch (finfo);
+
     send_a_repository ("", finfo->repository, finfo->update_dir);
 
     xfinfo = *finfo;
@@ -5847,6 +6199,7 @@ send_files (int argc, char **argv, int local, int aflag, unsigned int flags)
     args.no_contents = flags & SEND_NO_CONTENTS;
     args.backup_modified = flags & BACKUP_MODIFIED_FILES;
     args.force_signatures = flags & FORCE_SIGNATURES;
+    args.prefetch = !args.no_contents && send_prefetch_args (argc, argv);
     err = start_recursion
 	(send_fileproc, send_filesdoneproc, send_dirent_proc,
          send_dirleave_proc, &args, argc, argv, local, W_LOCAL, aflag,
@@ -85,6 +85,7 @@ char *strerror (int);
 #define CVSADM_ENTBAK   "CVS/Entries.Backup"
 #define CVSADM_ENTLOG   "CVS/Entries.Log"
 #define CVSADM_ENTSTAT  "CVS/Entries.Static"
+#define CVSADM_ENTIDX   "CVS/Entries.Index"
 #define CVSADM_REP      "CVS/Repository."
 #define CVSADM_ROOT     "CVS/Root."
 #define CVSADM_TAG      "CVS/Tag."
@@ -94,12 +95,15 @@ char *strerror (int);
 #define CVSADM_BASEREV   "CVS/Baserev."
 #define CVSADM_BASEREVTMP "CVS/Baserev.tmp"
 #define CVSADM_TEMPLATE "CVS/Template."
+#define CVSADM_FSMONITOR "CVS/FSMonitor."
 #else /* !USE_VMS_FILENAMES */
 #define	CVSADM		"CVS"
 #define	CVSADM_ENT	"CVS/Entries"
 #define	CVSADM_ENTBAK	"CVS/Entries.Backup"
 #define CVSADM_ENTLOG	"CVS/Entries.Log"
 #define	CVSADM_ENTSTAT	"CVS/Entries.Static"
+/* A binary copy of the Entries file, for large directories.  */
+#define CVSADM_ENTIDX	"CVS/Entries.idx"
 #define	CVSADM_REP	"CVS/Repository"
 #define	CVSADM_ROOT	"CVS/Root"
 #define	CVSADM_TAG	"CVS/Tag"
@@ -112,6 +116,8 @@ char *strerror (int);
 #define CVSADM_BASEREVTMP "CVS/Baserev.tmp"
 /* File which contains the template for use in log messages.  */
 #define CVSADM_TEMPLATE "CVS/Template"
+/* The state kept for the command named by FSMONITOR_ENV.  */
+#define CVSADM_FSMONITOR "CVS/FSMonitor"
 #endif /* USE_VMS_FILENAMES */
 
 /* This is the special directory which we use to store various extra
@@ -245,6 +251,13 @@ char *strerror (int);
 
 #define	IGNORE_ENV	"CVSIGNORE"	/* More files to ignore */
 #define WRAPPER_ENV     "CVSWRAPPERS"   /* name of the wrapper file */
+#define FSMONITOR_ENV	"CVS_FSMONITOR"	/* tells what has changed in the
+					 * working directory */
+#define CHECKOUT_CACHE_ENV "CVS_CHECKOUT_CACHE" /* where to keep base
+					      * files for reuse by other
+					      * checkouts */
+#define CHECKOUT_CACHE_SIZE_ENV "CVS_CHECKOUT_CACHE_SIZE" /* how much each
+						     * user may keep there */
 
 #define	CVSUMASK_ENV	"CVSUMASK"	/* Effective umask for repository */
 
@@ -342,6 +355,10 @@ int RCS_exec_rcsdiff (RCSNode *rcsfile, int diff_argc,
 int diff_exec (const char *file1, const char *file2,
                const char *label1, const char *label2,
                int iargc, char * const *iargv, const char *out);
+int diff_exec_buffers (const char *text1, size_t len1,
+		       const char *text2, size_t len2,
+		       int iargc, char * const *iargv,
+		       char **out, size_t *outlen);
 
 
 #include "error.h"
@@ -372,6 +389,7 @@ char *gmformat_time_t (time_t unixtime);
 char *format_date_alloc (char *text);
 
 char *entries_time (time_t unixtime);
+time_t parse_entries_time (const char *timestamp);
 time_t unix_time_stamp (const char *file);
 
 typedef	RETSIGTYPE (*SIGCLEANUPPROC)	(int);
@@ -32,7 +32,9 @@
 
 /* CVS */
 #include "base.h"
+#include "difflib.h"
 #include "ignore.h"
+#include "parseinfo.h"
 #include "rcs.h"
 #include "recurse.h"
 #include "wrapper.h"
@@ -51,6 +53,22 @@ enum diff_file
     DIFF_SAME
 };
 
+/* The files diff_fileproc compares, which it hands to a diff job (see
+ * diff_job_start) along with the duty of removing the temp files.
+ */
+struct diff_job_files
+{
+    struct file_info *finfo;
+    enum diff_file empty_file;
+    const char *f1;
+    const char *f2;
+    char *use_rev1;
+    char *use_rev2;
+    char *label1;
+    char *label2;
+    char *rev1_cache;
+};
+
 static Dtype diff_dirproc (void *callerdat, const char *dir,
                            const char *pos_repos, const char *update_dir,
                            List *entries);
@@ -141,6 +159,7 @@ static const char *const diff_usage[] =
     "  --horizon-lines=NUM  Keep NUM lines of the common prefix and suffix.\n",
     "  -d  --minimal  Try hard to find a smaller set of changes.\n",
     "  -H  --speed-large-files  Assume large files and many scattered small changes.\n",
+    "  --histogram  Match up lines with the histogram algorithm.\n",
     "\n(Specify the --help global option for a list of other help options)\n",
     NULL
 };
@@ -215,6 +234,7 @@ static struct option const longopts[] =
     {"changed-group-format", 1, 0, 139},
     {"horizon-lines", 1, 0, 140},
     {"binary", 0, 0, 142},
+    {"histogram", 0, 0, 147},
     {0, 0, 0, 0}
 };
 
@@ -358,7 +378,7 @@ diff (int argc, char **argv)
 		break;
 	    case 129: case 130: case 131: case 132: case 133: case 134:
 	    case 135: case 136: case 137: case 138: case 139: case 140:
-	    case 141: case 142: case 143: case 145: case 146:
+	    case 141: case 142: case 143: case 145: case 146: case 147:
 		add_diff_args (0, longopts[option_index].name,
 			      longopts[option_index].has_arg ? optarg : NULL);
 		break;
@@ -468,16 +488,27 @@ diff (int argc, char **argv)
     if (diff_rev2 != NULL)
 	tag_check_valid (diff_rev2, argc, argv, local, 0, "", false);
 
+    /* The repository may ask for the histogram algorithm by default.  */
+    if (config->HistogramDiff)
+	add_diff_args (0, "histogram", NULL);
+
     which = W_LOCAL;
     if (diff_rev1 || diff_date1)
 	which |= W_REPOS | W_ATTIC;
 
     wrap_setup ();
 
+    /* A client diffing against its base revisions does the diffs itself,
+     * so only diffs made here can be run in parallel.
+     */
+    diff_jobs_begin (server_use_bases () ? 1 : config->DiffJobs);
+
     /* start the recursion processor */
     err = start_recursion (diff_fileproc, NULL, diff_dirproc, NULL, NULL, argc,
 			   argv, local, which, 0, CVS_LOCK_READ, NULL, 1, NULL);
 
+    diff_jobs_end ();
+
     /* clean up */
     free (options);
     options = NULL;
@@ -754,6 +785,63 @@ diff_file_nodiff (struct file_info *finfo, Vers_TS *vers,
 
 
 
+/* Diff the files described by DATA, a struct diff_job_files, and return
+ * the status, as for rcsdiff.
+ */
+static int
+diff_job_run (void *data)
+{
+    struct diff_job_files *job = data;
+
+    return base_diff (job->finfo, diff_argc, diff_argv, job->f1,
+		      job->use_rev1, job->label1, job->f2, job->use_rev2,
+		      job->label2, empty_files);
+}
+
+
+
+/* Record the status ERR of diffing the files described by DATA, a struct
+ * diff_job_files, then remove any temp files and free DATA.
+ */
+static void
+diff_job_done (void *data, int err)
+{
+    struct diff_job_files *job = data;
+
+    if (job->empty_file != DIFF_ADDED && !job->rev1_cache && job->f1)
+    {
+	if (unlink_file (job->f1) < 0)
+	    error (0, errno, "Failed to remove temp file `%s'", job->f1);
+	free ((char *)job->f1);
+    }
+    if (job->empty_file != DIFF_REMOVED && job->use_rev2 && job->f2)
+    {
+	if (unlink_file (job->f2) < 0)
+	    error (0, errno, "Failed to remove temp file `%s'", job->f2);
+	free ((char *)job->f2);
+    }
+
+    if (job->use_rev1) free (job->use_rev1);
+    if (job->use_rev2) free (job->use_rev2);
+    if (job->label1) free (job->label1);
+    if (job->label2) free (job->label2);
+
+    /* Call CVS_UNLINK() rather than unlink_file() below to avoid the check
+     * for noexec.
+     */
+    if (job->rev1_cache)
+    {
+	if (CVS_UNLINK (job->rev1_cache) < 0)
+	    error (0, errno, "cannot remove %s", job->rev1_cache);
+	free (job->rev1_cache);
+    }
+
+    free (job);
+    diff_mark_errors (err);
+}
+
+
+
 /*
  * Do a file diff
  */
@@ -765,10 +853,7 @@ diff_fileproc (void *callerdat, struct file_info *finfo)
     Vers_TS *vers;
     enum diff_file empty_file = server_use_bases ()
 				? DIFF_CLIENT : DIFF_DIFFERENT;
-    char *rev1_cache = NULL;
-    char *use_rev1 = NULL, *use_rev2 = NULL;
-    const char *f1 = NULL, *f2 = NULL;
-    char *label1 = NULL, *label2 = NULL;
+    struct diff_job_files *job = xcalloc (1, sizeof *job);
 
     user_file_rev = 0;
     vers = Version_TS (finfo, NULL, NULL, NULL, 1, 0);
@@ -915,10 +1000,10 @@ diff_fileproc (void *callerdat, struct file_info *finfo)
 	}
     }
 
-    empty_file = diff_file_nodiff (finfo, vers, empty_file, &rev1_cache,
+    empty_file = diff_file_nodiff (finfo, vers, empty_file, &job->rev1_cache,
 				   diff_rev1 && !isdigit (diff_rev1[0])
 				   ? diff_rev1 : vers->tag,
-				   &use_rev1, &use_rev2);
+				   &job->use_rev1, &job->use_rev2);
     if (empty_file == DIFF_SAME)
     {
 	/* In the server case, would be nice to send a "Checked-in"
@@ -935,43 +1020,43 @@ diff_fileproc (void *callerdat, struct file_info *finfo)
 	goto out;
 
     if (empty_file == DIFF_ADDED)
-	f1 = DEVNULL;
-    else if (rev1_cache)
+	job->f1 = DEVNULL;
+    else if (job->rev1_cache)
     {
 	/* If this is cached, temp_checkout was not called for the client.
 	 */
 	assert (empty_file != DIFF_CLIENT);
-	f1 = rev1_cache;
+	job->f1 = job->rev1_cache;
     }
     else
     {
-	f1 = temp_checkout (vers->srcfile, finfo,
+	job->f1 = temp_checkout (vers->srcfile, finfo,
 			    vers->vn_user && *(vers->vn_user) == '-'
 			    ? vers->vn_user + 1 : vers->vn_user,
-			    use_rev1, vers->tag,
+			    job->use_rev1, vers->tag,
 			    diff_rev1 && !isdigit (diff_rev1[0])
 			    ? diff_rev1 : vers->tag,
 			    vers->options, *options ? options : vers->options);
-	if (!f1)
+	if (!job->f1)
 	    goto out;
     }
 
     if (empty_file == DIFF_REMOVED)
-	f2 = DEVNULL;
-    else if (use_rev2)
+	job->f2 = DEVNULL;
+    else if (job->use_rev2)
     {
-	f2 = temp_checkout (vers->srcfile, finfo,
+	job->f2 = temp_checkout (vers->srcfile, finfo,
 			    vers->vn_user && *(vers->vn_user) == '-'
 			    ? vers->vn_user + 1 : vers->vn_user,
-			    use_rev2, vers->tag,
+			    job->use_rev2, vers->tag,
 			    diff_rev2 && !isdigit (diff_rev2[0])
 			    ? diff_rev2 : NULL,
 			    vers->options, *options ? options : vers->options);
-	if (!f2)
+	if (!job->f2)
 	    goto out;
     }
     else
-	f2 = finfo->file;
+	job->f2 = finfo->file;
 
     /* Set up file labels appropriate for compatibility with the Larry Wall
      * implementation of patch if the user didn't specify.  This is irrelevant
@@ -983,9 +1068,9 @@ diff_fileproc (void *callerdat, struct file_info *finfo)
     if (!have_rev2_label)
     {
 	if (empty_file == DIFF_REMOVED)
-	    label2 = make_file_label (DEVNULL, NULL, NULL, NULL);
+	    job->label2 = make_file_label (DEVNULL, NULL, NULL, NULL);
 	else
-	    label2 = make_file_label (finfo->fullname, use_rev2,
+	    job->label2 = make_file_label (finfo->fullname, job->use_rev2,
 				      /* FIXME: make_file_label should be able
 				       * to trust vers->ts_user, but
 				       * Version_TS isn't setting it correctly
@@ -997,48 +1082,23 @@ diff_fileproc (void *callerdat, struct file_info *finfo)
 	if (!have_rev1_label)
 	{
 	    if (empty_file == DIFF_ADDED)
-		label1 = make_file_label (DEVNULL, NULL, NULL, NULL);
+		job->label1 = make_file_label (DEVNULL, NULL, NULL, NULL);
 	    else
-		label1 = make_file_label (finfo->fullname, use_rev1,
-		                          NULL, finfo->rcs);
+		job->label1 = make_file_label (finfo->fullname, job->use_rev1,
+		                               NULL, finfo->rcs);
 	}
     }
 
-    err = base_diff (finfo, diff_argc, diff_argv, f1, use_rev1, label1,
-		     f2, use_rev2, label2, empty_files);
+    job->finfo = finfo;
+    job->empty_file = empty_file;
+    diff_job_start (diff_job_run, diff_job_done, job);
+    freevers_ts (&vers);
+    return 0;
 
 out:
-    if (empty_file != DIFF_ADDED && !rev1_cache && f1)
-    {
-	if (unlink_file (f1) < 0)
-	    error (0, errno, "Failed to remove temp file `%s'", f1);
-	free ((char *)f1);
-    }
-    if (empty_file != DIFF_REMOVED && use_rev2 && f2)
-    {
-	if (unlink_file (f2) < 0)
-	    error (0, errno, "Failed to remove temp file `%s'", f2);
-	free ((char *)f2);
-    }
-
-    if (use_rev1) free (use_rev1);
-    if (use_rev2) free (use_rev2);
-    if (label1) free (label1);
-    if (label2) free (label2);
-
-    /* Call CVS_UNLINK() rather than unlink_file() below to avoid the check
-     * for noexec.
-     */
-    if (rev1_cache)
-    {
-	if (CVS_UNLINK (rev1_cache) < 0)
-	    error (0, errno, "cannot remove %s", rev1_cache);
-	free (rev1_cache);
-    }
-
+    job->empty_file = empty_file;
+    diff_job_done (job, err);
     freevers_ts (&vers);
-    diff_mark_errors (err);
-
     return 0;
 }
 
@@ -28,6 +28,9 @@
 
 /* GNULIB */
 #include "error.h"
+#include "wait.h"
+#include "xalloc.h"
+#include "xselect.h"
 
 /* diffutils */
 #include "diffrun.h"
@@ -36,6 +39,7 @@
 #include "filesubr.h"
 #include "run.h"
 #include "server.h"
+#include "subr.h"
 #include "system.h"
 
 extern int noexec;		/* Don't modify disk anywhere */
@@ -69,6 +73,17 @@ call_diff_add_arg (const char *s)
 
 
 
+/* Terminate call_diff_argv before handing it to the diff library.  This
+   doesn't go through call_diff_add_arg, which would trace a NULL string.  */
+static void
+call_diff_end_args (void)
+{
+    run_add_arg_p (&call_diff_argc, &call_diff_arg_allocated, &call_diff_argv,
+		   NULL);
+}
+
+
+
 void 
 call_diff_setup (const char *prog, int argc, char * const *argv)
 {
@@ -152,10 +167,50 @@ static struct diff_callbacks call_diff_file_callbacks =
 
 
 
+/* The output collected by call_diff_buffers.  */
+static char *call_diff_buf;
+static size_t call_diff_bufsize;
+static size_t call_diff_buflen;
+
+
+
+/* Call back function for the diff library to append to the output of
+   call_diff_buffers.  */
+static void
+call_diff_buffer_write_output (const char *text, size_t len)
+{
+    expand_string (&call_diff_buf, &call_diff_bufsize, call_diff_buflen + len);
+    memcpy (call_diff_buf + call_diff_buflen, text, len);
+    call_diff_buflen += len;
+}
+
+
+
+/* Call back function for the diff library to flush the output of
+   call_diff_buffers, which has nothing to do.  */
+static void
+call_diff_buffer_flush_output (void)
+{
+}
+
+
+
+/* This set of callback functions is used if we are collecting the diff
+   in memory.  */
+static struct diff_callbacks call_diff_buffer_callbacks =
+{
+    call_diff_buffer_write_output,
+    call_diff_buffer_flush_output,
+    call_diff_write_stdout,
+    call_diff_error
+};
+
+
+
 int
 call_diff (const char *out)
 {
-    call_diff_add_arg (NULL);
+    call_diff_end_args ();
 
     if (out == RUN_TTY)
 	return diff_run( call_diff_argc, call_diff_argv, NULL,
@@ -167,6 +222,45 @@ call_diff (const char *out)
 
 
 
+/* Like call_diff, but compare the LEN1 bytes at TEXT1 with the LEN2 bytes
+ * at TEXT2 rather than two files, and collect the output in memory.  No
+ * file name arguments should have been added.
+ *
+ * OUTPUTS
+ *   out	A newly malloc'd, '\0' terminated buffer holding the diff, or
+ *		NULL if there was no output.
+ *   outlen	The length of the diff.
+ *
+ * RETURNS
+ *   As call_diff.
+ */
+int
+call_diff_buffers (const char *text1, size_t len1, const char *text2,
+		   size_t len2, char **out, size_t *outlen)
+{
+    int retval;
+
+    call_diff_end_args ();
+
+    call_diff_buf = NULL;
+    call_diff_bufsize = call_diff_buflen = 0;
+    retval = diff_run_buffers (call_diff_argc, call_diff_argv, text1, len1,
+			       text2, len2, &call_diff_buffer_callbacks);
+    if (call_diff_buf != NULL)
+    {
+	/* Terminate it, as get_file would.  */
+	expand_string (&call_diff_buf, &call_diff_bufsize,
+		       call_diff_buflen + 1);
+	call_diff_buf[call_diff_buflen] = '\0';
+    }
+    *out = call_diff_buf;
+    *outlen = call_diff_buflen;
+    call_diff_buf = NULL;
+    return retval;
+}
+
+
+
 int
 call_diff3 (char *out)
 {
@@ -180,6 +274,42 @@ call_diff3 (char *out)
 
 
 
+/* Like call_diff3, but merge the three TEXTS, of LENS bytes, rather than
+ * three files, and collect the output in memory.  No file name arguments
+ * should have been added.
+ *
+ * OUTPUTS
+ *   out	A newly malloc'd, '\0' terminated buffer holding the output, or
+ *		NULL if there was no output.
+ *   outlen	The length of the output.
+ *
+ * RETURNS
+ *   As call_diff3.
+ */
+int
+call_diff3_buffers (const char *const texts[3], const size_t lens[3],
+		    char **out, size_t *outlen)
+{
+    int retval;
+
+    call_diff_buf = NULL;
+    call_diff_bufsize = call_diff_buflen = 0;
+    retval = diff3_run_buffers (call_diff_argc, call_diff_argv, texts, lens,
+				&call_diff_buffer_callbacks);
+    if (call_diff_buf != NULL)
+    {
+	expand_string (&call_diff_buf, &call_diff_bufsize,
+		       call_diff_buflen + 1);
+	call_diff_buf[call_diff_buflen] = '\0';
+    }
+    *out = call_diff_buf;
+    *outlen = call_diff_buflen;
+    call_diff_buf = NULL;
+    return retval;
+}
+
+
+
 /* Merge the changes between files J1 & J2 into file DEST.  Mark portions from
  * particular files using strings REV1 & REV2.
  */
@@ -187,13 +317,46 @@ int
 merge (const char *dest, const char *dlabel, const char *j1,
        const char *j1label, const char *j2, const char *j2label)
 {
-    char *diffout;
+    char *text1 = NULL, *text2 = NULL;
+    size_t size1 = 0, size2 = 0, len1, len2;
+    int retval;
+
+    get_file (j1, j1, "r", &text1, &size1, &len1);
+    get_file (j2, j2, "r", &text2, &size2, &len2);
+    retval = merge_buffers (dest, dlabel, text1, len1, j1label,
+			    text2, len2, j2label);
+    free (text1);
+    free (text2);
+    return retval;
+}
+
+
+
+/* Like merge, but with the texts of the two revisions being merged into
+ * DEST already in memory, at TEXT1 and TEXT2.  The merge is done in memory
+ * too, so no temp files are involved.
+ */
+int
+merge_buffers (const char *dest, const char *dlabel, const char *text1,
+	       size_t len1, const char *j1label, const char *text2,
+	       size_t len2, const char *j2label)
+{
+    const char *texts[3];
+    size_t lens[3];
+    char *desttext = NULL, *out;
+    size_t destsize = 0, outlen;
     int retval;
 
+    get_file (dest, dest, "r", &desttext, &destsize, &lens[0]);
+    texts[0] = desttext;
+    texts[1] = text1;
+    lens[1] = len1;
+    texts[2] = text2;
+    lens[2] = len2;
+
     /* Remember that the first word in the `call_diff_setup' string is used
        now only for diagnostic messages -- CVS no longer forks to run
        diff3. */
-    diffout = cvs_temp_name();
     call_diff_setup ("diff3", 0, NULL);
     call_diff_add_arg ("-E");
     call_diff_add_arg ("-am");
@@ -205,24 +368,473 @@ merge (const char *dest, const char *dlabel, const char *j1,
     call_diff_add_arg ("-L");
     call_diff_add_arg (j2label);
 
-    call_diff_add_arg ("--");
-    call_diff_add_arg (dest);
-    call_diff_add_arg (j1);
-    call_diff_add_arg (j2);
-
-    retval = call_diff3 (diffout);
+    retval = call_diff3_buffers (texts, lens, &out, &outlen);
 
     if (retval == 1 && !really_quiet)
 	error (0, 0, "conflicts during merge");
     else if (retval == 2)
 	error (1, 0, "diff3 failed.");
 
-    copy_file (diffout, dest);
+    write_file (dest, out ? out : "", outlen);
 
-    /* Clean up. */
-    if (CVS_UNLINK (diffout) < 0 && !existence_error (errno))
-	error (0, errno, "cannot remove temp file `%s'", diffout);
-    free (diffout);
+    free (desttext);
+    if (out != NULL)
+	free (out);
 
     return retval;
 }
+
+
+
+/* Diffs for several files may be run at once, each in a worker process
+ * started by diff_job_start.  A worker does not output anything itself.
+ * Instead, everything it would have sent to cvs_output and cvs_outerr is
+ * written to a pipe as records of the following form, and the parent
+ * replays the records in the order the jobs were started, so that the
+ * output is the same as if the diffs had been run one after the other.
+ * Anything the parent outputs while jobs are still running is held back
+ * in the same way, until the job started before it is done.
+ */
+struct diff_job_record
+{
+    /* 'M' for text for stdout, 'E' for text for stderr, or 'X' for the
+     * status the job returned.
+     */
+    char type;
+    /* The length of the text following the record, or the status.  */
+    size_t len;
+};
+
+struct diff_job
+{
+    struct diff_job *next;
+    pid_t pid;
+    /* The read end of the pipe from the worker, or -1 once it is closed.  */
+    int fd;
+    /* The records read from the worker.  */
+    char *out;
+    size_t outsize;
+    size_t outlen;
+    /* The records output by the parent after this job was started.  */
+    char *after;
+    size_t aftersize;
+    size_t afterlen;
+    void (*done) (void *, int);
+    void *data;
+};
+
+/* The running jobs, oldest first.  */
+static struct diff_job *diff_jobs_head;
+static struct diff_job *diff_jobs_tail;
+
+/* The most jobs to run at once.  Values less than 2 mean that jobs are run
+ * by diff_job_start itself.
+ */
+static size_t diff_jobs_limit;
+
+/* Set when a worker has exited without returning a status.  */
+static bool diff_jobs_aborted;
+
+/* Set while replaying the output of a job, which must not be held back
+ * again.
+ */
+static bool diff_jobs_replaying;
+
+/* In a worker, the write end of its pipe, and output not yet written to
+ * it.  DIFF_JOB_FD is -1 in any other process.
+ */
+static int diff_job_fd = -1;
+static char *diff_job_buf;
+static size_t diff_job_bufsize;
+static size_t diff_job_buflen;
+
+
+
+/* Append a record of type TYPE for the LEN bytes of TEXT to the buffer
+ * *BUF, which holds *BUFLEN bytes and has room for *BUFSIZE.
+ */
+static void
+diff_job_append (char **buf, size_t *bufsize, size_t *buflen, int type,
+		 const char *text, size_t len)
+{
+    struct diff_job_record rec;
+
+    rec.type = type;
+    rec.len = len;
+    expand_string (buf, bufsize, *buflen + sizeof rec + (text ? len : 0));
+    memcpy (*buf + *buflen, &rec, sizeof rec);
+    *buflen += sizeof rec;
+    if (text)
+    {
+	memcpy (*buf + *buflen, text, len);
+	*buflen += len;
+    }
+}
+
+
+
+/* Write the output a worker has collected to its pipe.  */
+static void
+diff_job_flush (void)
+{
+    const char *p = diff_job_buf;
+
+    while (diff_job_buflen > 0)
+    {
+	ssize_t n = write (diff_job_fd, p, diff_job_buflen);
+	if (n < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    /* Nobody is listening any more.  */
+	    _exit (EXIT_FAILURE);
+	}
+	p += n;
+	diff_job_buflen -= n;
+    }
+}
+
+
+
+/* Hold back output of type TYPE ('M' or 'E', as for struct
+ * diff_job_record), which is the LEN bytes at TEXT, if it must not be
+ * output yet.  That is the case in a worker, and in the parent while
+ * jobs are running.
+ *
+ * RETURNS
+ *   true if the output was held back and the caller should not output it.
+ */
+bool
+diff_job_capture (int type, const char *text, size_t len)
+{
+    if (diff_job_fd >= 0)
+    {
+	diff_job_append (&diff_job_buf, &diff_job_bufsize, &diff_job_buflen,
+			 type, text, len);
+	if (diff_job_buflen >= 64 * 1024)
+	    diff_job_flush ();
+	return true;
+    }
+
+    if (diff_jobs_tail && !diff_jobs_replaying)
+    {
+	diff_job_append (&diff_jobs_tail->after, &diff_jobs_tail->aftersize,
+			 &diff_jobs_tail->afterlen, type, text, len);
+	return true;
+    }
+
+    return false;
+}
+
+
+
+/* Return true if this process is a worker started by diff_job_start.  */
+bool
+diff_job_worker (void)
+{
+    return diff_job_fd >= 0;
+}
+
+
+
+/* Output the complete records among the LEN bytes at BUF.  Store the
+ * status from an 'X' record in *STATUS and set *FOUND, if STATUS is not
+ * NULL.
+ *
+ * RETURNS
+ *   The number of bytes used, which is less than LEN only when BUF ends
+ *   in the middle of a record.
+ */
+static size_t
+diff_job_replay (const char *buf, size_t len, int *status, bool *found)
+{
+    const char *p = buf;
+
+    while (buf + len - p >= sizeof (struct diff_job_record))
+    {
+	struct diff_job_record rec;
+
+	memcpy (&rec, p, sizeof rec);
+	if (rec.type == 'X')
+	{
+	    if (status)
+	    {
+		*status = rec.len;
+		*found = true;
+	    }
+	    p += sizeof rec;
+	    continue;
+	}
+
+	if (buf + len - p - sizeof rec < rec.len)
+	    break;
+	p += sizeof rec;
+	if (rec.len == 0)
+	    ;
+	else if (rec.type == 'M')
+	    cvs_output (p, rec.len);
+	else
+	    cvs_outerr (p, rec.len);
+	p += rec.len;
+    }
+    return p - buf;
+}
+
+
+
+/* Wait until at least one worker has more output or has exited, and
+ * read what is there.  Reading from every worker, rather than just the
+ * oldest, keeps the others from blocking on a full pipe.
+ */
+static void
+diff_jobs_read (void)
+{
+    struct diff_job *job;
+    fd_set readfds;
+    int maxfd = -1;
+
+    FD_ZERO (&readfds);
+    for (job = diff_jobs_head; job; job = job->next)
+	if (job->fd >= 0)
+	{
+	    FD_SET (job->fd, &readfds);
+	    if (job->fd > maxfd)
+		maxfd = job->fd;
+	}
+
+    if (select (maxfd + 1, &readfds, NULL, NULL, NULL) < 0)
+    {
+	if (errno == EINTR)
+	    return;
+	error (1, errno, "cannot select on diff worker pipes");
+    }
+
+    for (job = diff_jobs_head; job; job = job->next)
+	if (job->fd >= 0 && FD_ISSET (job->fd, &readfds))
+	{
+	    ssize_t n;
+
+	    expand_string (&job->out, &job->outsize, job->outlen + 8192);
+	    n = read (job->fd, job->out + job->outlen,
+		      job->outsize - job->outlen);
+	    if (n < 0)
+	    {
+		if (errno == EINTR)
+		    continue;
+		error (0, errno, "cannot read from diff worker");
+		n = 0;
+	    }
+	    if (n == 0)
+	    {
+		close (job->fd);
+		job->fd = -1;
+	    }
+	    else
+		job->outlen += n;
+	}
+}
+
+
+
+/* Wait for the oldest job to finish, output what it and the parent have
+ * held back, and call its DONE function.  The oldest job's output is
+ * passed on as it arrives, since nothing else is waiting to go first.
+ */
+static void
+diff_job_finish_first (void)
+{
+    struct diff_job *job = diff_jobs_head;
+    int status, wstatus;
+    bool found = false;
+
+    diff_jobs_replaying = true;
+    for (;;)
+    {
+	size_t used = diff_job_replay (job->out, job->outlen, &status,
+				       &found);
+	job->outlen -= used;
+	memmove (job->out, job->out + used, job->outlen);
+	if (job->fd < 0)
+	    break;
+	diff_jobs_read ();
+    }
+    while (waitpid (job->pid, &wstatus, 0) < 0)
+	if (errno != EINTR)
+	{
+	    error (0, errno, "cannot wait for diff worker");
+	    wstatus = 0;
+	    break;
+	}
+
+    diff_jobs_head = job->next;
+    if (!diff_jobs_head)
+	diff_jobs_tail = NULL;
+
+    if (!found)
+    {
+	/* The worker has already explained itself if it exited after an
+	 * error, but not if something killed it.
+	 */
+	if (WIFSIGNALED (wstatus))
+	    error (0, 0, "diff worker terminated by signal %d",
+		   WTERMSIG (wstatus));
+	diff_jobs_aborted = true;
+	status = 2;
+    }
+    job->done (job->data, status);
+    diff_job_replay (job->after, job->afterlen, NULL, NULL);
+    diff_jobs_replaying = false;
+
+    if (job->out)
+	free (job->out);
+    if (job->after)
+	free (job->after);
+    free (job);
+}
+
+
+
+/* Finish every job, and exit if any of them did not finish normally.  */
+static void
+diff_jobs_drain (void)
+{
+    while (diff_jobs_head)
+	diff_job_finish_first ();
+    if (diff_jobs_aborted)
+	exit (EXIT_FAILURE);
+}
+
+
+
+/* Allow up to LIMIT diff jobs to run at once from now on.  */
+void
+diff_jobs_begin (size_t limit)
+{
+    diff_jobs_limit = limit;
+}
+
+
+
+/* Wait for all diff jobs to finish and output everything held back, then
+ * go back to running jobs one at a time.
+ */
+void
+diff_jobs_end (void)
+{
+    diff_jobs_drain ();
+    diff_jobs_limit = 0;
+}
+
+
+
+/* Called before exiting after a fatal error.  A worker writes out what it
+ * has collected and exits without running the exit handlers, which belong
+ * to the parent.  The parent outputs what the running jobs have to say
+ * first, so that the error message is not lost among their held back
+ * output.
+ */
+void
+diff_job_abort (void)
+{
+    if (diff_job_fd >= 0)
+    {
+	diff_job_flush ();
+	_exit (EXIT_FAILURE);
+    }
+
+    /* Leave the jobs alone if this error came from one of them.  */
+    if (!diff_jobs_replaying)
+	while (diff_jobs_head)
+	    diff_job_finish_first ();
+}
+
+
+
+/* Run RUN (DATA) and then call DONE (DATA, STATUS) with the status RUN
+ * returned.
+ *
+ * When diff_jobs_begin has allowed it, RUN is called in a new worker
+ * process and DONE is called later, in the parent, once the worker is
+ * done.  RUN sees DATA as it was when this function was called and may
+ * only change anything else through its output and status.  RUN may not
+ * read from or write to the network, and its status must fit in an int.
+ */
+void
+diff_job_start (int (*run) (void *), void (*done) (void *, int), void *data)
+{
+    struct diff_job *job, *j;
+    int fds[2];
+
+    if (diff_jobs_limit < 2)
+    {
+	done (data, run (data));
+	return;
+    }
+
+    /* Make room for this job.  */
+    {
+	size_t running = 0;
+
+	for (j = diff_jobs_head; j; j = j->next)
+	    running++;
+	if (running >= diff_jobs_limit)
+	    diff_job_finish_first ();
+	if (diff_jobs_aborted)
+	    diff_jobs_drain ();
+    }
+
+    if (pipe (fds) < 0)
+	error (1, errno, "cannot create pipe for diff worker");
+
+    job = xmalloc (sizeof *job);
+    memset (job, 0, sizeof *job);
+    job->done = done;
+    job->data = data;
+
+    job->pid = fork ();
+    if (job->pid < 0)
+	error (1, errno, "cannot fork diff worker");
+
+    if (job->pid == 0)
+    {
+	close (fds[0]);
+	for (j = diff_jobs_head; j; j = j->next)
+	    if (j->fd >= 0)
+		close (j->fd);
+	diff_jobs_head = diff_jobs_tail = NULL;
+	diff_job_fd = fds[1];
+
+	/* The signal handlers would clean up after the parent.  */
+#ifdef SIGABRT
+	signal (SIGABRT, SIG_DFL);
+#endif
+#ifdef SIGHUP
+	signal (SIGHUP, SIG_DFL);
+#endif
+#ifdef SIGINT
+	signal (SIGINT, SIG_DFL);
+#endif
+#ifdef SIGQUIT
+	signal (SIGQUIT, SIG_DFL);
+#endif
+#ifdef SIGPIPE
+	signal (SIGPIPE, SIG_DFL);
+#endif
+#ifdef SIGTERM
+	signal (SIGTERM, SIG_DFL);
+#endif
+
+	diff_job_append (&diff_job_buf, &diff_job_bufsize, &diff_job_buflen,
+			 'X', NULL, run (data));
+	diff_job_flush ();
+	_exit (0);
+    }
+
+    close (fds[1]);
+    job->fd = fds[0];
+    if (diff_jobs_tail)
+	diff_jobs_tail->next = job;
+    else
+	diff_jobs_head = job;
+    diff_jobs_tail = job;
+}
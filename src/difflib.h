@@ -18,11 +18,29 @@
 #ifndef DIFFLIB_H
 #define DIFFLIB_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 int call_diff (const char *out);
+int call_diff_buffers (const char *text1, size_t len1, const char *text2,
+		       size_t len2, char **out, size_t *outlen);
 int call_diff3 (char *out);
+int call_diff3_buffers (const char *const texts[3], const size_t lens[3],
+			char **out, size_t *outlen);
 void call_diff_add_arg (const char *s);
 void call_diff_setup (const char *prog, int argc, char * const *argv);
 int merge (const char *dest, const char *dlabel, const char *j1,
 	   const char *j1label, const char *j2, const char *j2label);
+int merge_buffers (const char *dest, const char *dlabel, const char *text1,
+		   size_t len1, const char *j1label, const char *text2,
+		   size_t len2, const char *j2label);
+
+void diff_jobs_begin (size_t limit);
+void diff_jobs_end (void);
+void diff_job_start (int (*run) (void *), void (*done) (void *, int),
+		     void *data);
+bool diff_job_capture (int type, const char *text, size_t len);
+bool diff_job_worker (void);
+void diff_job_abort (void);
 
 #endif /* DIFFLIB_H */
@@ -24,6 +24,9 @@
 /* Validate API */
 #include "entries.h"
 
+/* Standards */
+#include <stdint.h>
+
 /* GNULIB */
 #include "quote.h"
 
@@ -81,6 +84,7 @@ Entnode_Create (enum ent_type type, const char *user, const char *vn,
     ent->user      = xstrdup (user);
     ent->version   = xstrdup (vn);
     ent->timestamp = xstrdup (ts ? ts : "");
+    ent->mtime     = parse_entries_time (ent->timestamp);
     ent->options   = xstrdup (options ? options : "");
     ent->tag       = xstrdup (tag);
     ent->date      = xstrdup (date);
@@ -177,6 +181,375 @@ write_ent_proc (Node *node, void *closure)
 
 
 
+/* Directories with at least this many entries get a binary index of
+ * CVS/Entries, which they can be loaded from without parsing it.
+ */
+#define ENTIDX_MIN		100
+
+/* The Entries index format, as written by write_entries_index:
+ *
+ *   struct entidx_header
+ *   records			In Entries order, each a struct entidx_record
+ *				followed by the name, version, timestamp and
+ *				options, then whichever of the tag, date and
+ *				conflict its flags say are present, each
+ *				NUL-terminated, padded to a multiple of four
+ *				bytes.
+ *
+ * Like the modules index, it is written in native byte order, and it is
+ * ignored unless it was built from the CVS/Entries which is there now.
+ * CVS/Entries remains the authority; older versions of CVS which don't know
+ * about the index simply leave it stale.
+ */
+#define ENTIDX_MAGIC		"CVSENT1\n"
+#define ENTIDX_BYTEORDER	0x01020304
+
+struct entidx_header
+{
+    char magic[8];
+    uint32_t byteorder;
+    uint32_t count;
+    /* Nonzero if Entries lists the subdirectories.  */
+    uint32_t sawdir;
+    uint32_t reserved;
+    /* Stamp of the CVS/Entries this index was built from.  */
+    uint64_t ent_ino;
+    uint64_t ent_size;
+    int64_t ent_mtime;
+    int64_t ent_ctime;
+};
+
+struct entidx_record
+{
+    /* Including this header and the padding.  */
+    uint32_t size;
+    uint32_t flags;
+};
+
+#define ENTIDX_SUBDIR		0x1
+#define ENTIDX_TAG		0x2
+#define ENTIDX_DATE		0x4
+#define ENTIDX_CONFLICT		0x8
+
+#define ENTIDX_ALIGN(n)		(((n) + 3) & ~(size_t) 3)
+
+
+
+/* Return true if the index header HDR was built from the Entries file
+ * described by SB.
+ */
+static bool
+entidx_current (const struct entidx_header *hdr, const struct stat *sb)
+{
+    return !memcmp (hdr->magic, ENTIDX_MAGIC, sizeof hdr->magic)
+	   && hdr->byteorder == ENTIDX_BYTEORDER
+	   && hdr->ent_ino == (uint64_t) sb->st_ino
+	   && hdr->ent_size == (uint64_t) sb->st_size
+	   && hdr->ent_mtime == (int64_t) sb->st_mtime
+	   && hdr->ent_ctime == (int64_t) sb->st_ctime;
+}
+
+
+
+/* Return the next string of a record, which ends at END, and advance *CP
+ * past it, or return NULL if the record is damaged.
+ */
+static char *
+entidx_string (char **cp, char *end)
+{
+    char *s = *cp;
+    char *nul = memchr (s, '\0', end - s);
+
+    if (nul == NULL)
+	return NULL;
+    *cp = nul + 1;
+    return s;
+}
+
+
+
+/* Load ENTRIES from the index of the Entries file in DIR, if it is current.
+ *
+ * The index is read into a single buffer which ENTRIES adopts, along with an
+ * array of Entnodes pointing into it, so that loading costs no more than
+ * hashing the names.
+ *
+ * RETURNS
+ *   true if ENTRIES was loaded, in which case *SAWDIR is set as reading the
+ *   text file would have set it.
+ *   false if there was no usable index, in which case ENTRIES is untouched.
+ */
+static bool
+read_entries_index (List *entries, const char *dir, int *sawdir)
+{
+    struct entidx_header hdr;
+    struct stat ent_sb, sb;
+    char *file, *buf = NULL, *cp, *end;
+    Entnode *ents = NULL;
+    size_t got;
+    ssize_t n;
+    uint32_t i;
+    int fd;
+    bool ok = false;
+
+    file = dir_append (dir, CVSADM_ENT);
+    if (stat (file, &ent_sb) < 0)
+    {
+	free (file);
+	return false;
+    }
+    free (file);
+
+    file = dir_append (dir, CVSADM_ENTIDX);
+    fd = CVS_OPEN (file, O_RDONLY | OPEN_BINARY);
+    if (fd < 0)
+    {
+	free (file);
+	return false;
+    }
+
+    if (fstat (fd, &sb) < 0 || sb.st_size < (off_t) sizeof hdr)
+	goto done;
+    buf = xmalloc (sb.st_size);
+    for (got = 0; got < (size_t) sb.st_size; got += n)
+    {
+	n = read (fd, buf + got, sb.st_size - got);
+	if (n <= 0)
+	    goto done;
+    }
+
+    memcpy (&hdr, buf, sizeof hdr);
+    if (!entidx_current (&hdr, &ent_sb)
+	|| hdr.count > (sb.st_size - sizeof hdr) / sizeof (struct entidx_record))
+    {
+	TRACE (TRACE_DATA, "read_entries_index: ignoring stale or invalid `%s'",
+	       file);
+	goto done;
+    }
+
+    /* Check every record before adding any of them.  */
+    ents = xnmalloc (hdr.count, sizeof *ents);
+    cp = buf + sizeof hdr;
+    for (i = 0; i < hdr.count; i++)
+    {
+	struct entidx_record rec;
+	Entnode *ent = &ents[i];
+
+	if ((size_t) (buf + sb.st_size - cp) < sizeof rec)
+	    goto done;
+	memcpy (&rec, cp, sizeof rec);
+	if (rec.size < sizeof rec || rec.size % 4 != 0
+	    || rec.size > (size_t) (buf + sb.st_size - cp))
+	    goto done;
+	end = cp + rec.size;
+	cp += sizeof rec;
+
+	ent->type = rec.flags & ENTIDX_SUBDIR ? ENT_SUBDIR : ENT_FILE;
+	if ((ent->user = entidx_string (&cp, end)) == NULL
+	    || (ent->version = entidx_string (&cp, end)) == NULL
+	    || (ent->timestamp = entidx_string (&cp, end)) == NULL
+	    || (ent->options = entidx_string (&cp, end)) == NULL)
+	    goto done;
+	ent->tag = ent->date = ent->conflict = NULL;
+	if ((rec.flags & ENTIDX_TAG
+	     && (ent->tag = entidx_string (&cp, end)) == NULL)
+	    || (rec.flags & ENTIDX_DATE
+		&& (ent->date = entidx_string (&cp, end)) == NULL)
+	    || (rec.flags & ENTIDX_CONFLICT
+		&& (ent->conflict = entidx_string (&cp, end)) == NULL))
+	    goto done;
+	ent->mtime = parse_entries_time (ent->timestamp);
+	cp = end;
+    }
+    if (cp != buf + sb.st_size)
+	goto done;
+
+    TRACE (TRACE_DATA, "read_entries_index: using `%s'", file);
+    for (i = 0; i < hdr.count; i++)
+    {
+	Node *p = getnode ();
+
+	p->type = ENTRIES;
+	p->key = ents[i].user;
+	p->data = &ents[i];
+	p->flags = NODE_KEY_POOLED | NODE_DATA_POOLED;
+	if (addnode (entries, p))
+	    freenode (p);
+    }
+    list_adopt (entries, buf);
+    list_adopt (entries, ents);
+    *sawdir = hdr.sawdir != 0;
+    buf = NULL;
+    ents = NULL;
+    ok = true;
+
+done:
+    if (close (fd) < 0)
+	error (0, errno, "cannot close %s", file);
+    if (buf != NULL)
+	free (buf);
+    if (ents != NULL)
+	free (ents);
+    free (file);
+    return ok;
+}
+
+
+
+/* Write the index of LIST, whose Entries file in DIR has just been written,
+ * or remove the index if LIST is too small to need one.  Failures are not
+ * reported, since the index is only a cache.
+ */
+static void
+write_entries_index (List *list, const char *dir, int sawdir)
+{
+    struct entidx_header hdr;
+    struct stat sb;
+    Node *head, *p;
+    char *file, *buf, *cp;
+    size_t count, size;
+    FILE *fp;
+
+    /* The server's Entries files live in its temporary directory, which
+       is removed when the command finishes, so an index would never be
+       read again.  */
+    if (server_active)
+	return;
+
+    file = dir_append (dir, CVSADM_ENTIDX);
+
+    head = list->list;
+    count = 0;
+    size = sizeof hdr;
+    for (p = head->next; p != head; p = p->next)
+    {
+	Entnode *ent = p->data;
+
+	count++;
+	size += ENTIDX_ALIGN (sizeof (struct entidx_record)
+			      + strlen (ent->user) + strlen (ent->version)
+			      + strlen (ent->timestamp) + strlen (ent->options)
+			      + (ent->tag ? strlen (ent->tag) + 1 : 0)
+			      + (ent->date ? strlen (ent->date) + 1 : 0)
+			      + (ent->conflict ? strlen (ent->conflict) + 1 : 0)
+			      + 4);
+    }
+
+    if (count < ENTIDX_MIN || size > UINT32_MAX)
+    {
+	if (CVS_UNLINK (file) < 0 && !existence_error (errno))
+	    TRACE (TRACE_DATA, "write_entries_index: cannot remove `%s'", file);
+	free (file);
+	return;
+    }
+
+    /* Stamp the index with the Entries file we just renamed into place.  */
+    cp = dir_append (dir, CVSADM_ENT);
+    if (stat (cp, &sb) < 0)
+    {
+	free (cp);
+	free (file);
+	return;
+    }
+    free (cp);
+
+    memset (&hdr, 0, sizeof hdr);
+    memcpy (hdr.magic, ENTIDX_MAGIC, sizeof hdr.magic);
+    hdr.byteorder = ENTIDX_BYTEORDER;
+    hdr.count = count;
+    hdr.sawdir = sawdir;
+    hdr.ent_ino = sb.st_ino;
+    hdr.ent_size = sb.st_size;
+    hdr.ent_mtime = sb.st_mtime;
+    hdr.ent_ctime = sb.st_ctime;
+
+    buf = xzalloc (size);
+    memcpy (buf, &hdr, sizeof hdr);
+    cp = buf + sizeof hdr;
+    for (p = head->next; p != head; p = p->next)
+    {
+	Entnode *ent = p->data;
+	struct entidx_record rec;
+	char *start = cp;
+
+	rec.flags = (ent->type == ENT_SUBDIR ? ENTIDX_SUBDIR : 0)
+		    | (ent->tag ? ENTIDX_TAG : 0)
+		    | (ent->date ? ENTIDX_DATE : 0)
+		    | (ent->conflict ? ENTIDX_CONFLICT : 0);
+	cp += sizeof rec;
+	cp = stpcpy (cp, ent->user) + 1;
+	cp = stpcpy (cp, ent->version) + 1;
+	cp = stpcpy (cp, ent->timestamp) + 1;
+	cp = stpcpy (cp, ent->options) + 1;
+	if (ent->tag)
+	    cp = stpcpy (cp, ent->tag) + 1;
+	if (ent->date)
+	    cp = stpcpy (cp, ent->date) + 1;
+	if (ent->conflict)
+	    cp = stpcpy (cp, ent->conflict) + 1;
+	cp = start + ENTIDX_ALIGN (cp - start);
+	rec.size = cp - start;
+	memcpy (start, &rec, sizeof rec);
+    }
+    assert (cp == buf + size);
+
+    fp = CVS_FOPEN (file, FOPEN_BINARY_WRITE);
+    if (fp == NULL)
+	TRACE (TRACE_DATA, "write_entries_index: cannot write `%s'", file);
+    else
+    {
+	size_t written = fwrite (buf, 1, size, fp);
+
+	if (fclose (fp) == EOF || written != size)
+	{
+	    TRACE (TRACE_DATA, "write_entries_index: cannot write `%s'",
+		   file);
+	    CVS_UNLINK (file);
+	}
+    }
+    free (buf);
+    free (file);
+}
+
+
+
+/* Entries files smaller than this are rewritten as soon as anything is added
+ * to their Entries.Log.  Larger ones are only rewritten once their log has
+ * grown to 1/ENTLOG_RATIO of their size, since rewriting them for every
+ * change would make adding N files to a directory cost O(N^2).
+ */
+#define ENTLOG_LAZY_MIN		65536
+#define ENTLOG_RATIO		4
+
+
+
+/* Return true if the Entries.Log in DIR should be folded back into the
+ * Entries file now.  An empty log, as left by Subdirs_Known, always is.
+ */
+static bool
+entries_log_due (const char *dir)
+{
+    struct stat ent_sb, log_sb;
+    char *file;
+    bool due;
+
+    file = dir_append (dir, CVSADM_ENTLOG);
+    due = stat (file, &log_sb) == 0;
+    free (file);
+    if (!due)
+	return false;
+
+    file = dir_append (dir, CVSADM_ENT);
+    due = stat (file, &ent_sb) < 0
+	  || ent_sb.st_size < ENTLOG_LAZY_MIN
+	  || log_sb.st_size == 0
+	  || log_sb.st_size >= ent_sb.st_size / ENTLOG_RATIO;
+    free (file);
+    return due;
+}
+
+
+
 /*
  * write out the current entries file given a list,  making a backup copy
  * first of course
@@ -236,6 +609,8 @@ write_entries (List *list, const char *update_dir, const char *dir)
     rename_file (bakfilename, entfilename);
     free (entfilename);
 
+    write_entries_index (list, dir, sawdir || entriesHasAllSubdirs (list));
+
     entfilename = dir_append (dir, CVSADM_ENTLOG);
     /* now, remove the log file */
     if (unlink_file (entfilename) < 0 && !existence_error (errno))
@@ -334,11 +709,10 @@ AddEntryNode (List *list, Entnode *entdata)
     p->type = ENTRIES;
     p->delproc = Entries_delproc;
 
-    /* this one gets a key of the name for hashing */
-    /* FIXME This results in duplicated data --- the hash package shouldn't
-       assume that the key is dynamically allocated.  The user's free proc
-       should be responsible for freeing the key. */
-    p->key = xstrdup (entdata->user);
+    /* this one gets a key of the name for hashing, kept in the list's pool
+       so that discarding the whole Entries list doesn't free each key */
+    p->key = list_strdup (list, entdata->user);
+    p->flags = NODE_KEY_POOLED;
     p->data = entdata;
 
     /* put the node into the list */
@@ -652,8 +1026,10 @@ Entries_Open_Dir (int aflag, const char *update_dir_i, const char *dir)
     char *dirtag, *dirdate;
     int dirnonbranch;
     int do_rewrite = 0;
+    bool sawlog = false;
     FILE *fpin;
     int sawdir;
+    size_t count = 0;
     char *entfile;
     char *update_dir;
 
@@ -687,11 +1063,22 @@ Entries_Open_Dir (int aflag, const char *update_dir_i, const char *dir)
 
     update_dir = dir_append (update_dir_i, dir);
     entfile = dir_append (dir, CVSADM_ENT);
-    fpin = CVS_FOPEN (entfile, "r");
+    if (read_entries_index (entries, dir, &sawdir))
+	/* No need to parse the text.  */
+	fpin = NULL;
+    else if ((fpin = CVS_FOPEN (entfile, "r")) == NULL)
+    {
+	char *update_file = dir_append (update_dir, CVSADM_ENT);
+	error (0, errno, "cannot open %s for reading", quote (update_file));
+	free (update_file);
+    }
     if (fpin)
     {
 	while ((ent = fgetentent (fpin, NULL, &sawdir)) != NULL)
+	{
 	    AddEntryNode (entries, ent);
+	    count++;
+	}
 
 	if (fclose (fpin) < 0)
 	{
@@ -701,12 +1088,6 @@ Entries_Open_Dir (int aflag, const char *update_dir_i, const char *dir)
 	    free (update_file);
 	}
     }
-    else
-    {
-	char *update_file = dir_append (update_dir, CVSADM_ENT);
-	error (0, errno, "cannot open %s for reading", quote (update_file));
-	free (update_file);
-    }
     free (entfile);
 
     entfile = dir_append (dir, CVSADM_ENTLOG);
@@ -734,7 +1115,8 @@ Entries_Open_Dir (int aflag, const char *update_dir_i, const char *dir)
 	        break;
 	    }
 	}
-	do_rewrite = 1;
+	sawlog = true;
+	do_rewrite = entries_log_due (dir);
 	if (fclose (fpin) < 0)
 	{
 	    char *update_file = dir_append (update_dir, CVSADM_ENTLOG);
@@ -759,6 +1141,9 @@ Entries_Open_Dir (int aflag, const char *update_dir_i, const char *dir)
 
     if (do_rewrite && !noexec)
 	write_entries (entries, update_dir_i, dir);
+    else if (!sawlog && count >= ENTIDX_MIN && !noexec)
+	/* Index a large Entries file which we had to parse.  */
+	write_entries_index (entries, dir, sawdir);
 
     /* clean up and return */
     free (update_dir);
@@ -787,13 +1172,8 @@ Entries_Close_Dir (List *list, const char *update_dir, const char *dir)
 
     if (list)
     {
-	if (!noexec)
-	{
-	    char *entfile = dir_append (dir, CVSADM_ENTLOG);
-	    if (isfile (entfile))
-		write_entries (list, update_dir, dir);
-	    free (entfile);
-	}
+	if (!noexec && entries_log_due (dir))
+	    write_entries (list, update_dir, dir);
 	dellist (&list);
     }
 }
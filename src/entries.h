@@ -42,6 +42,8 @@ struct entnode
 
     /* Timestamp, or "" if none (never NULL).  */
     char *timestamp;
+    /* TIMESTAMP in seconds since the epoch, or -1 if it isn't a date.  */
+    time_t mtime;
 
     /* Keyword expansion options, or "" if none (never NULL).  */
     char *options;
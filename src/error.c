@@ -19,6 +19,7 @@
 #endif
 
 #include "cvs.h"
+#include "difflib.h"
 #include "vasnprintf.h"
 
 /* Out of memory errors which could not be forwarded to the client are sent to
@@ -183,7 +184,10 @@ error (int status, int errnum, const char *message, ...)
 
     /* Done, if we're exiting.  */
     if (status)
+    {
+	diff_job_abort ();
 	exit (EXIT_FAILURE);
+    }
 
     /* Free anything we may have allocated.  */
     if (buf != statbuf) free (buf);
@@ -27,6 +27,12 @@
 /* SUSv3 */
 #include <stdlib.h>
 
+/* Linux */
+#ifdef HAVE_LINUX_FS_H
+# include <linux/fs.h>
+# include <sys/ioctl.h>
+#endif
+
 /* GNULIB */
 #include "lstat.h"
 #include "save-cwd.h"
@@ -79,7 +85,13 @@ force_copy_file (const char *from, const char *to)
 	    error (1, errno, "cannot fstat %s", from);
 	if ((fdout = creat (to, (int) sb.st_mode & 07777)) < 0)
 	    error (1, errno, "cannot create %s for copying", to);
-	if (sb.st_size > 0)
+	if (sb.st_size > 0
+#ifdef FICLONE
+	    /* Where the file system can share the data between the two
+	       files until either changes, there is nothing to copy.  */
+	    && ioctl (fdout, FICLONE, fdin) < 0
+#endif
+	   )
 	{
 	    char buf[BUFSIZ];
 	    int n;
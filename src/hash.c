@@ -23,33 +23,122 @@
 #include "cvs.h"
 
 /* Global caches.  The idea is that we maintain a linked list of "free"d
-   nodes or lists, and get new items from there.  It has been suggested
-   to use an obstack instead, but off the top of my head, I'm not sure
-   that would gain enough to be worth worrying about.  */
+   nodes or lists, and get new items from there.  When a cache runs dry it is
+   refilled with a whole slab of items from a single allocation, so that
+   building a large list does not call malloc once per node.  Slabs are never
+   returned to the system.  */
 static List *listcache = NULL;
 static Node *nodecache = NULL;
 
+/* Number of items carved from each slab.  */
+#define NODE_SLAB	128
+#define LIST_SLAB	32
+
+/* Blocks of a list's string pool start at POOL_MINBLOCK bytes, since most
+ * lists are small, and double up to POOL_MAXBLOCK.  Strings too large to
+ * share a block get one of their own.
+ */
+#define POOL_MINBLOCK	64
+#define POOL_MAXBLOCK	4096
+
+/* A block of LIST->POOL.  Strings are carved from the SIZE bytes which
+ * follow this header.  Blocks made by list_adopt have no storage of their
+ * own and instead own MEM.
+ */
+struct hashpool
+{
+    struct hashpool *next;
+    size_t size;
+    size_t used;
+    void *mem;
+};
+
+/* Allocator statistics, reported by hash_trace_stats.  */
+static struct
+{
+    unsigned long node_slabs;
+    unsigned long list_slabs;
+    unsigned long pool_blocks;
+    unsigned long pool_bytes;
+    unsigned long pool_strings;
+    unsigned long pool_adopted;
+    unsigned long frees_avoided;
+} hash_stats;
+
 static void freenode_mem (Node * p);
 
-/* hash function */
-static int
+/* The smallest hash table allocated for a list.  */
+#define HASH_MINSIZE	16
+
+/* Marks a HASHARRAY slot whose node has been removed.  Probes continue past
+ * these, but new nodes may be stored in them.
+ */
+static Node hash_deleted;
+#define HASH_DELETED	(&hash_deleted)
+
+/* hash function (FNV-1a) */
+static unsigned int
 hashp (const char *key)
 {
-    unsigned int h = 0;
-    unsigned int g;
+    unsigned int h = 2166136261U;
 
     assert(key != NULL);
 
     while (*key != 0)
     {
-	unsigned int c = *key++;
+	unsigned int c = (unsigned char) *key++;
 	/* The FOLD_FN_CHAR is so that findnode_fn works.  */
-	h = (h << 4) + FOLD_FN_CHAR (c);
-	if ((g = h & 0xf0000000) != 0)
-	    h = (h ^ (g >> 24)) ^ g;
+	h ^= FOLD_FN_CHAR (c);
+	h *= 16777619U;
     }
 
-    return h % HASHSIZE;
+    return h;
+}
+
+
+
+/* Return the number of hash slots needed to hold COUNT nodes while keeping
+ * LIST's table at most 3/4 full.
+ */
+static size_t
+hash_size_for (size_t count)
+{
+    size_t size = HASH_MINSIZE;
+
+    while (size / 4 * 3 < count)
+	size *= 2;
+    return size;
+}
+
+
+
+/* Rebuild LIST's hash table with SIZE slots, dropping any tombstones.  */
+static void
+hash_resize (List *list, size_t size)
+{
+    Node **old = list->hasharray;
+    size_t oldsize = list->hashsize;
+    size_t mask = size - 1;
+    size_t i, j;
+
+    TRACE (TRACE_MINUTIA, "hash_resize (%s, %lu)",
+	   TRACE_PTR (list, 0), (unsigned long) size);
+
+    list->hasharray = xcalloc (size, sizeof (Node *));
+    list->hashsize = size;
+    list->ndeleted = 0;
+
+    for (i = 0; i < oldsize; i++)
+    {
+	if (old[i] == NULL || old[i] == HASH_DELETED)
+	    continue;
+	for (j = old[i]->hashval & mask; list->hasharray[j] != NULL;
+	     j = (j + 1) & mask)
+	    ;
+	list->hasharray[j] = old[i];
+    }
+    if (old != NULL)
+	free (old);
 }
 
 
@@ -60,24 +149,43 @@ hashp (const char *key)
 List *
 getlist (void)
 {
-    int i;
     List *list;
     Node *node;
 
-    if (listcache != NULL)
+#ifndef NOCACHE
+    if (listcache == NULL)
     {
-	/* get a list from the cache and clear it */
-	list = listcache;
-	listcache = listcache->next;
-	list->next = NULL;
-	for (i = 0; i < HASHSIZE; i++)
-	    list->hasharray[i] = NULL;
+	/* refill the cache with a new slab of lists */
+	List *slab = xnmalloc (LIST_SLAB, sizeof (List));
+	int i;
+
+	memset (slab, 0, LIST_SLAB * sizeof (List));
+	for (i = LIST_SLAB - 1; i >= 0; i--)
+	{
+	    slab[i].next = listcache;
+	    listcache = &slab[i];
+	}
+	hash_stats.list_slabs++;
+	TRACE (TRACE_MINUTIA, "getlist: new slab of %d lists", LIST_SLAB);
     }
-    else
+
+    /* get a list from the cache and clear it */
+    list = listcache;
+    listcache = listcache->next;
+    list->next = NULL;
+    list->hasharray = NULL;
+    list->hashsize = 0;
+    list->nhashed = 0;
+    list->ndeleted = 0;
+    list->pool = NULL;
+#else
+    list = xmalloc (sizeof (List));
+    memset (list, 0, sizeof (List));
+#endif
+
+    /* lists fresh from a slab still need a header; cached lists keep theirs */
+    if (list->list == NULL)
     {
-	/* make a new list from scratch */
-	list = xmalloc (sizeof (List));
-	memset (list, 0, sizeof (List));
 	node = getnode ();
 	list->list = node;
 	node->type = HEADER;
@@ -88,6 +196,21 @@ getlist (void)
 
 
 
+/*
+ * Like getlist, but size the hash table up front to hold COUNT keyed nodes,
+ * for callers which know roughly how large the list will grow.
+ */
+List *
+getlist_sized (size_t count)
+{
+    List *list = getlist ();
+
+    hash_resize (list, hash_size_for (count));
+    return list;
+}
+
+
+
 /*
  * Free up a list.  For accessing globals which might be accessed via interrupt
  * handlers, it can be assumed that the first action of this function will be
@@ -96,7 +219,6 @@ getlist (void)
 void
 dellist (List **listp)
 {
-    int i;
     Node *p;
     List *tmp;
 
@@ -110,30 +232,30 @@ dellist (List **listp)
 
     p = tmp->list;
 
-    /* free each node in the list (except header) */
+    /* free each node in the list (except header), without bothering to
+       remove each from the hash table, which is about to go away */
     while (p->next != p)
+    {
+	p->next->hashlist = NULL;
 	delnode (p->next);
+    }
 
     /* free any list-private data, without freeing the actual header */
     freenode_mem (p);
 
-    /* free up the header nodes for hash lists (if any) */
-    for (i = 0; i < HASHSIZE; i++)
+    /* free up the hash table (if any) */
+    if (tmp->hasharray != NULL)
+	free (tmp->hasharray);
+
+    /* release the string pool in one go */
+    while (tmp->pool != NULL)
     {
-	if ((p = tmp->hasharray[i]) != NULL)
-	{
-	    /* put the nodes into the cache */
-#ifndef NOCACHE
-	    p->type = NT_UNKNOWN;
-	    p->next = nodecache;
-	    nodecache = p;
-#else
-	    /* If NOCACHE is defined we turn off the cache.  This can make
-	       it easier to tools to determine where items were allocated
-	       and freed, for tracking down memory leaks and the like.  */
-	    free (p);
-#endif
-	}
+	struct hashpool *block = tmp->pool;
+
+	tmp->pool = block->next;
+	if (block->mem != NULL)
+	    free (block->mem);
+	free (block);
     }
 
     /* put it on the cache */
@@ -141,6 +263,9 @@ dellist (List **listp)
     tmp->next = listcache;
     listcache = tmp;
 #else
+    /* If NOCACHE is defined we turn off the cache.  This can make
+       it easier to tools to determine where items were allocated
+       and freed, for tracking down memory leaks and the like.  */
     free (tmp->list);
     free (tmp);
 #endif
@@ -161,10 +286,29 @@ removenode (Node *p)
     p->prev->next = p->next;
 
     /* if it was hashed, remove it from there too */
-    if (p->hashnext)
+    if (p->hashlist)
     {
-	p->hashnext->hashprev = p->hashprev;
-	p->hashprev->hashnext = p->hashnext;
+	List *list = p->hashlist;
+	size_t mask = list->hashsize - 1;
+	size_t i;
+
+	for (i = p->hashval & mask; list->hasharray[i] != p;
+	     i = (i + 1) & mask)
+	    assert (list->hasharray[i] != NULL);
+
+	list->nhashed--;
+	if (list->nhashed == 0)
+	{
+	    /* Cheaply get rid of any tombstones.  */
+	    memset (list->hasharray, 0, list->hashsize * sizeof (Node *));
+	    list->ndeleted = 0;
+	}
+	else
+	{
+	    list->hasharray[i] = HASH_DELETED;
+	    list->ndeleted++;
+	}
+	p->hashlist = NULL;
     }
 }
 
@@ -186,6 +330,25 @@ mergelists (List *dest, List **src)
 	if (addnode (dest, p) == -1)
 	    freenode (p);
     }
+
+    /* Pooled keys and data need not be strings, so rather than copying
+       them hand the whole pool over to DEST.  Its first block stays first,
+       since that is the one list_strdup carves from.  */
+    if ((*src)->pool != NULL)
+    {
+	struct hashpool *last = (*src)->pool;
+
+	while (last->next != NULL)
+	    last = last->next;
+	if (dest->pool != NULL)
+	{
+	    last->next = dest->pool->next;
+	    dest->pool->next = (*src)->pool;
+	}
+	else
+	    dest->pool = (*src)->pool;
+	(*src)->pool = NULL;
+    }
     dellist (src);
 }
 
@@ -199,18 +362,29 @@ getnode (void)
 {
     Node *p;
 
-    if (nodecache != NULL)
-    {
-	/* get one from the cache */
-	p = nodecache;
-	nodecache = p->next;
-    }
-    else
+#ifndef NOCACHE
+    if (nodecache == NULL)
     {
-	/* make a new one */
-	p = xmalloc (sizeof (Node));
+	/* refill the cache with a new slab of nodes */
+	Node *slab = xnmalloc (NODE_SLAB, sizeof (Node));
+	int i;
+
+	for (i = NODE_SLAB - 1; i >= 0; i--)
+	{
+	    slab[i].next = nodecache;
+	    nodecache = &slab[i];
+	}
+	hash_stats.node_slabs++;
+	TRACE (TRACE_MINUTIA, "getnode: new slab of %d nodes", NODE_SLAB);
     }
 
+    /* get one from the cache */
+    p = nodecache;
+    nodecache = p->next;
+#else
+    p = xmalloc (sizeof (Node));
+#endif
+
     /* always make it clean */
     memset (p, 0, sizeof (Node));
     p->type = NT_UNKNOWN;
@@ -236,24 +410,31 @@ delnode (Node *p)
 
 
 /*
- * free up the storage associated with a node
+ * free up the storage associated with a node.  The pooled flags alone decide
+ * whether the key and data are ours to free: pooled data is never handed to
+ * the delproc, since the list's pool owns it.
  */
 static void
 freenode_mem (Node *p)
 {
-    if (p->delproc != NULL)
+    if (p->flags & NODE_DATA_POOLED)
+	hash_stats.frees_avoided++;	/* released with the list's pool */
+    else if (p->delproc != NULL)
 	p->delproc (p);			/* call the specified delproc */
     else
     {
 	if (p->data != NULL)		/* otherwise free() it if necessary */
 	    free (p->data);
     }
-    if (p->key != NULL)			/* free the key if necessary */
+    if (p->flags & NODE_KEY_POOLED)
+	hash_stats.frees_avoided++;
+    else if (p->key != NULL)		/* free the key if necessary */
 	free (p->key);
 
     /* to be safe, re-initialize these */
     p->key = p->data = NULL;
     p->delproc = NULL;
+    p->flags = 0;
 }
 
 
@@ -291,29 +472,37 @@ insert_before (List *list, Node *marker, Node *p)
 {
     if (p->key != NULL)			/* hash it too? */
     {
-	int hashval;
+	unsigned int hashval;
+	size_t mask, i;
+	Node **slot = NULL;
 	Node *q;
 
-	hashval = hashp (p->key);
-	if (list->hasharray[hashval] == NULL)	/* make a header for list? */
-	{
-	    q = getnode ();
-	    q->type = HEADER;
-	    list->hasharray[hashval] = q->hashnext = q->hashprev = q;
-	}
+	/* make room first, so that the probe below finds a free slot */
+	if ((list->nhashed + list->ndeleted + 1) > list->hashsize / 4 * 3)
+	    hash_resize (list, hash_size_for (list->nhashed + 1));
 
-	/* put it into the hash list if it's not already there */
-	for (q = list->hasharray[hashval]->hashnext;
-	     q != list->hasharray[hashval]; q = q->hashnext)
+	/* put it into the hash table if it's not already there */
+	hashval = hashp (p->key);
+	mask = list->hashsize - 1;
+	for (i = hashval & mask; (q = list->hasharray[i]) != NULL;
+	     i = (i + 1) & mask)
 	{
-	    if (STREQ (p->key, q->key))
+	    if (q == HASH_DELETED)
+	    {
+		if (slot == NULL)
+		    slot = &list->hasharray[i];
+	    }
+	    else if (q->hashval == hashval && STREQ (p->key, q->key))
 		return -1;
 	}
-	q = list->hasharray[hashval];
-	p->hashprev = q->hashprev;
-	p->hashnext = q;
-	p->hashprev->hashnext = p;
-	q->hashprev = p;
+	if (slot == NULL)
+	    slot = &list->hasharray[i];
+	else
+	    list->ndeleted--;
+	*slot = p;
+	list->nhashed++;
+	p->hashval = hashval;
+	p->hashlist = list;
     }
 
     p->next = marker;
@@ -359,22 +548,26 @@ addnode_at_front (List *list, Node *p)
 Node *
 findnode (List *list, const char *key)
 {
-    Node *head, *p;
+    unsigned int hashval;
+    size_t mask, i;
+    Node *p;
 
     assert (key);
-    TRACE (TRACE_DATA, "findnode (%s, %s)", TRACE_PTR (list, 0), key);
-
-    if (list_isempty (list))
-	return NULL;
+    /* This is called for every file name and keyword looked up, so don't
+       even format the list pointer unless it will be printed.  */
+    if (trace >= TRACE_DATA)
+	TRACE (TRACE_DATA, "findnode (%s, %s)", TRACE_PTR (list, 0), key);
 
-    head = list->hasharray[hashp (key)];
-    if (!head)
-	/* Not found.  */
+    if (list == NULL || list->nhashed == 0)
 	return NULL;
 
-    for (p = head->hashnext; p != head; p = p->hashnext)
-	if (STREQ (p->key, key))
+    hashval = hashp (key);
+    mask = list->hashsize - 1;
+    for (i = hashval & mask; (p = list->hasharray[i]) != NULL;
+	 i = (i + 1) & mask)
+	if (p != HASH_DELETED && p->hashval == hashval && STREQ (p->key, key))
 	    return p;
+    /* Not found.  */
     return NULL;
 }
 
@@ -386,23 +579,26 @@ findnode (List *list, const char *key)
 Node *
 findnode_fn (List *list, const char *key)
 {
-    Node *head, *p;
+    unsigned int hashval;
+    size_t mask, i;
+    Node *p;
 
     assert (key);
-    TRACE (TRACE_DATA, "findnode_fn (%s, %s)", TRACE_PTR (list, 0), key);
+    if (trace >= TRACE_DATA)
+	TRACE (TRACE_DATA, "findnode_fn (%s, %s)", TRACE_PTR (list, 0), key);
 
     /* This probably should be "assert (list != NULL)" (or if not we
        should document the current behavior), but only if we check all
        the callers to see if any are relying on this behavior.  */
-    if (list_isempty(list))
-	return NULL;
-
-    head = list->hasharray[hashp (key)];
-    if (!head)
+    if (list == NULL || list->nhashed == 0)
 	return NULL;
 
-    for (p = head->hashnext; p != head; p = p->hashnext)
-	if (fncmp (p->key, key) == 0)
+    hashval = hashp (key);
+    mask = list->hashsize - 1;
+    for (i = hashval & mask; (p = list->hasharray[i]) != NULL;
+	 i = (i + 1) & mask)
+	if (p != HASH_DELETED && p->hashval == hashval
+	    && fncmp (p->key, key) == 0)
 	    return p;
     return NULL;
 }
@@ -425,9 +621,10 @@ walklist (List *list, int (*proc) (Node *, void *), void *closure)
     Node *head, *p;
     int err = 0;
 
-    TRACE (TRACE_FLOW, "walklist (list=%s, proc=%s, closure=%s)",
-	   TRACE_PTR (list, 0), TRACE_PTR ((void *)proc, 1),
-	   TRACE_PTR (closure, 2));
+    if (trace >= TRACE_FLOW)
+	TRACE (TRACE_FLOW, "walklist (list=%s, proc=%s, closure=%s)",
+	       TRACE_PTR (list, 0), TRACE_PTR ((void *)proc, 1),
+	       TRACE_PTR (closure, 2));
 
     if (!list) return 0;
 
@@ -523,6 +720,104 @@ fsortcmp (const Node *p, const Node *q)
 
 
 
+/*
+ * Copy STR into LIST's string pool, which is released as a whole when LIST
+ * is deleted.  The caller should set NODE_KEY_POOLED or NODE_DATA_POOLED on
+ * any node of LIST which it stores the copy in.
+ *
+ * RETURNS
+ *   The copy, which must not be passed to free().
+ */
+char *
+list_strdup (List *list, const char *str)
+{
+    size_t len = strlen (str) + 1;
+    struct hashpool *block = list->pool;
+    char *copy;
+
+    if (block == NULL || block->size - block->used < len)
+    {
+	size_t size = block == NULL || block->mem != NULL
+		      ? POOL_MINBLOCK : block->size * 2;
+
+	if (size > POOL_MAXBLOCK)
+	    size = POOL_MAXBLOCK;
+	if (size < len)
+	    size = len;
+
+	block = xmalloc (sizeof (struct hashpool) + size);
+	block->size = size;
+	block->used = 0;
+	block->mem = NULL;
+	if (size == len && list->pool != NULL)
+	{
+	    /* Keep carving from the current block.  */
+	    block->next = list->pool->next;
+	    list->pool->next = block;
+	}
+	else
+	{
+	    block->next = list->pool;
+	    list->pool = block;
+	}
+	hash_stats.pool_blocks++;
+	hash_stats.pool_bytes += size;
+    }
+
+    copy = (char *) (block + 1) + block->used;
+    memcpy (copy, str, len);
+    block->used += len;
+    hash_stats.pool_strings++;
+    return copy;
+}
+
+
+
+/*
+ * Hand MEM, which must have come from malloc, over to LIST.  It will be
+ * freed when LIST is deleted, so nodes may point into it as long as they are
+ * marked NODE_KEY_POOLED or NODE_DATA_POOLED.
+ */
+void
+list_adopt (List *list, void *mem)
+{
+    struct hashpool *block = xmalloc (sizeof (struct hashpool));
+
+    block->size = block->used = 0;
+    block->mem = mem;
+    if (list->pool != NULL)
+    {
+	block->next = list->pool->next;
+	list->pool->next = block;
+    }
+    else
+    {
+	block->next = NULL;
+	list->pool = block;
+    }
+    hash_stats.pool_adopted++;
+}
+
+
+
+/*
+ * Report what the allocator has done so far, when tracing.
+ */
+void
+hash_trace_stats (void)
+{
+    TRACE (TRACE_DATA, "hash: %lu nodes in %lu slabs, %lu lists in %lu slabs",
+	   hash_stats.node_slabs * NODE_SLAB, hash_stats.node_slabs,
+	   hash_stats.list_slabs * LIST_SLAB, hash_stats.list_slabs);
+    TRACE (TRACE_DATA,
+	   "hash: %lu pooled strings in %lu blocks (%lu bytes), %lu adopted",
+	   hash_stats.pool_strings, hash_stats.pool_blocks,
+	   hash_stats.pool_bytes, hash_stats.pool_adopted);
+    TRACE (TRACE_DATA, "hash: %lu frees avoided", hash_stats.frees_avoided);
+}
+
+
+
 /* Debugging functions.  Quite useful to call from within gdb. */
 
 
@@ -585,8 +880,9 @@ printlist (List *list)
 	return;
     }
 
-    printf ("List at %s: list=%s, HASHSIZE=%d, next=%s\n",
-	    TRACE_PTR (list, 0), TRACE_PTR (list->list, 1), HASHSIZE,
+    printf ("List at %s: list=%s, hashsize=%lu, nhashed=%lu, next=%s\n",
+	    TRACE_PTR (list, 0), TRACE_PTR (list->list, 1),
+	    (unsigned long) list->hashsize, (unsigned long) list->nhashed,
 	    TRACE_PTR (list->next, 2));
 
     (void) walklist(list, printnode, NULL);
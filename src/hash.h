@@ -15,12 +15,6 @@
 
 #include <stddef.h>
 
-/*
- * The number of buckets for the hash table contained in each list.  This
- * should probably be prime.
- */
-#define HASHSIZE	151
-
 /*
  * Types of nodes
  */
@@ -32,13 +26,21 @@ enum ntype
 };
 typedef enum ntype Ntype;
 
+struct hashlist;
+struct hashpool;
+
+/* Node flags.  */
+#define NODE_KEY_POOLED		0x1	/* KEY lives in its list's pool.  */
+#define NODE_DATA_POOLED	0x2	/* DATA lives in its list's pool.  */
+
 struct hashnode
 {
     Ntype type;
+    unsigned int hashval;	/* Hash of KEY, valid while in HASHLIST.  */
+    unsigned int flags;		/* NODE_* flags above.  */
     struct hashnode *next;
     struct hashnode *prev;
-    struct hashnode *hashnext;
-    struct hashnode *hashprev;
+    struct hashlist *hashlist;	/* The list hashing this node, if any.  */
     char *key;
     void *data;
     size_t len;			/* Length of DATA.  */
@@ -46,15 +48,32 @@ struct hashnode
 };
 typedef struct hashnode Node;
 
+/*
+ * Lists keep their nodes in a doubly linked ring headed by LIST, which
+ * defines the order seen by walklist.  Nodes with keys are also indexed in
+ * HASHARRAY, an open-addressed table which is allocated on the first keyed
+ * insertion and doubled as it fills.
+ *
+ * POOL holds strings allocated with list_strdup and buffers handed over with
+ * list_adopt.  They are all released at once by dellist, and nodes whose
+ * key or data live there are marked with NODE_KEY_POOLED or NODE_DATA_POOLED
+ * so that freenode leaves them alone, whatever their delproc.  mergelists
+ * hands the pool over along with the nodes.
+ */
 struct hashlist
 {
     Node *list;
-    Node *hasharray[HASHSIZE];
+    Node **hasharray;
+    size_t hashsize;		/* Slots in HASHARRAY, a power of two.  */
+    size_t nhashed;		/* Nodes in HASHARRAY.  */
+    size_t ndeleted;		/* Slots in HASHARRAY holding tombstones.  */
+    struct hashpool *pool;
     struct hashlist *next;
 };
 typedef struct hashlist List;
 
 List *getlist (void);
+List *getlist_sized (size_t count);
 Node *findnode (List *list, const char *key);
 Node *findnode_fn (List *list, const char *key);
 Node *getnode (void);
@@ -71,5 +90,8 @@ void freenode (Node *p);
 void sortlist (List *list, int (*)(const Node *, const Node *));
 int fsortcmp (const Node *p, const Node *q);
 void printlist (List *list);
+char *list_strdup (List *list, const char *str);
+void list_adopt (List *list, void *mem);
+void hash_trace_stats (void);
 
 #endif /* HASH_H */
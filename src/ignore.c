@@ -34,6 +34,231 @@
 
 
 
+/*
+ * Wildcard set section.
+ *
+ * Most wildcards in ignore and wrapper lists are plain names (`core'),
+ * suffixes (`*.o') or prefixes (`.#*').  Rather than trying each of them
+ * in turn with CVS_FNMATCH, a wildcard set keeps the plain names and the
+ * suffixes in hash lists, and the prefixes in buckets by their first
+ * character, and only falls back on CVS_FNMATCH for the rest.  The LEN of
+ * each hash node is the index of the first wildcard it stands for, so that
+ * callers like the wrapper code, for which the first match wins, still get
+ * the same answer as a linear search would give them.
+ */
+
+struct wildcard_prefix
+{
+    const char *prefix;
+    size_t len;
+    int index;
+    struct wildcard_prefix *next;
+};
+
+struct wildcard_set
+{
+    int count;			/* Wildcards added so far.  */
+    List *names;		/* Wildcards without special characters.  */
+    List *suffixes;		/* What follows the `*' of `*SUFFIX'.  */
+    size_t *suffix_lens;	/* The distinct lengths of SUFFIXES.  */
+    size_t nsuffix_lens;
+    size_t suffix_lens_size;
+    struct wildcard_prefix *prefixes[UCHAR_MAX + 1];
+				/* What precedes the `*' of `PREFIX*', by
+				 * the first character of PREFIX.  */
+    char **others;		/* Any other wildcards, in order...  */
+    int *other_index;		/* ...and their indexes.  */
+    size_t nothers;
+    size_t others_size;
+};
+
+
+
+/* Return a new, empty wildcard set.  */
+struct wildcard_set *
+wildcard_set_new (void)
+{
+    struct wildcard_set *set = xzalloc (sizeof *set);
+    set->names = getlist ();
+    set->suffixes = getlist ();
+    return set;
+}
+
+
+
+/* Return true if the LEN characters at S contain none which CVS_FNMATCH
+ * would treat specially.
+ */
+static bool
+wildcard_plain (const char *s, size_t len)
+{
+    return strcspn (s, "*?[\\") >= len;
+}
+
+
+
+/* Add the key S to the hash list LIST, pointing at wildcard INDEX, unless
+ * an earlier wildcard already put it there.  Return true if it was added.
+ */
+static bool
+wildcard_set_key (List *list, const char *s, int index)
+{
+    Node *p;
+
+    if (findnode (list, s) != NULL)
+	return false;
+    p = getnode ();
+    p->key = list_strdup (list, s);
+    p->flags = NODE_KEY_POOLED;
+    p->len = index;
+    addnode (list, p);
+    return true;
+}
+
+
+
+/* Add WILDCARD to SET.  Its index is the number of wildcards added before
+ * it.
+ */
+void
+wildcard_set_add (struct wildcard_set *set, const char *wildcard)
+{
+    size_t len = strlen (wildcard);
+    int index = set->count++;
+
+#ifndef FILENAMES_CASE_INSENSITIVE
+    /* The hash lists compare names exactly, so on systems where
+     * CVS_FNMATCH ignores case, leave everything to it.
+     */
+    if (wildcard_plain (wildcard, len))
+    {
+	wildcard_set_key (set->names, wildcard, index);
+	return;
+    }
+
+    if (wildcard[0] == '*' && wildcard_plain (wildcard + 1, len - 1))
+    {
+	if (wildcard_set_key (set->suffixes, wildcard + 1, index))
+	{
+	    size_t i;
+
+	    for (i = 0; i < set->nsuffix_lens; i++)
+		if (set->suffix_lens[i] == len - 1)
+		    break;
+	    if (i == set->nsuffix_lens)
+	    {
+		if (set->nsuffix_lens == set->suffix_lens_size)
+		    set->suffix_lens = x2nrealloc (set->suffix_lens,
+						   &set->suffix_lens_size,
+						   sizeof *set->suffix_lens);
+		set->suffix_lens[set->nsuffix_lens++] = len - 1;
+	    }
+	}
+	return;
+    }
+
+    if (wildcard[len - 1] == '*' && wildcard_plain (wildcard, len - 1))
+    {
+	struct wildcard_prefix *p = xmalloc (sizeof *p);
+	struct wildcard_prefix **pp;
+
+	p->prefix = list_strdup (set->names, wildcard);
+	p->len = len - 1;
+	p->index = index;
+	p->next = NULL;
+
+	/* Keep the buckets in the order the wildcards were added.  */
+	for (pp = &set->prefixes[(unsigned char) wildcard[0]]; *pp != NULL;
+	     pp = &(*pp)->next)
+	    ;
+	*pp = p;
+	return;
+    }
+#endif /* !FILENAMES_CASE_INSENSITIVE */
+
+    if (set->nothers == set->others_size)
+    {
+	set->others = x2nrealloc (set->others, &set->others_size,
+				  sizeof *set->others);
+	set->other_index = xnrealloc (set->other_index, set->others_size,
+				      sizeof *set->other_index);
+    }
+    set->others[set->nothers] = list_strdup (set->names, wildcard);
+    set->other_index[set->nothers++] = index;
+}
+
+
+
+/* Return the index of the first wildcard in SET which matches NAME, or -1
+ * if none does.
+ */
+int
+wildcard_set_match (struct wildcard_set *set, const char *name)
+{
+    size_t len = strlen (name);
+    int best = set->count;
+    struct wildcard_prefix *p;
+    Node *n;
+    size_t i;
+
+    n = findnode (set->names, name);
+    if (n != NULL)
+	best = n->len;
+
+    for (i = 0; i < set->nsuffix_lens; i++)
+	if (set->suffix_lens[i] <= len)
+	{
+	    n = findnode (set->suffixes, name + len - set->suffix_lens[i]);
+	    if (n != NULL && (int) n->len < best)
+		best = n->len;
+	}
+
+    for (p = set->prefixes[(unsigned char) name[0]];
+	 p != NULL && p->index < best; p = p->next)
+	if (p->len <= len && !strncmp (p->prefix, name, p->len))
+	{
+	    best = p->index;
+	    break;
+	}
+
+    for (i = 0; i < set->nothers && set->other_index[i] < best; i++)
+	if (CVS_FNMATCH (set->others[i], name, 0) == 0)
+	{
+	    best = set->other_index[i];
+	    break;
+	}
+
+    return best < set->count ? best : -1;
+}
+
+
+
+/* Free SET and everything in it.  */
+void
+wildcard_set_free (struct wildcard_set *set)
+{
+    size_t i;
+
+    if (set == NULL)
+	return;
+
+    for (i = 0; i <= UCHAR_MAX; i++)
+	while (set->prefixes[i] != NULL)
+	{
+	    struct wildcard_prefix *next = set->prefixes[i]->next;
+	    free (set->prefixes[i]);
+	    set->prefixes[i] = next;
+	}
+    dellist (&set->names);
+    dellist (&set->suffixes);
+    free (set->suffix_lens);
+    free (set->others);
+    free (set->other_index);
+    free (set);
+}
+
+
+
 /*
  * Ignore file section.
  * 
@@ -51,6 +276,8 @@ static int ign_size;			/* This many slots available (plus
 					 * one for a NULL) */
 static int ign_hold = -1;		/* Index where first "temporary" item
 					 * is held */
+static struct wildcard_set *ign_set;	/* IGN_LIST compiled for ign_name,
+					 * or NULL if it has changed since */
 
 const char *ign_default = ". .. core RCSLOG tags TAGS RCS SCCS .make.state\
  .nse_depinfo #* .#* cvslog.* ,* CVS CVS.adm .del-* *.a *.olb *.o *.obj\
@@ -131,6 +358,9 @@ ign_add_file (char *file, int hold)
     char *line = NULL;
     size_t line_allocated = 0;
 
+    wildcard_set_free (ign_set);
+    ign_set = NULL;
+
     /* restore the saved list (if any) */
     if (s_ign_list != NULL)
     {
@@ -191,6 +421,9 @@ ign_add (char *ign, int hold)
     if (!ign || !*ign)
 	return;
 
+    wildcard_set_free (ign_set);
+    ign_set = NULL;
+
     for (; *ign; ign++)
     {
 	char *mark;
@@ -294,6 +527,40 @@ ign_add (char *ign, int hold)
 
 
 
+/* Return the wildcards which are ignored everywhere, as a string for
+ * fsmonitor_same_ignores, or NULL if they can't be told apart from those
+ * of a .cvsignore file any more.
+ */
+static const char *
+ign_global (void)
+{
+    static bool done;
+    static char *global;
+
+    if (!done)
+    {
+	size_t len = 0;
+	int i;
+
+	done = true;
+	if (ign_hold >= 0 || s_ign_list != NULL)
+	    return NULL;
+	for (i = 0; i < ign_count; i++)
+	{
+	    size_t n = strlen (ign_list[i]);
+	    global = xrealloc (global, len + n + 2);
+	    memcpy (global + len, ign_list[i], n);
+	    len += n;
+	    global[len++] = ' ';
+	}
+	global = xrealloc (global, len + 1);
+	global[len] = '\0';
+    }
+    return global;
+}
+
+
+
 /* Return true if the given filename should be ignored by update or import,
  * else return false.
  */
@@ -305,11 +572,14 @@ ign_name (char *name)
     if (cpp == NULL)
 	return 0;
 
-    while (*cpp)
-	if (CVS_FNMATCH (*cpp++, name, 0) == 0)
-	    return 1;
+    if (ign_set == NULL)
+    {
+	ign_set = wildcard_set_new ();
+	while (*cpp)
+	    wildcard_set_add (ign_set, *cpp++);
+    }
 
-    return 0;
+    return wildcard_set_match (ign_set, name) >= 0;
 }
 
 
@@ -394,6 +664,14 @@ ignore_files (List *ilist, List *entries, const char *update_dir,
     else
 	xdir = update_dir;
 
+    /* Nothing new can have appeared in a directory which hasn't changed
+       since it was last found to have nothing to report.  */
+    if (fsmonitor_same_ignores (ign_global ()) && fsmonitor_unchanged (xdir))
+    {
+	fsmonitor_scanned (xdir, true);
+	return;
+    }
+
     dirp = CVS_OPENDIR (".");
     if (!dirp)
     {
@@ -476,5 +754,6 @@ ignore_files (List *ilist, List *entries, const char *update_dir,
     sortlist (files, fsortcmp);
     for (p = files->list->next; p != files->list; p = p->next)
 	(*proc) (p->key, xdir);
+    fsmonitor_scanned (xdir, list_isempty (files));
     dellist (&files);
 }
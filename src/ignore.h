@@ -21,6 +21,13 @@
 
 #include "hash.h"
 
+/* A set of wildcards which can be matched against a name at once.  */
+struct wildcard_set;
+struct wildcard_set *wildcard_set_new (void);
+void wildcard_set_add (struct wildcard_set *set, const char *wildcard);
+int wildcard_set_match (struct wildcard_set *set, const char *name);
+void wildcard_set_free (struct wildcard_set *set);
+
 int ign_name (char *name);
 void ign_add (char *ign, int hold);
 void ign_add_file (char *file, int hold);
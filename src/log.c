@@ -136,6 +136,21 @@ struct log_data_and_rcs
     RCSNode *rcs;
 };
 
+/* The state of log_fileproc while it prints the trunk of a file as
+   RCS_walk_deltatexts reads the delta texts.  */
+struct log_stream
+{
+    struct log_data *log_data;
+    struct revlist *revlist;
+    /* The last trunk revision read.  It is printed once the delta text
+       of the revision after it has supplied its add and delete counts.  */
+    RCSVers *pending;
+    /* The revision after PENDING, or NULL if there is none or its delta
+       text was out of order, in which case the rest of the trunk is
+       printed after the whole file has been read.  */
+    RCSVers *expected;
+};
+
 static int rlog_proc (int argc, char **argv, char *xwhere,
                       char *mwhere, char *mfile, int shorten,
                       int local_specified, char *mname, char *msg);
@@ -143,6 +158,7 @@ static Dtype log_dirproc (void *callerdat, const char *dir,
                           const char *repository, const char *update_dir,
                           List *entries);
 static int log_fileproc (void *callerdat, struct file_info *finfo);
+static void log_stream_proc (RCSNode *, RCSVers *, void *);
 static struct option_revlist *log_parse_revlist (const char *);
 static void log_parse_date (struct log_data *, const char *);
 static void log_parse_list (List **, const char *);
@@ -790,6 +806,42 @@ printlock_proc (Node *lock, void *foo)
 
 
 
+/*
+ * Print the trunk revisions of a file as RCS_walk_deltatexts reads their
+ * delta texts.  The log message of a trunk revision is in its own delta
+ * text, but its add and delete counts are in that of the next revision,
+ * so each revision is printed when the following one has been read.  A
+ * printed revision's delta text information is not needed any more and
+ * is freed, so memory use does not grow with the length of the trunk.
+ */
+static void
+log_stream_proc (RCSNode *rcs, RCSVers *vers, void *closure)
+{
+    struct log_stream *stream = closure;
+    Node *p;
+
+    if (vers != stream->expected)
+	return;
+
+    if (stream->pending != NULL)
+    {
+	log_version (stream->log_data, stream->revlist, rcs, stream->pending,
+		     1);
+	dellist (&stream->pending->other);
+    }
+
+    stream->pending = vers;
+    stream->expected = NULL;
+    if (vers->next != NULL)
+    {
+	p = findnode (rcs->versions, vers->next);
+	if (p != NULL)
+	    stream->expected = p->data;
+    }
+}
+
+
+
 /*
  * Do an rlog on a file
  */
@@ -839,8 +891,15 @@ log_fileproc (void *callerdat, struct file_info *finfo)
     if (log_data->sup_header || !log_data->nameonly)
     {
 
-	/* We will need all the information in the RCS file.  */
-	RCS_fully_parse (rcsfile);
+	/* We will need all the revision information in the RCS file.  The
+	   delta texts are only read as the revisions are printed, unless
+	   revisions are selected by state: that looks at every revision
+	   before printing any, so read the whole file first, which reports
+	   a damaged file before anything else is done with it.  */
+	if (log_data->statelist != NULL)
+	    RCS_fully_parse (rcsfile);
+	else if (rcsfile->flags & PARTIAL)
+	    RCS_reparsercsfile (rcsfile, NULL, NULL);
 
 	/* Turn any symbolic revisions in the revision list into numeric
 	   revisions.  */
@@ -980,10 +1039,24 @@ log_fileproc (void *callerdat, struct file_info *finfo)
 
     if (!log_data->header && ! log_data->long_header && rcsfile->head != NULL)
     {
+	struct log_stream stream;
+
 	p = findnode (rcsfile->versions, rcsfile->head);
 	if (p == NULL)
 	    error (1, 0, "can not find head revision in `%s'",
 		   finfo->fullname);
+
+	/* Print the trunk while the delta texts are read, which CVS
+	   writes in the same order, unless they have been read already.  */
+	stream.log_data = log_data;
+	stream.revlist = revlist;
+	stream.pending = NULL;
+	stream.expected = p->data;
+	if (log_data->statelist == NULL)
+	    RCS_walk_deltatexts (rcsfile, log_stream_proc, &stream);
+
+	if (stream.pending != NULL)
+	    p = findnode (rcsfile->versions, stream.pending->version);
 	while (p != NULL)
 	{
 	    RCSVers *vers = p->data;
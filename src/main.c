@@ -1259,6 +1259,15 @@ cause intermittent sandbox corruption.");
 
 	assert (current_parsed_root == NULL);
 
+	/* Find out what has changed in the working directory since the
+	   last run, if the user has given us a way to.  */
+	if (
+#ifdef SERVER_SUPPORT
+	    cm->func != server &&
+#endif
+	    cm->attr & CVS_CMD_USES_WORK_DIR)
+	    fsmonitor_setup ();
+
 	/* If we're running the server, we want to execute this main
 	   loop once and only once (we won't be serving multiple roots
 	   from this connection, so there's no need to do it more than
@@ -1387,6 +1396,7 @@ cause intermittent sandbox corruption.");
 	} /* end of loop for cvsroot values */
 
 	dellist (&root_directories);
+	fsmonitor_finish ();
     } /* end of stuff that gets done if the user DOESN'T ask for help */
 
     root_allow_free ();
@@ -1402,6 +1412,8 @@ cause intermittent sandbox corruption.");
     if (hostname) {free (hostname); hostname = NULL;}
     if (program_path) {free ((char *)program_path); program_path = NULL;}
 
+    hash_trace_stats ();
+
     /* This is exit rather than return because apparently that keeps
        some tools which check for memory leaks happier.  */
     exit (err ? EXIT_FAILURE : 0);
@@ -36,11 +36,8 @@
 static int checkout_file (char *file, char *temp);
 static char *make_tempfile (void);
 static void rename_rcsfile (char *temp, char *real);
-
-#ifndef MY_NDBM
 static void rename_dbmfile (char *temp);
 static void write_dbmfile (char *temp);
-#endif				/* !MY_NDBM */
 
 /* Structure which describes an administrative file.  */
 struct admin_file {
@@ -618,6 +615,41 @@ static const char *const config_contents[] = {
     "# For example:\n",
     "#\n",
     "#   UseArchiveCommentLeader=no\n",
+    "\n",
+    "# Set `DiffAlgorithm' to `histogram' to have CVS match lines up with the\n",
+    "# histogram algorithm when it stores deltas at checkin and for `cvs diff'.\n",
+    "# This copes much better with large files containing many repeated\n",
+    "# lines.  Defaults to `myers'.\n",
+    "#\n",
+    "# For example:\n",
+    "#\n",
+    "#   DiffAlgorithm=histogram\n",
+    "\n",
+    "# Set `DiffJobs' to have `cvs diff' and `cvs rdiff' run the diffs for up\n",
+    "# to that many files at once, in separate processes.  The output is the\n",
+    "# same as when the files are diffed one at a time.  Defaults to 1.\n",
+    "#\n",
+    "# For example:\n",
+    "#\n",
+    "#   DiffJobs=4\n",
+    "\n",
+    "# Set `AnnotateCache' to `yes' to have `cvs annotate' remember which\n",
+    "# revision each line of an annotated revision came from, in CVS/annotate\n",
+    "# in the repository, so that annotating it or a later revision again only\n",
+    "# needs to look at the newer deltas.  Defaults to `no'.\n",
+    "#\n",
+    "# For example:\n",
+    "#\n",
+    "#   AnnotateCache=yes\n",
+    "\n",
+    "# Set `DigestCache' to `yes' to have CVS remember a digest of each revision\n",
+    "# it checks out to see whether a file whose timestamp has changed really\n",
+    "# differs, in CVS/digest in the repository, so that the next time it only\n",
+    "# needs to read the file.  Defaults to `no'.\n",
+    "#\n",
+    "# For example:\n",
+    "#\n",
+    "#   DigestCache=yes\n",
     NULL
 };
 
@@ -705,9 +737,6 @@ mkmodules (char *dir)
     struct saved_cwd cwd;
     char *temp;
     char *cp, *last, *fname;
-#ifdef MY_NDBM
-    DBM *db;
-#endif
     FILE *fp;
     char *line = NULL;
     size_t line_allocated = 0;
@@ -730,14 +759,8 @@ mkmodules (char *dir)
     {
 
 	case 0:			/* everything ok */
-#ifdef MY_NDBM
-	    /* open it, to generate any duplicate errors */
-	    if ((db = dbm_open (temp, O_RDONLY, 0666)) != NULL)
-		dbm_close (db);
-#else
 	    write_dbmfile (temp);
 	    rename_dbmfile (temp);
-#endif
 	    rename_rcsfile (temp, CVSROOTADM_MODULES);
 	    break;
 
@@ -920,7 +943,57 @@ checkout_file (char *file, char *temp)
 
 
 
-#ifndef MY_NDBM
+#ifdef MY_NDBM
+
+/* Build the hashed index for the modules file TEMP.  This also reports any
+ * duplicate keys in it, in which case no index is built.
+ */
+static void
+write_dbmfile (char *temp)
+{
+    char *index;
+
+    index = Xasprintf ("%s%s", temp, MYDBM_INDEX_SUFFIX);
+    (void) mydbm_write_index (temp, index);
+    free (index);
+}
+
+
+
+/* Move the index built by write_dbmfile into place.  The index records the
+ * stamp of TEMP, so it is only used once TEMP has itself been renamed to
+ * the modules file, and any index left over from an older modules file is
+ * simply ignored until then.
+ *
+ * When write_dbmfile declined to build an index because TEMP had problems,
+ * remove the old index instead.
+ */
+static void
+rename_dbmfile (char *temp)
+{
+    char *newidx, *dotidx;
+
+    newidx = Xasprintf ("%s%s", temp, MYDBM_INDEX_SUFFIX);
+    dotidx = Xasprintf ("%s%s", CVSROOTADM_MODULES, MYDBM_INDEX_SUFFIX);
+
+    if (!isfile (newidx))
+    {
+	if (unlink_file (dotidx) < 0 && !existence_error (errno))
+	    error (0, errno, "cannot remove %s", dotidx);
+    }
+    else
+    {
+	if (chmod (newidx, 0444) < 0)
+	    error (0, errno, "warning: cannot chmod %s", newidx);
+	if (CVS_RENAME (newidx, dotidx) < 0)
+	    error (0, errno, "cannot rename %s to %s", newidx, dotidx);
+    }
+
+    free (dotidx);
+    free (newidx);
+}
+
+#else /* !MY_NDBM */
 
 static void
 write_dbmfile( char *temp )
@@ -18,12 +18,28 @@
  * at dbm_open time, and loads the entire file into memory.  As such, it is
  * probably only good for fairly small modules files.  Ours is about 30K in
  * size, and this code works fine.
+ *
+ * Files opened read-only are parsed at most once per process for as long as
+ * they remain unchanged on disk, so repeated lookups in val-tags or the
+ * modules file (common in a long-running server) only pay for a stat.
+ *
+ * For large files, mkmodules also writes a hashed index beside the text
+ * file (see mydbm_write_index).  When the index is current, read-only opens
+ * map it and look keys up directly instead of parsing the text at all.  The
+ * text file always remains authoritative: an index whose recorded stamp
+ * does not match the text file is ignored.
  */
 
 #ifdef HAVE_CONFIG_H
 # include <config.h>
 #endif
 
+#include <stdint.h>
+
+#ifdef HAVE_MMAP
+# include "mman.h"
+#endif
+
 #include "cvs.h"
 
 #ifdef MY_NDBM
@@ -31,7 +47,521 @@
 #   define O_ACCMODE (O_RDONLY | O_WRONLY | O_RDWR)
 # endif /* defined O_ACCMODE */
 
-static void mydbm_load_file (FILE *, List *, char *);
+static int mydbm_load_file (FILE *, List *, char *);
+
+
+
+/* A parsed database shared by every read-only DBM opened on the same file.
+ * The file identity and modification stamp recorded here decide whether the
+ * parsed copy may be reused by the next mydbm_open.
+ */
+struct mydbm_cache
+{
+    List *list;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+
+    /* Number of open DBMs pointing at LIST.  */
+    int refcount;
+
+    /* Set once this copy has been superseded in MYDBM_CACHE.  LIST is freed
+     * when the last DBM using it is closed.
+     */
+    bool stale;
+};
+
+/* Parsed read-only databases, keyed by file name.  */
+static List *mydbm_cache;
+
+
+
+static void
+mydbm_cache_release (struct mydbm_cache *cache)
+{
+    if (--cache->refcount > 0 || !cache->stale)
+	return;
+    dellist (&cache->list);
+    free (cache);
+}
+
+
+
+static void
+mydbm_cache_delproc (Node *p)
+{
+    struct mydbm_cache *cache = p->data;
+
+    cache->stale = true;
+    /* Drop the reference held by MYDBM_CACHE itself.  */
+    mydbm_cache_release (cache);
+}
+
+
+
+/* Forget any parsed copy of FILE, so that the next read-only open reloads
+ * it from disk.
+ */
+static void
+mydbm_cache_forget (const char *file)
+{
+    if (mydbm_cache)
+	delnode (findnode (mydbm_cache, file));
+}
+
+
+
+/* Return the shared parsed copy of the database FILE, which is open as FP,
+ * loading it first if it is not cached or has changed on disk.
+ *
+ * NOTES
+ *   A rewrite of the file that preserves its inode, size, and modification
+ *   second will go unnoticed by this process.  Writers to val-tags only ever
+ *   add keys and mkmodules replaces the modules database via a rename, so in
+ *   practice this does not happen.
+ */
+static struct mydbm_cache *
+mydbm_cache_get (FILE *fp, char *file)
+{
+    struct stat sb;
+    struct mydbm_cache *cache;
+    Node *p;
+
+    if (fstat (fileno (fp), &sb) < 0)
+	error (1, errno, "cannot fstat %s",
+	       primary_root_inverse_translate (file));
+
+    if (!mydbm_cache)
+	mydbm_cache = getlist ();
+
+    p = findnode (mydbm_cache, file);
+    if (p)
+    {
+	cache = p->data;
+	if (cache->dev == sb.st_dev && cache->ino == sb.st_ino
+	    && cache->size == sb.st_size && cache->mtime == sb.st_mtime)
+	{
+	    TRACE (TRACE_DATA, "mydbm_open: reusing parsed copy of `%s'",
+		   file);
+	    cache->refcount++;
+	    return cache;
+	}
+	delnode (p);
+    }
+
+    cache = xmalloc (sizeof *cache);
+    cache->list = getlist ();
+    cache->dev = sb.st_dev;
+    cache->ino = sb.st_ino;
+    cache->size = sb.st_size;
+    cache->mtime = sb.st_mtime;
+    /* One reference for the caller and one for MYDBM_CACHE.  */
+    cache->refcount = 2;
+    cache->stale = false;
+    mydbm_load_file (fp, cache->list, file);
+
+    p = getnode ();
+    p->type = NDBMNODE;
+    p->key = xstrdup (file);
+    p->data = cache;
+    p->delproc = mydbm_cache_delproc;
+    addnode (mydbm_cache, p);
+
+    return cache;
+}
+
+
+
+/* The hashed index format, as written by mydbm_write_index:
+ *
+ *   struct mydbm_index_header
+ *   uint32_t slots[NSLOTS]	Open-addressed hash table of record
+ *				offsets, 0 marking an empty slot.
+ *   records			In text file order, each a struct
+ *				mydbm_index_record followed by the key and
+ *				the value, each NUL-terminated, padded to a
+ *				multiple of four bytes.
+ *
+ * The index is written in native byte order and is only meant to be read by
+ * the host that wrote it.  Anything unexpected causes the index to be
+ * ignored in favor of the text file.
+ */
+#define MYDBM_INDEX_MAGIC	"CVSIDX1\n"
+#define MYDBM_INDEX_BYTEORDER	0x01020304
+
+struct mydbm_index_header
+{
+    char magic[8];
+    uint32_t byteorder;
+    /* Always a power of two.  */
+    uint32_t nslots;
+    /* Stamp of the text file this index was built from.  */
+    uint64_t text_ino;
+    uint64_t text_size;
+    int64_t text_mtime;
+};
+
+struct mydbm_index_record
+{
+    uint32_t hash;
+    uint32_t keylen;
+    uint32_t vallen;
+};
+
+#define MYDBM_INDEX_ALIGN(n)	(((n) + 3) & ~(size_t) 3)
+
+
+
+/* FNV-1a.  Unlike hashp() in hash.c, the result must not depend on the
+ * size of the table.
+ */
+static uint32_t
+mydbm_index_hash (const char *key, size_t len)
+{
+    uint32_t h = 2166136261U;
+
+    while (len-- > 0)
+    {
+	h ^= (unsigned char) *key++;
+	h *= 16777619U;
+    }
+    return h;
+}
+
+
+
+/* Return the record at offset OFF in DB's index, or NULL if it would run
+ * past the end of the index.
+ */
+static struct mydbm_index_record *
+mydbm_index_record (DBM *db, size_t off)
+{
+    struct mydbm_index_record *rec;
+
+    if (off < sizeof (struct mydbm_index_header)
+	|| off % 4 != 0
+	|| db->index_size - off < sizeof *rec)
+	return NULL;
+    rec = (struct mydbm_index_record *) (db->index + off);
+    if ((size_t) rec->keylen + rec->vallen + 2
+	> db->index_size - off - sizeof *rec)
+	return NULL;
+    return rec;
+}
+
+
+
+/* Offset of the first record in DB's index.  */
+static size_t
+mydbm_index_first (DBM *db)
+{
+    const struct mydbm_index_header *hdr =
+	(const struct mydbm_index_header *) db->index;
+
+    return sizeof *hdr + (size_t) hdr->nslots * sizeof (uint32_t);
+}
+
+
+
+/* Try to use the index of FILE, which is open as FP, for DB.
+ *
+ * RETURNS
+ *   true if a current index was found and DB now refers to it.
+ *   false otherwise, in which case the caller should parse the text file.
+ */
+static bool
+mydbm_index_open (DBM *db, FILE *fp, char *file)
+{
+    struct stat text_sb, sb;
+    const struct mydbm_index_header *hdr;
+    char *index;
+    int fd;
+    bool ok = false;
+
+    if (fstat (fileno (fp), &text_sb) < 0)
+	return false;
+
+    index = Xasprintf ("%s%s", file, MYDBM_INDEX_SUFFIX);
+    fd = CVS_OPEN (index, O_RDONLY | OPEN_BINARY);
+    if (fd < 0)
+    {
+	if (!existence_error (errno))
+	    error (0, errno, "warning: cannot open `%s'",
+		   primary_root_inverse_translate (index));
+	free (index);
+	return false;
+    }
+
+    if (fstat (fd, &sb) < 0 || sb.st_size < (off_t) sizeof *hdr)
+	goto done;
+
+    db->index_size = sb.st_size;
+    db->index_mapped = 0;
+#ifdef HAVE_MMAP
+    /* Map private and writable, like rcsbuf_open, since callers such as
+     * cat_module are known to scribble on fetched values.
+     */
+    db->index = mmap (NULL, db->index_size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE, fd, 0);
+    if (db->index && db->index != MAP_FAILED)
+	db->index_mapped = 1;
+    else
+#endif /* HAVE_MMAP */
+    {
+	size_t got = 0;
+
+	db->index = xmalloc (db->index_size);
+	while (got < db->index_size)
+	{
+	    ssize_t n = read (fd, db->index + got, db->index_size - got);
+	    if (n <= 0)
+		break;
+	    got += n;
+	}
+	if (got < db->index_size)
+	{
+	    free (db->index);
+	    db->index = NULL;
+	    goto done;
+	}
+    }
+
+    hdr = (const struct mydbm_index_header *) db->index;
+    if (memcmp (hdr->magic, MYDBM_INDEX_MAGIC, sizeof hdr->magic)
+	|| hdr->byteorder != MYDBM_INDEX_BYTEORDER
+	|| hdr->nslots == 0
+	|| (hdr->nslots & (hdr->nslots - 1)) != 0
+	|| hdr->nslots > (db->index_size - sizeof *hdr) / sizeof (uint32_t)
+	|| hdr->text_ino != (uint64_t) text_sb.st_ino
+	|| hdr->text_size != (uint64_t) text_sb.st_size
+	|| hdr->text_mtime != (int64_t) text_sb.st_mtime)
+    {
+	TRACE (TRACE_DATA, "mydbm_open: ignoring stale or invalid `%s'",
+	       index);
+#ifdef HAVE_MMAP
+	if (db->index_mapped)
+	    munmap (db->index, db->index_size);
+	else
+#endif /* HAVE_MMAP */
+	    free (db->index);
+	db->index = NULL;
+	goto done;
+    }
+
+    TRACE (TRACE_DATA, "mydbm_open: using index `%s'", index);
+    db->index_next = mydbm_index_first (db);
+    ok = true;
+
+done:
+    if (close (fd) < 0)
+	error (0, errno, "cannot close `%s'",
+	       primary_root_inverse_translate (index));
+    free (index);
+    return ok;
+}
+
+
+
+/* Look KEY up in DB's index.  */
+static datum
+mydbm_index_fetch (DBM *db, datum key)
+{
+    const struct mydbm_index_header *hdr =
+	(const struct mydbm_index_header *) db->index;
+    const uint32_t *slots = (const uint32_t *) (hdr + 1);
+    uint32_t hash = mydbm_index_hash (key.dptr, key.dsize);
+    uint32_t mask = hdr->nslots - 1;
+    uint32_t i, n;
+    datum val;
+
+    val.dptr = NULL;
+    val.dsize = 0;
+    for (i = hash & mask, n = 0; n < hdr->nslots; i = (i + 1) & mask, n++)
+    {
+	struct mydbm_index_record *rec;
+	char *rkey;
+
+	if (slots[i] == 0)
+	    break;
+	rec = mydbm_index_record (db, slots[i]);
+	if (!rec)
+	    break;
+	rkey = (char *) (rec + 1);
+	if (rec->hash == hash && rec->keylen == key.dsize
+	    && !memcmp (rkey, key.dptr, key.dsize))
+	{
+	    val.dptr = rkey + rec->keylen + 1;
+	    val.dsize = rec->vallen;
+	    break;
+	}
+    }
+    return val;
+}
+
+
+
+/* Return the key of the record at DB->INDEX_NEXT in DB's index and advance
+ * past it.
+ */
+static datum
+mydbm_index_nextkey (DBM *db)
+{
+    struct mydbm_index_record *rec;
+    datum key;
+
+    rec = mydbm_index_record (db, db->index_next);
+    if (rec)
+    {
+	key.dptr = (char *) (rec + 1);
+	key.dsize = rec->keylen;
+	db->index_next += MYDBM_INDEX_ALIGN (sizeof *rec + rec->keylen
+					     + rec->vallen + 2);
+    }
+    else
+    {
+	key.dptr = NULL;
+	key.dsize = 0;
+    }
+    return key;
+}
+
+
+
+/* Parse the database in FILE and write a hashed index of it to INDEX, for use
+ * by later read-only opens of FILE.  Problems parsing FILE, such as duplicate
+ * keys, are reported just as they would be by mydbm_open.
+ *
+ * The index is only a cache, so failures to build it are reported as
+ * warnings and leave no index behind, and later opens parse FILE instead.
+ *
+ * RETURNS
+ *   true if the index was written.
+ *   false if FILE had problems, in which case no index is written so that
+ *   every later open of FILE parses it and reports them again, or if the
+ *   index could not be written.
+ */
+bool
+mydbm_write_index (char *file, char *index)
+{
+    struct mydbm_index_header hdr;
+    struct stat sb;
+    List *list;
+    Node *head, *p;
+    FILE *fp;
+    uint32_t *slots;
+    uint32_t nslots, mask, off;
+    size_t count, size;
+    char *buf;
+    bool ok;
+
+    fp = CVS_FOPEN (file, FOPEN_BINARY_READ);
+    if (fp == NULL)
+    {
+	error (0, errno, "cannot open %s",
+	       primary_root_inverse_translate (file));
+	return false;
+    }
+    if (fstat (fileno (fp), &sb) < 0)
+    {
+	error (0, errno, "cannot fstat %s",
+	       primary_root_inverse_translate (file));
+	if (fclose (fp) < 0)
+	    error (0, errno, "cannot close %s",
+		   primary_root_inverse_translate (file));
+	return false;
+    }
+    list = getlist ();
+    if (mydbm_load_file (fp, list, file) > 0)
+    {
+	dellist (&list);
+	if (fclose (fp) < 0)
+	    error (0, errno, "cannot close %s",
+		   primary_root_inverse_translate (file));
+	return false;
+    }
+    if (fclose (fp) < 0)
+	error (0, errno, "cannot close %s",
+	       primary_root_inverse_translate (file));
+
+    /* Keep the table at most half full so that probe sequences stay
+     * short.
+     */
+    head = list->list;
+    count = 0;
+    size = 0;
+    for (p = head->next; p != head; p = p->next)
+    {
+	count++;
+	size += MYDBM_INDEX_ALIGN (sizeof (struct mydbm_index_record)
+				   + strlen (p->key) + strlen (p->data) + 2);
+    }
+    for (nslots = 8; nslots < 2 * count; nslots *= 2)
+	;
+    off = sizeof hdr + nslots * sizeof (uint32_t);
+    if (size > UINT32_MAX - off)
+    {
+	error (0, 0, "%s is too large to index",
+	       primary_root_inverse_translate (file));
+	dellist (&list);
+	return false;
+    }
+    size += off;
+
+    memset (&hdr, 0, sizeof hdr);
+    memcpy (hdr.magic, MYDBM_INDEX_MAGIC, sizeof hdr.magic);
+    hdr.byteorder = MYDBM_INDEX_BYTEORDER;
+    hdr.nslots = nslots;
+    hdr.text_ino = sb.st_ino;
+    hdr.text_size = sb.st_size;
+    hdr.text_mtime = sb.st_mtime;
+
+    buf = xzalloc (size);
+    memcpy (buf, &hdr, sizeof hdr);
+    slots = (uint32_t *) (buf + sizeof hdr);
+    mask = nslots - 1;
+    for (p = head->next; p != head; p = p->next)
+    {
+	struct mydbm_index_record *rec = (struct mydbm_index_record *) (buf + off);
+	uint32_t i;
+
+	rec->keylen = strlen (p->key);
+	rec->vallen = strlen (p->data);
+	rec->hash = mydbm_index_hash (p->key, rec->keylen);
+	memcpy (rec + 1, p->key, rec->keylen + 1);
+	memcpy ((char *) (rec + 1) + rec->keylen + 1, p->data, rec->vallen + 1);
+
+	for (i = rec->hash & mask; slots[i] != 0; i = (i + 1) & mask)
+	    ;
+	slots[i] = off;
+	off += MYDBM_INDEX_ALIGN (sizeof *rec + rec->keylen + rec->vallen + 2);
+    }
+    dellist (&list);
+
+    ok = false;
+    fp = CVS_FOPEN (index, FOPEN_BINARY_WRITE);
+    if (fp == NULL)
+	error (0, errno, "cannot write %s", index);
+    else
+    {
+	if (fwrite (buf, 1, size, fp) != size)
+	    error (0, errno, "cannot write %s", index);
+	else
+	    ok = true;
+	if (fclose (fp) < 0)
+	{
+	    error (0, errno, "cannot close %s", index);
+	    ok = false;
+	}
+	/* Don't leave a partial index behind.  */
+	if (!ok && unlink_file (index) < 0 && !existence_error (errno))
+	    error (0, errno, "cannot remove %s", index);
+    }
+    free (buf);
+    return ok;
+}
+
+
 
 /* Returns NULL on error in which case errno has been set to indicate
    the error.  Can also call error() itself.  */
@@ -48,17 +578,31 @@ mydbm_open (char *file, int flags, int mode)
 	return NULL;
 
     db = xmalloc (sizeof (*db));
-    db->dbm_list = getlist ();
+    db->dbm_list = NULL;
+    db->cache = NULL;
+    db->index = NULL;
+    db->index_mapped = 0;
     db->modified = 0;
     db->name = xstrdup (file);
 
-    if (fp != NULL)
+    if (fp != NULL && (flags & O_ACCMODE) == O_RDONLY
+	&& mydbm_index_open (db, fp, file))
+	/* Nothing more to do.  */;
+    else if (fp != NULL && (flags & O_ACCMODE) == O_RDONLY)
     {
-	mydbm_load_file (fp, db->dbm_list, file);
-	if (fclose (fp) < 0)
-	    error (0, errno, "cannot close %s",
-		   primary_root_inverse_translate (file));
+	db->cache = mydbm_cache_get (fp, file);
+	db->dbm_list = db->cache->list;
+    }
+    else
+    {
+	db->dbm_list = getlist ();
+	if (fp != NULL)
+	    mydbm_load_file (fp, db->dbm_list, file);
     }
+
+    if (fp != NULL && fclose (fp) < 0)
+	error (0, errno, "cannot close %s",
+	       primary_root_inverse_translate (file));
     return db;
 }
 
@@ -89,9 +633,20 @@ mydbm_close (DBM *db)
 	walklist (db->dbm_list, write_item, fp);
 	if (fclose (fp) < 0)
 	    error (0, errno, "cannot close %s", db->name);
+	mydbm_cache_forget (db->name);
     }
     free (db->name);
-    dellist (&db->dbm_list);
+#ifdef HAVE_MMAP
+    if (db->index_mapped)
+	munmap (db->index, db->index_size);
+    else
+#endif /* HAVE_MMAP */
+    if (db->index)
+	free (db->index);
+    else if (db->cache)
+	mydbm_cache_release (db->cache);
+    else
+	dellist (&db->dbm_list);
     free (db);
 }
 
@@ -104,6 +659,9 @@ mydbm_fetch (DBM *db, datum key)
     char *s;
     datum val;
 
+    if (db->index)
+	return mydbm_index_fetch (db, key);
+
     /* make sure it's null-terminated */
     s = xmalloc (key.dsize + 1);
     (void) strncpy (s, key.dptr, key.dsize);
@@ -132,6 +690,12 @@ mydbm_firstkey (DBM *db)
     Node *head, *p;
     datum key;
 
+    if (db->index)
+    {
+	db->index_next = mydbm_index_first (db);
+	return mydbm_index_nextkey (db);
+    }
+
     head = db->dbm_list->list;
     p = head->next;
     if (p != head)
@@ -156,6 +720,9 @@ mydbm_nextkey (DBM *db)
     Node *head, *p;
     datum key;
 
+    if (db->index)
+	return mydbm_index_nextkey (db);
+
     head = db->dbm_list->list;
     p = db->dbm_next;
     if (p != head)
@@ -183,6 +750,9 @@ mydbm_store (DBM *db, datum key, datum value, int flags)
 {
     Node *node;
 
+    /* Read-only databases share their list with other DBMs, or have none.  */
+    assert (!db->cache && !db->index);
+
     node = getnode ();
     node->type = NDBMNODE;
 
@@ -210,8 +780,11 @@ mydbm_store (DBM *db, datum key, datum value, int flags)
  *
  * INPUTS
  *   filename		Used in error messages.
+ *
+ * RETURNS
+ *   The number of lines which were ignored due to problems.
  */
-static void
+static int
 mydbm_load_file (FILE *fp, List *list, char *filename)
 {
     char *line = NULL;
@@ -222,6 +795,7 @@ mydbm_load_file (FILE *fp, List *list, char *filename)
     int cont;
     int line_length;
     int line_num;
+    int problems = 0;
 
     value_allocated = 1;
     value = xmalloc (value_allocated);
@@ -310,6 +884,7 @@ mydbm_load_file (FILE *fp, List *list, char *filename)
 			"warning: NULL value for key `%s' at line %d of `%s'",
 			p->key, line_num,
 			primary_root_inverse_translate (filename));
+		problems++;
 		freenode (p);
 		continue;
 	    }
@@ -321,6 +896,7 @@ mydbm_load_file (FILE *fp, List *list, char *filename)
 			"duplicate key found for `%s' at line %d of `%s'",
 			p->key, line_num,
 			primary_root_inverse_translate (filename));
+		problems++;
 		freenode (p);
 	    }
 	}
@@ -331,6 +907,7 @@ mydbm_load_file (FILE *fp, List *list, char *filename)
 
     free (line);
     free (value);
+    return problems;
 }
 
 #endif				/* MY_NDBM */
@@ -16,11 +16,26 @@
 
 #define	DBLKSIZ	4096
 
+struct mydbm_cache;
+
 typedef struct
 {
     List *dbm_list;			/* cached database */
     Node *dbm_next;			/* next key to return for nextkey() */
 
+    /* When the database was opened read-only, the process-wide parsed copy
+       that DBM_LIST points into.  NULL for private, writable copies.  */
+    struct mydbm_cache *cache;
+
+    /* When a current hashed index was found beside a read-only database,
+       its contents and size, and DBM_LIST is NULL.  */
+    char *index;
+    size_t index_size;
+    /* Nonzero if INDEX is mmap'd rather than malloc'd.  */
+    int index_mapped;
+    /* Offset of the next record to return for nextkey().  */
+    size_t index_next;
+
     /* Name of the file to write to if modified is set.  malloc'd.  */
     char *name;
 
@@ -56,4 +71,9 @@ datum mydbm_firstkey (DBM * db);
 datum mydbm_nextkey (DBM * db);
 extern int mydbm_store (DBM *, datum, datum, int);
 
+/* The suffix appended to a database file name to find its hashed index.  */
+#define MYDBM_INDEX_SUFFIX	".idx"
+
+bool mydbm_write_index (char *file, char *index);
+
 #endif				/* MY_NDBM */
@@ -708,6 +708,23 @@ parse_config (const char *cvsroot, const char *path)
 		}
 	    }
 	}
+	else if (STREQ (line, "DiffAlgorithm"))
+	{
+	    if (!strcasecmp (p, "histogram"))
+		retval->HistogramDiff = true;
+	    else if (!strcasecmp (p, "myers"))
+		retval->HistogramDiff = false;
+	    else
+		error (0, 0,
+"%s [%u]: unrecognized value `%s' for DiffAlgorithm.",
+		       infopath, ln, p);
+	}
+	else if (STREQ (line, "DiffJobs"))
+	    readSizeT (infopath, "DiffJobs", p, &retval->DiffJobs);
+	else if (STREQ (line, "AnnotateCache"))
+	    readBool (infopath, "AnnotateCache", p, &retval->AnnotateCache);
+	else if (STREQ (line, "DigestCache"))
+	    readBool (infopath, "DigestCache", p, &retval->DigestCache);
 	else if (STREQ (line, "FirstVerifyLogErrorFatal"))
 	    readBool (infopath, "FirstVerifyLogErrorFatal", p,
 		      &retval->FirstVerifyLogErrorFatal);
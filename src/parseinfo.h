@@ -59,6 +59,27 @@ struct config
     size_t MaxCommentLeaderLength;
     bool UseArchiveCommentLeader;
 
+    /* Should diffs and checkin deltas be generated with the histogram
+     * algorithm rather than Myers'?  DiffAlgorithm=myers|histogram
+     */
+    bool HistogramDiff;
+
+    /* How many files `cvs diff' and `cvs rdiff' may diff at once.
+     * DiffJobs=N
+     */
+    size_t DiffJobs;
+
+    /* Should `cvs annotate' keep the line origins it works out for each
+     * revision in the repository, for reuse?  AnnotateCache=yes|no
+     */
+    bool AnnotateCache;
+
+    /* Should RCS_cmp_file keep digests of the revisions it checks out in
+     * the repository, so that it can compare files against them instead?
+     * DigestCache=yes|no
+     */
+    bool DigestCache;
+
 #ifdef AUTH_SERVER_SUPPORT
     /* Should we check for system usernames/passwords?  */
     bool system_auth;
@@ -23,7 +23,9 @@
 #endif
 
 /* CVS headers.  */
+#include "difflib.h"
 #include "ignore.h"
+#include "parseinfo.h"
 #include "recurse.h"
 
 #include "cvs.h"
@@ -35,6 +37,8 @@ static Dtype patch_dirproc (void *callerdat, const char *dir,
                             const char *repos, const char *update_dir,
                             List *entries);
 static int patch_fileproc (void *callerdat, struct file_info *finfo);
+static int patch_job_run (void *data);
+static void patch_job_done (void *data, int err);
 static int patch_proc (int argc, char **argv, char *xwhere,
 		       char *mwhere, char *mfile, int shorten,
 		       int local_specified, char *mname, char *msg);
@@ -54,6 +58,30 @@ static char *tmpfile2 = NULL;
 static char *tmpfile3 = NULL;
 static int unidiff = 0;
 
+/* A diff which patch_fileproc has handed to a diff job (see diff_job_start),
+ * along with the temp files holding the two revisions.
+ */
+struct patch_job
+{
+    struct patch_job *next;
+    char *fullname;
+    char *rcs;
+    char *vers_tag;
+    char *vers_head;
+    char *tmpfile1;
+    char *tmpfile2;
+    char *tmpfile3;
+};
+
+/* The diff jobs not yet done, oldest first, so that patch_cleanup can find
+ * their temp files.
+ */
+static struct patch_job *patch_jobs = NULL;
+static struct patch_job *patch_jobs_tail = NULL;
+
+/* The errors reported by the diff jobs.  */
+static int patch_errors = 0;
+
 static const char *const patch_usage[] =
 {
     "Usage: %s %s [-flR] [-c|-u] [-s|-t] [-k kopt]\n",
@@ -344,9 +372,13 @@ patch_proc (int argc, char **argv, char *xwhere, char *mwhere, char *mfile,
     }
 
     /* start the recursion processor */
+    diff_jobs_begin (config->DiffJobs);
+    patch_errors = 0;
     err = start_recursion (patch_fileproc, NULL, patch_dirproc, NULL, NULL,
 			   argc - 1, argv + 1, local_specified,
 			   which, 0, CVS_LOCK_READ, where, 1, repository );
+    diff_jobs_end ();
+    err += patch_errors;
     free (repository);
     free (where);
 
@@ -369,26 +401,11 @@ patch_fileproc (void *callerdat, struct file_info *finfo)
     char *rcs_orig = NULL;
     RCSNode *rcsfile;
     FILE *fp1, *fp2, *fp3;
+    struct patch_job *job;
     int ret = 0;
     int isattic = 0;
     int retcode = 0;
-    char *file1;
-    char *file2;
-    char *strippath;
-    char *line1, *line2;
-    size_t line1_chars_allocated;
-    size_t line2_chars_allocated;
-    char *cp1, *cp2;
-    FILE *fp;
-    int line_length;
-    int dargc = 0;
-    size_t darg_allocated = 0;
-    char **dargv = NULL;
 
-    line1 = NULL;
-    line1_chars_allocated = 0;
-    line2 = NULL;
-    line2_chars_allocated = 0;
     vers_tag = vers_head = NULL;
 
     /* find the parsed rcs file */
@@ -481,6 +498,46 @@ patch_fileproc (void *callerdat, struct file_info *finfo)
 	goto out2;
     }
 
+    if (patch_short)
+    {
+	/* A short patch only needs to know whether the revisions differ,
+	 * which comparing them in memory tells us more cheaply than diff.
+	 */
+	char *text1, *text2;
+	size_t len1, len2;
+
+	if (RCS_checkout_buffer (rcsfile, vers_tag, rev1, options,
+				 &text1, &len1))
+	{
+	    error (0, 0,
+		   "cannot check out revision %s of %s", vers_tag, rcs);
+	    ret = 1;
+	    goto out2;
+	}
+	if (RCS_checkout_buffer (rcsfile, vers_head, rev2, options,
+				 &text2, &len2))
+	{
+	    error (0, 0,
+		   "cannot check out revision %s of %s", vers_head, rcs);
+	    free (text1);
+	    ret = 1;
+	    goto out2;
+	}
+	if (len1 != len2 || memcmp (text1, text2, len1))
+	{
+	    cvs_output ("File ", 0);
+	    cvs_output (finfo->fullname, 0);
+	    cvs_output (" changed from revision ", 0);
+	    cvs_output (vers_tag, 0);
+	    cvs_output (" to ", 0);
+	    cvs_output (vers_head, 0);
+	    cvs_output ("\n", 1);
+	}
+	free (text1);
+	free (text2);
+	goto out2;
+    }
+
     /* Create 3 empty files.  I'm not really sure there is any advantage
      * to doing so now rather than just waiting until later.
      *
@@ -562,10 +619,91 @@ patch_fileproc (void *callerdat, struct file_info *finfo)
 	    (void)utime (tmpfile2, &t);
     }
 
+    /* The diff job takes over the temp files and revisions from here.  */
+    job = xmalloc (sizeof *job);
+    job->next = NULL;
+    job->fullname = xstrdup (finfo->fullname);
+    job->rcs = rcs_orig;
+    job->vers_tag = vers_tag;
+    job->vers_head = vers_head;
+    job->tmpfile1 = tmpfile1;
+    job->tmpfile2 = tmpfile2;
+    job->tmpfile3 = tmpfile3;
+    rcs_orig = vers_tag = vers_head = NULL;
+    tmpfile1 = tmpfile2 = tmpfile3 = NULL;
+    if (patch_jobs_tail)
+	patch_jobs_tail->next = job;
+    else
+	patch_jobs = job;
+    patch_jobs_tail = job;
+    diff_job_start (patch_job_run, patch_job_done, job);
+
+  out:
+    if (tmpfile1 != NULL)
+    {
+	if (CVS_UNLINK (tmpfile1) < 0)
+	    error (0, errno, "cannot unlink %s", tmpfile1);
+	free (tmpfile1);
+	tmpfile1 = NULL;
+    }
+    if (tmpfile2 != NULL)
+    {
+	if (CVS_UNLINK (tmpfile2) < 0)
+	    error (0, errno, "cannot unlink %s", tmpfile2);
+	free (tmpfile2);
+	tmpfile2 = NULL;
+    }
+    if (tmpfile3 != NULL)
+    {
+	if (CVS_UNLINK (tmpfile3) < 0)
+	    error (0, errno, "cannot unlink %s", tmpfile3);
+	free (tmpfile3);
+	tmpfile3 = NULL;
+    }
+
+ out2:
+    if (vers_tag != NULL)
+	free (vers_tag);
+    if (vers_head != NULL)
+	free (vers_head);
+    if (rcs_orig)
+	free (rcs_orig);
+    return ret;
+}
+
+
+
+/* Diff the two revisions checked out for DATA, a struct patch_job, and
+ * output the patch.
+ *
+ * RETURNS
+ *   The number of errors, as for patch_fileproc.
+ */
+static int
+patch_job_run (void *data)
+{
+    struct patch_job *job = data;
+    char *rcs = job->rcs;
+    int ret = 0;
+    char *file1;
+    char *file2;
+    char *strippath;
+    char *line1 = NULL, *line2 = NULL;
+    size_t line1_chars_allocated = 0;
+    size_t line2_chars_allocated = 0;
+    char *cp1, *cp2;
+    FILE *fp;
+    int line_length;
+    int dargc = 0;
+    size_t darg_allocated = 0;
+    char **dargv = NULL;
+
     if (unidiff) run_add_arg_p (&dargc, &darg_allocated, &dargv, "-u");
     else run_add_arg_p (&dargc, &darg_allocated, &dargv, "-c");
-    switch (diff_exec (tmpfile1, tmpfile2, NULL, NULL, dargc, dargv,
-		       tmpfile3))
+    if (config->HistogramDiff)
+	run_add_arg_p (&dargc, &darg_allocated, &dargv, "--histogram");
+    switch (diff_exec (job->tmpfile1, job->tmpfile2, NULL, NULL, dargc, dargv,
+		       job->tmpfile3))
     {
 	case -1:			/* fork/wait failure */
 	    error (1, errno, "fork for diff failed on %s", rcs);
@@ -576,44 +714,29 @@ patch_fileproc (void *callerdat, struct file_info *finfo)
 	    /*
 	     * The two revisions are really different, so read the first two
 	     * lines of the diff output file, and munge them to include more
-	     * reasonable file names that "patch" will understand, unless the
-	     * user wanted a short patch.  In that case, just output the short
-	     * message.
+	     * reasonable file names that "patch" will understand.
 	     */
-	    if (patch_short)
-	    {
-		cvs_output ("File ", 0);
-		cvs_output (finfo->fullname, 0);
-		cvs_output (" changed from revision ", 0);
-		cvs_output (vers_tag, 0);
-		cvs_output (" to ", 0);
-		cvs_output (vers_head, 0);
-		cvs_output ("\n", 1);
-		ret = 0;
-		goto out;
-	    }
-
 	    /* Output an "Index:" line for patch to use */
 	    cvs_output ("Index: ", 0);
-	    cvs_output (finfo->fullname, 0);
+	    cvs_output (job->fullname, 0);
 	    cvs_output ("\n", 1);
 
 	    /* Now the munging. */
-	    fp = xfopen (tmpfile3, "r");
+	    fp = xfopen (job->tmpfile3, "r");
 	    if (getline (&line1, &line1_chars_allocated, fp) < 0 ||
 		getline (&line2, &line2_chars_allocated, fp) < 0)
 	    {
 		if (feof (fp))
 		    error (0, 0, "\
-failed to read diff file header %s for %s: end of file", tmpfile3, rcs);
+failed to read diff file header %s for %s: end of file", job->tmpfile3, rcs);
 		else
 		    error (0, errno,
 			   "failed to read diff file header %s for %s",
-			   tmpfile3, rcs);
+			   job->tmpfile3, rcs);
 		ret = 1;
 		if (fclose (fp) < 0)
-		    error (0, errno, "error closing %s", tmpfile3);
-		goto out;
+		    error (0, errno, "error closing %s", job->tmpfile3);
+		break;
 	    }
 	    if (!unidiff)
 	    {
@@ -625,8 +748,8 @@ failed to read diff file header %s for %s: end of file", tmpfile3, rcs);
 		    error (0, 0, "invalid diff header for %s", rcs);
 		    ret = 1;
 		    if (fclose (fp) < 0)
-			error (0, errno, "error closing %s", tmpfile3);
-		    goto out;
+			error (0, errno, "error closing %s", job->tmpfile3);
+		    break;
 		}
 	    }
 	    else
@@ -639,8 +762,8 @@ failed to read diff file header %s for %s: end of file", tmpfile3, rcs);
 		    error (0, 0, "invalid unidiff header for %s", rcs);
 		    ret = 1;
 		    if (fclose (fp) < 0)
-			error (0, errno, "error closing %s", tmpfile3);
-		    goto out;
+			error (0, errno, "error closing %s", job->tmpfile3);
+		    break;
 		}
 	    }
 	    assert (current_parsed_root != NULL);
@@ -651,13 +774,13 @@ failed to read diff file header %s for %s: end of file", tmpfile3, rcs);
 	    if (STRNEQ (rcs, strippath, strlen (strippath)))
 		rcs += strlen (strippath);
 	    free (strippath);
-	    if (vers_tag != NULL)
-		file1 = Xasprintf ("%s:%s", finfo->fullname, vers_tag);
+	    if (job->vers_tag != NULL)
+		file1 = Xasprintf ("%s:%s", job->fullname, job->vers_tag);
 	    else
 		file1 = xstrdup (DEVNULL);
 
-	    file2 = Xasprintf ("%s:%s", finfo->fullname,
-			       vers_head ? vers_head : "removed");
+	    file2 = Xasprintf ("%s:%s", job->fullname,
+			       job->vers_head ? job->vers_head : "removed");
 
 	    /* Note that the string "diff" is specified by POSIX (for -c)
 	       and is part of the diff output format, not the name of a
@@ -689,7 +812,7 @@ failed to read diff file header %s for %s: end of file", tmpfile3, rcs);
 		cvs_output ("--- ", 0);
 	    }
 
-	    cvs_output (finfo->fullname, 0);
+	    cvs_output (job->fullname, 0);
 	    cvs_output (cp2, 0);
 
 	    /* spew the rest of the diff out */
@@ -698,57 +821,59 @@ failed to read diff file header %s for %s: end of file", tmpfile3, rcs);
 		   >= 0)
 		cvs_output (line1, 0);
 	    if (line_length < 0 && !feof (fp))
-		error (0, errno, "cannot read %s", tmpfile3);
+		error (0, errno, "cannot read %s", job->tmpfile3);
 
 	    if (fclose (fp) < 0)
-		error (0, errno, "cannot close %s", tmpfile3);
+		error (0, errno, "cannot close %s", job->tmpfile3);
 	    free (file1);
 	    free (file2);
 	    break;
 	default:
-	    error (0, 0, "diff failed for %s", finfo->fullname);
+	    error (0, 0, "diff failed for %s", job->fullname);
     }
-  out:
+
     if (line1)
         free (line1);
     if (line2)
         free (line2);
-    if (tmpfile1 != NULL)
-    {
-	if (CVS_UNLINK (tmpfile1) < 0)
-	    error (0, errno, "cannot unlink %s", tmpfile1);
-	free (tmpfile1);
-	tmpfile1 = NULL;
-    }
-    if (tmpfile2 != NULL)
-    {
-	if (CVS_UNLINK (tmpfile2) < 0)
-	    error (0, errno, "cannot unlink %s", tmpfile2);
-	free (tmpfile2);
-	tmpfile2 = NULL;
-    }
-    if (tmpfile3 != NULL)
-    {
-	if (CVS_UNLINK (tmpfile3) < 0)
-	    error (0, errno, "cannot unlink %s", tmpfile3);
-	free (tmpfile3);
-	tmpfile3 = NULL;
-    }
+    run_arg_free_p (dargc, dargv);
+    free (dargv);
+    return ret;
+}
 
-    if (darg_allocated)
-    {
-	run_arg_free_p (dargc, dargv);
-	free (dargv);
-    }
 
- out2:
-    if (vers_tag != NULL)
-	free (vers_tag);
-    if (vers_head != NULL)
-	free (vers_head);
-    if (rcs_orig)
-	free (rcs_orig);
-    return ret;
+
+/* Remove the temp files of DATA, a struct patch_job, whose diff finished
+ * with ERR errors, and free it.
+ */
+static void
+patch_job_done (void *data, int err)
+{
+    struct patch_job *job = data;
+
+    /* Diff jobs finish in the order they were started.  */
+    assert (job == patch_jobs);
+    patch_jobs = job->next;
+    if (!patch_jobs)
+	patch_jobs_tail = NULL;
+
+    if (CVS_UNLINK (job->tmpfile1) < 0)
+	error (0, errno, "cannot unlink %s", job->tmpfile1);
+    if (CVS_UNLINK (job->tmpfile2) < 0)
+	error (0, errno, "cannot unlink %s", job->tmpfile2);
+    if (CVS_UNLINK (job->tmpfile3) < 0)
+	error (0, errno, "cannot unlink %s", job->tmpfile3);
+    free (job->tmpfile1);
+    free (job->tmpfile2);
+    free (job->tmpfile3);
+    free (job->fullname);
+    free (job->rcs);
+    if (job->vers_tag != NULL)
+	free (job->vers_tag);
+    if (job->vers_head != NULL)
+	free (job->vers_head);
+    free (job);
+    patch_errors += err;
 }
 
 
@@ -774,6 +899,8 @@ patch_dirproc (void *callerdat, const char *dir, const char *repos,
 static RETSIGTYPE
 patch_cleanup (int sig)
 {
+    struct patch_job *job;
+
     /* Note that the checks for existence_error are because we are
        called from a signal handler, without SIG_begincrsect, so
        we don't know whether the files got created.  */
@@ -801,6 +928,20 @@ patch_cleanup (int sig)
     }
     tmpfile1 = tmpfile2 = tmpfile3 = NULL;
 
+    /* The temp files of any diff jobs not yet done.  */
+    for (job = patch_jobs; job; job = job->next)
+    {
+	if (unlink_file (job->tmpfile1) < 0
+	    && !existence_error (errno))
+	    error (0, errno, "cannot remove %s", job->tmpfile1);
+	if (unlink_file (job->tmpfile2) < 0
+	    && !existence_error (errno))
+	    error (0, errno, "cannot remove %s", job->tmpfile2);
+	if (unlink_file (job->tmpfile3) < 0
+	    && !existence_error (errno))
+	    error (0, errno, "cannot remove %s", job->tmpfile3);
+    }
+
     if (sig != 0)
     {
 	const char *name;
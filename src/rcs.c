@@ -27,6 +27,7 @@
 
 /* GNULIB */
 #include "base64.h"
+#include "md5.h"
 #include "quote.h"
 
 /* CVS */
@@ -111,7 +112,6 @@ static void rcsbuf_get_buffered (struct rcsbuffer *, char **datap,
 static void rcsbuf_cache (RCSNode *, struct rcsbuffer *);
 static void rcsbuf_cache_close (void);
 static void rcsbuf_cache_open (RCSNode *, off_t, FILE **, struct rcsbuffer *);
-static int checkmagic_proc (Node *p, void *closure);
 static void do_branches (List * list, char *val);
 static void do_symbols (List * list, char *val);
 static void do_locks (List * list, char *val);
@@ -128,6 +128,7 @@ static void expand_keywords (RCSNode *, RCSVers *, const char *,
                              const char *, size_t, enum kflag, char *,
                              size_t, char **, size_t *);
 static void cmp_file_buffer (void *, const char *, size_t);
+static void checkout_buffer (void *, const char *, size_t);
 
 /* Routines for reading, parsing and writing RCS files. */
 static RCSVers *getdelta (struct rcsbuffer *, char *, char **, char **);
@@ -150,6 +151,10 @@ static void rcs_internal_unlockfile (FILE *, char *);
 static char *rcs_lockfilename (const char *);
 static int findnextmagicrev (RCSNode *rcs, char *rev, int default_rv);
 static int findnextmagicrev_proc (Node *p, void *closure);
+static void symbols_byrev_free (RCSNode *rcs);
+static size_t symbols_byrev_search (RCSNode *rcs, const char *rev, size_t len);
+static bool symbols_byrev_exists (RCSNode *rcs, const char *rev, size_t len);
+static bool rev_has_tags (RCSNode *rcs, const char *rev);
 static char * getfullCVSname (char *, char **);
 
 
@@ -608,7 +613,8 @@ RCS_reparsercsfile (RCSNode *rdata, FILE **pfp, struct rcsbuffer *rcsbufp)
 	    rdata->other = getlist ();
 	kv = getnode ();
         kv->type = rcsbuf_get_node_type (&rcsbuf);
-	kv->key = xstrdup (key);
+	kv->key = list_strdup (rdata->other, key);
+	kv->flags = NODE_KEY_POOLED;
 	kv->data = rcsbuf_valcopy (&rcsbuf, value, kv->type != RCSCMPFLD,
 				   &kv->len);
 	if (addnode (rdata->other, kv) != 0)
@@ -756,23 +762,19 @@ RCS_setattic (RCSNode *rcs, int toattic)
 
 
 /*
- * Fully parse the RCS file.  Store all keyword/value pairs, fetch the
- * log messages for each revision, and fetch add and delete counts for
- * each revision (we could fetch the entire text for each revision,
- * but the only caller, log_fileproc, doesn't need that information,
- * so we don't waste the memory required to store it).  The add and
- * delete counts are stored on the OTHER field of the RCSVERSNODE
- * structure, under the names ";add" and ";delete", so that we don't
- * waste the memory space of extra fields in RCSVERSNODE for code
- * which doesn't need this information.
+ * Read the delta texts of RCS from RCSBUF, which must be positioned at
+ * the first one, to the end of the file.  Store all keyword/value pairs,
+ * the log message and the add and delete counts of each revision on the
+ * OTHER field of its RCSVERSNODE, as described for RCS_fully_parse.  If
+ * PROC is not NULL, call it with each revision as soon as its delta text
+ * has been read, so that callers can use the revisions while the rest of
+ * the file is still unread.
  */
-void
-RCS_fully_parse (RCSNode *rcs)
+static void
+rcs_read_deltatexts (RCSNode *rcs, struct rcsbuffer *rcsbufp,
+		     RCSDELTATEXTPROC proc, void *closure)
 {
-    FILE *fp;
-    struct rcsbuffer rcsbuf;
-
-    RCS_reparsercsfile (rcs, &fp, &rcsbuf);
+    struct rcsbuffer rcsbuf = *rcsbufp;
 
     while (1)
     {
@@ -803,7 +805,8 @@ RCS_fully_parse (RCSNode *rcs)
 		    vnode->other = getlist ();
 		kv = getnode ();
 		kv->type = rcsbuf_get_node_type (&rcsbuf);
-		kv->key = xstrdup (key);
+		kv->key = list_strdup (vnode->other, key);
+		kv->flags = NODE_KEY_POOLED;
 		kv->data = rcsbuf_valcopy (&rcsbuf, value,
 					   kv->type != RCSCMPFLD, NULL);
 		if (addnode (vnode->other, kv) != 0)
@@ -912,8 +915,59 @@ warning: duplicate key `%s' in version `%s' of RCS file `%s'",
                next revision.  */
 	    break;
 	}
+
+	if (proc != NULL)
+	    proc (rcs, vnode, closure);
     }
 
+    *rcsbufp = rcsbuf;
+}
+
+
+
+/*
+ * Fully parse the RCS file.  Store all keyword/value pairs, fetch the
+ * log messages for each revision, and fetch add and delete counts for
+ * each revision (we could fetch the entire text for each revision,
+ * but the only caller, log_fileproc, doesn't need that information,
+ * so we don't waste the memory required to store it).  The add and
+ * delete counts are stored on the OTHER field of the RCSVERSNODE
+ * structure, under the names ";add" and ";delete", so that we don't
+ * waste the memory space of extra fields in RCSVERSNODE for code
+ * which doesn't need this information.
+ */
+void
+RCS_fully_parse (RCSNode *rcs)
+{
+    FILE *fp;
+    struct rcsbuffer rcsbuf;
+
+    RCS_reparsercsfile (rcs, &fp, &rcsbuf);
+    rcs_read_deltatexts (rcs, &rcsbuf, NULL, NULL);
+    rcsbuf_cache (rcs, &rcsbuf);
+}
+
+
+
+/*
+ * Like RCS_fully_parse, but read the delta texts in a single sequential
+ * pass and call PROC with each revision, in the order the delta texts
+ * appear in the file, as soon as its log message and change counts are
+ * known.  PROC may free the OTHER list of any revision it is done with,
+ * which lets a caller like log_fileproc write its output as it reads the
+ * file instead of holding every log message of the file in memory.
+ */
+void
+RCS_walk_deltatexts (RCSNode *rcs, RCSDELTATEXTPROC proc, void *closure)
+{
+    FILE *fp;
+    struct rcsbuffer rcsbuf;
+
+    if (rcs->flags & PARTIAL)
+	RCS_reparsercsfile (rcs, NULL, NULL);
+
+    rcsbuf_cache_open (rcs, rcs->delta_pos, &fp, &rcsbuf);
+    rcs_read_deltatexts (rcs, &rcsbuf, proc, closure);
     rcsbuf_cache (rcs, &rcsbuf);
 }
 
@@ -957,6 +1011,7 @@ static void
 free_rcsnode_contents (RCSNode *rnode)
 {
     dellist (&rnode->versions);
+    symbols_byrev_free (rnode);
     if (rnode->symbols != NULL)
 	dellist (&rnode->symbols);
     if (rnode->symbols_data != NULL)
@@ -2087,11 +2142,14 @@ do_symbols (List *list, char *val)
 	if (*cp != '\0')
 	    *cp++ = '\0';
 
-	/* make a new node and add it to the list */
+	/* make a new node and add it to the list, pointing straight into
+	   VAL, which the list has adopted */
 	p = getnode ();
-	p->key = xstrdup (tag);
-	p->data = xstrdup (rev);
-	(void) addnode (list, p);
+	p->key = tag;
+	p->data = rev;
+	p->flags = NODE_KEY_POOLED | NODE_DATA_POOLED;
+	if (addnode (list, p) != 0)
+	    freenode (p);
     }
 }
 
@@ -2131,11 +2189,13 @@ do_locks (List *list, char *val)
 	if (*cp != '\0')
 	    *cp++ = '\0';
 
-	/* make a new node and add it to the list */
+	/* make a new node and add it to the list, as in do_symbols */
 	p = getnode ();
-	p->key = xstrdup (rev);
-	p->data = xstrdup (user);
-	(void) addnode (list, p);
+	p->key = rev;
+	p->data = user;
+	p->flags = NODE_KEY_POOLED | NODE_DATA_POOLED;
+	if (addnode (list, p) != 0)
+	    freenode (p);
     }
 }
 
@@ -2494,7 +2554,6 @@ RCS_gettag (RCSNode *rcs, const char *symtag, int force_tag_match,
  *
  * Note: We assume that REV is an RCS revision and not a branch number.
  */
-static char *check_rev;
 char *
 RCS_magicrev (RCSNode *rcs, char *rev)
 {
@@ -2502,7 +2561,6 @@ RCS_magicrev (RCSNode *rcs, char *rev)
     char *xrev, *test_branch, *local_branch_num;
 
     xrev = xmalloc (strlen (rev) + 14); /* enough for .0.number */
-    check_rev = xrev;
 
     local_branch_num = getenv ("CVS_LOCAL_BRANCH_NUM");
     if (local_branch_num)
@@ -2538,8 +2596,8 @@ RCS_magicrev (RCSNode *rcs, char *rev)
 	/* now, create a "magic" revision */
 	(void) sprintf (xrev, "%s.%d.%d", rev, RCS_MAGIC_BRANCH, rev_num);
 
-	/* walk the symbols list to see if a magic one already exists */
-	if (walklist (RCS_symbols(rcs), checkmagic_proc, NULL) != 0)
+	/* see if a magic one already exists */
+	if (symbols_byrev_exists (rcs, xrev, strlen (xrev) + 1))
 	    continue;
 
 	/* we found a free magic branch.  Claim it as ours */
@@ -2549,21 +2607,6 @@ RCS_magicrev (RCSNode *rcs, char *rev)
 
 
 
-/*
- * walklist proc to look for a match in the symbols list.
- * Returns 0 if the symbol does not match, 1 if it does.
- */
-static int
-checkmagic_proc (Node *p, void *closure)
-{
-    if (STREQ (check_rev, p->data))
-	return 1;
-    else
-	return 0;
-}
-
-
-
 /*
  * Given an RCSNode, returns non-zero if the specified revision number 
  * or symbolic tag resolves to a "branch" within the rcs file.
@@ -3237,8 +3280,8 @@ RCS_getlocks (RCSNode *rcs)
 
     if (rcs->locks_data) {
 	rcs->locks = getlist ();
+	list_adopt (rcs->locks, rcs->locks_data);
 	do_locks (rcs->locks, rcs->locks_data);
-	free(rcs->locks_data);
 	rcs->locks_data = NULL;
     }
 
@@ -3256,9 +3299,16 @@ RCS_symbols(RCSNode *rcs)
 	RCS_reparsercsfile (rcs, NULL, NULL);
 
     if (rcs->symbols_data) {
-	rcs->symbols = getlist ();
+	size_t count = 0;
+	const char *cp;
+
+	/* Size the table for one symbol per `:' so that files with many
+	   tags don't rehash repeatedly while it is built.  */
+	for (cp = strchr (rcs->symbols_data, ':'); cp; cp = strchr (cp + 1, ':'))
+	    count++;
+	rcs->symbols = getlist_sized (count);
+	list_adopt (rcs->symbols, rcs->symbols_data);
 	do_symbols (rcs->symbols, rcs->symbols_data);
-	free(rcs->symbols_data);
 	rcs->symbols_data = NULL;
     }
 
@@ -3531,13 +3581,37 @@ struct rcs_keyword
     bool expandit;
 };
 
+/* The size of the keyword hash table.  The hash function below gives each
+   of the standard keywords its own slot; a LocalKeyword may need to probe
+   for one.  */
+#define KEYWORD_HASH_SIZE 32
+#define KEYWORD_HASH(s, len) \
+	(((len) + 4 * (unsigned char) (s)[0] \
+	  + (unsigned char) (s)[(len) - 1]) % KEYWORD_HASH_SIZE)
+
+/* What config->keywords points to: the table of keywords, terminated by an
+   entry with a NULL STRING, and an index of those to expand which is built
+   by next_keyword the first time it is needed.  */
+struct rcs_keywords
+{
+    /* This must come first, since the table is passed around as an array
+       of struct rcs_keyword.  */
+    struct rcs_keyword list[KEYWORD_LOCALID + 2];
+    /* Whether START and HASH describe LIST.  */
+    bool indexed;
+    /* Which characters start a keyword to expand.  */
+    bool start[UCHAR_MAX + 1];
+    const struct rcs_keyword *hash[KEYWORD_HASH_SIZE];
+};
+
 
 
 static inline struct rcs_keyword *
 new_keywords (void)
 {
     struct rcs_keyword *new;
-    new = xcalloc (KEYWORD_LOCALID + 2, sizeof (struct rcs_keyword));
+    new = ((struct rcs_keywords *) xcalloc (1, sizeof (struct rcs_keywords)))
+	  ->list;
 
 #define KEYWORD_INIT(k, i, s) \
 	k[i].string = s; \
@@ -3667,6 +3741,49 @@ escape_keyword_value (const char *value, int *free_value)
 
 
 
+/* Build the index of the keywords to expand in KEYWORDS.  */
+static void
+index_keywords (struct rcs_keywords *keywords)
+{
+    const struct rcs_keyword *keyword;
+
+    memset (keywords->start, 0, sizeof keywords->start);
+    memset (keywords->hash, 0, sizeof keywords->hash);
+    for (keyword = keywords->list; keyword->string; keyword++)
+    {
+	size_t h;
+
+	if (!keyword->expandit || keyword->len == 0)
+	    continue;
+	keywords->start[(unsigned char) keyword->string[0]] = true;
+	h = KEYWORD_HASH (keyword->string, keyword->len);
+	while (keywords->hash[h])
+	    h = (h + 1) % KEYWORD_HASH_SIZE;
+	keywords->hash[h] = keyword;
+    }
+    keywords->indexed = true;
+}
+
+
+
+/* Return the keyword to expand which is spelled as the LEN characters at S,
+   or NULL if there is none.  */
+static inline const struct rcs_keyword *
+find_keyword (const struct rcs_keywords *keywords, const char *s, size_t len)
+{
+    const struct rcs_keyword *keyword;
+    size_t h;
+
+    for (h = KEYWORD_HASH (s, len);
+	 (keyword = keywords->hash[h]);
+	 h = (h + 1) % KEYWORD_HASH_SIZE)
+	if (keyword->len == len && !memcmp (keyword->string, s, len))
+	    return keyword;
+    return NULL;
+}
+
+
+
 /* Search for keywords in the *LEN bytes starting at *START.  Return the
  * struct rcs_keyword describing the keyword found, or NULL when none is found.
  * On return, *START will point to the first character after the `$'
@@ -3681,10 +3798,13 @@ next_keyword (char **start, size_t *len, char **end)
 {
     char *srch, *srch_next, *s = NULL;
     size_t srch_len;
-    const struct rcs_keyword *keywords, *keyword = NULL;
+    struct rcs_keywords *keywords;
+    const struct rcs_keyword *keyword = NULL;
 
     if (!config->keywords) config->keywords = new_keywords ();
     keywords = config->keywords;
+    if (!keywords->indexed)
+	index_keywords (keywords);
 
     srch = *start;
     srch_len = *len;
@@ -3697,6 +3817,10 @@ next_keyword (char **start, size_t *len, char **end)
 	srch_len -= (srch_next + 1) - srch;
 	srch = srch_next + 1;
 
+	/* Most `$'s are not followed by the start of a keyword at all.  */
+	if (srch_len == 0 || !keywords->start[(unsigned char) *srch])
+	    continue;
+
 	/* Look for the first non alphabetic character after the '$'.  */
 	send = srch + srch_len;
 	for (s = srch; s < send; s++)
@@ -3710,16 +3834,8 @@ next_keyword (char **start, size_t *len, char **end)
 
 	/* See if this is one of the keywords.  */
 	slen = s - srch;
-	for (keyword = keywords; keyword->string; keyword++)
-	{
-	    if (keyword->expandit
-		&& keyword->len == slen
-		&& STRNEQ (keyword->string, srch, slen))
-	    {
-		break;
-	    }
-	}
-	if (!keyword->string)
+	keyword = find_keyword (keywords, srch, slen);
+	if (!keyword)
 	    continue;
 
 	/* If the keyword ends with a ':', then the old value consists
@@ -3743,7 +3859,7 @@ next_keyword (char **start, size_t *len, char **end)
 	    break;
     }
 
-    if (keyword && keyword->string)
+    if (keyword)
     {
 	*start = srch;
 	*end = s;
@@ -3778,15 +3894,16 @@ expand_keywords (RCSNode *rcs, RCSVers *ver, const char *name, const char *log,
 		 size_t loglen, enum kflag expand, char *buf, size_t len,
 		 char **retbuf, size_t *retlen)
 {
-    struct expand_buffer
-    {
-	struct expand_buffer *next;
-	char *data;
-	size_t len;
-	int free_data;
-    } *ebufs = NULL;
-    struct expand_buffer *ebuf_last = NULL;
-    size_t ebuf_len = 0;
+    /* Once an expansion changes the size of the text, the output is built
+       up in RET, and COPIED points to the first character of BUF which has
+       not been copied there yet.  */
+    char *ret = NULL;
+    size_t ret_size = 0;
+    size_t ret_len = 0;
+    char *copied = buf;
+    /* Each expansion is built up in SUB.  */
+    char *sub = NULL;
+    size_t sub_size = 0;
     char *locker;
     char *srch, *s;
     size_t srch_len;
@@ -3819,7 +3936,6 @@ expand_keywords (RCSNode *rcs, RCSVers *ver, const char *name, const char *log,
     {
 	char *value;
 	int free_value;
-	char *sub;
 	size_t sublen;
 	
 	/* At this point we must replace the string from SRCH to S
@@ -3912,7 +4028,8 @@ expand_keywords (RCSNode *rcs, RCSVers *ver, const char *name, const char *log,
 	    }
 	}
 
-	sub = xmalloc (keyword->len
+	expand_string (&sub, &sub_size,
+		       keyword->len
 		       + (value == NULL ? 0 : strlen (value))
 		       + 10);
 	if (expand == KFLAG_V)
@@ -4009,8 +4126,6 @@ expand_keywords (RCSNode *rcs, RCSVers *ver, const char *name, const char *log,
 		{
 		    error (0, 0,
 "Skipping `$" "Log$' keyword due to excessive comment leader.");
-		    free (sub);
-		    sub = NULL;
 		    continue;
 		}
 	    }
@@ -4045,8 +4160,8 @@ expand_keywords (RCSNode *rcs, RCSVers *ver, const char *name, const char *log,
 		++cnl;
 
 	    date = printable_date (ver->date);
-	    sub = xrealloc (sub,
-			    (sublen
+	    expand_string (&sub, &sub_size,
+			   (sublen
 			     + sizeof "Revision"
 			     + strlen (ver->version)
 			     + strlen (date)
@@ -4117,56 +4232,20 @@ expand_keywords (RCSNode *rcs, RCSVers *ver, const char *name, const char *log,
 	   from SRCH to S.  SUBLEN is the length of SUB.  */
 
 	if (srch + sublen == s)
-	{
 	    memcpy (srch, sub, sublen);
-	    free (sub);
-	}
 	else
 	{
-	    struct expand_buffer *ebuf;
-
-	    /* We need to change the size of the buffer.  We build a
-               list of expand_buffer structures.  Each expand_buffer
-               structure represents a portion of the final output.  We
-               concatenate them back into a single buffer when we are
-               done.  This minimizes the number of potentially large
-               buffer copies we must do.  */
-
-	    if (ebufs == NULL)
-	    {
-		ebufs = xmalloc (sizeof *ebuf);
-		ebufs->next = NULL;
-		ebufs->data = buf;
-		ebufs->free_data = 0;
-		ebuf_len = srch - buf;
-		ebufs->len = ebuf_len;
-		ebuf_last = ebufs;
-	    }
-	    else
-	    {
-		assert (srch >= ebuf_last->data);
-		assert (srch <= ebuf_last->data + ebuf_last->len);
-		ebuf_len -= ebuf_last->len - (srch - ebuf_last->data);
-		ebuf_last->len = srch - ebuf_last->data;
-	    }
-
-	    ebuf = xmalloc (sizeof *ebuf);
-	    ebuf->data = sub;
-	    ebuf->len = sublen;
-	    ebuf->free_data = 1;
-	    ebuf->next = NULL;
-	    ebuf_last->next = ebuf;
-	    ebuf_last = ebuf;
-	    ebuf_len += sublen;
-
-	    ebuf = xmalloc (sizeof *ebuf);
-	    ebuf->data = s;
-	    ebuf->len = srch_len - (s - srch);
-	    ebuf->free_data = 0;
-	    ebuf->next = NULL;
-	    ebuf_last->next = ebuf;
-	    ebuf_last = ebuf;
-	    ebuf_len += srch_len - (s - srch);
+	    /* We need to change the size of the text, so copy it to RET
+	       up to the keyword, followed by the expansion.  The first
+	       time, make room for the whole of the text.  */
+	    expand_string (&ret, &ret_size,
+			   xsum3 (ret_len, srch - copied, sublen)
+			   + (ret == NULL ? len - (s - buf) : 0));
+	    memcpy (ret + ret_len, copied, srch - copied);
+	    ret_len += srch - copied;
+	    memcpy (ret + ret_len, sub, sublen);
+	    ret_len += sublen;
+	    copied = s;
 	}
 
 	srch_len -= (s - srch);
@@ -4175,31 +4254,20 @@ expand_keywords (RCSNode *rcs, RCSVers *ver, const char *name, const char *log,
 
     if (locker != NULL)
 	free (locker);
+    if (sub != NULL)
+	free (sub);
 
-    if (ebufs == NULL)
+    if (ret == NULL)
     {
 	*retbuf = buf;
 	*retlen = len;
     }
     else
     {
-	char *ret;
-
-	ret = xmalloc (ebuf_len);
+	expand_string (&ret, &ret_size, ret_len + (buf + len - copied));
+	memcpy (ret + ret_len, copied, buf + len - copied);
 	*retbuf = ret;
-	*retlen = ebuf_len;
-	while (ebufs != NULL)
-	{
-	    struct expand_buffer *next;
-
-	    memcpy (ret, ebufs->data, ebufs->len);
-	    ret += ebufs->len;
-	    if (ebufs->free_data)
-		free (ebufs->data);
-	    next = ebufs->next;
-	    free (ebufs);
-	    ebufs = next;
-	}
+	*retlen = ret_len + (buf + len - copied);
     }
 }
 
@@ -4802,6 +4870,63 @@ workfile);
 
 
 
+/* This structure is passed between RCS_checkout_buffer and
+   checkout_buffer.  */
+struct checkout_buffer_data
+{
+    char *text;
+    size_t size;
+    size_t len;
+};
+
+
+
+/* An RCS_checkout callback which appends the revision text to the
+   checkout_buffer_data CALLERDAT.  */
+static void
+checkout_buffer (void *callerdat, const char *text, size_t len)
+{
+    struct checkout_buffer_data *data = callerdat;
+
+    expand_string (&data->text, &data->size, data->len + len);
+    memcpy (data->text + data->len, text, len);
+    data->len += len;
+}
+
+
+
+/* Check out revision REV of RCS into memory, for callers which would
+ * otherwise check it out to a temp file only to read it back.  REV,
+ * NAMETAG, and OPTIONS are as for RCS_checkout.
+ *
+ * OUTPUTS
+ *   text	A newly malloc'd buffer holding the revision, which is never
+ *		NULL, even for an empty revision.
+ *   len	The length of the revision.
+ *
+ * RETURNS
+ *   As RCS_checkout.
+ */
+int
+RCS_checkout_buffer (RCSNode *rcs, const char *rev, const char *nametag,
+		     const char *options, char **text, size_t *len)
+{
+    struct checkout_buffer_data data;
+    int status;
+
+    data.text = NULL;
+    data.size = data.len = 0;
+    status = RCS_checkout (rcs, NULL, rev, nametag, options, RUN_TTY,
+			   checkout_buffer, &data);
+    if (data.text == NULL)
+	data.text = xstrdup ("");
+    *text = data.text;
+    *len = data.len;
+    return status;
+}
+
+
+
 static const char *
 iRCS_get_openpgp_signatures (RCSNode *rcs, const char *rev, size_t *len)
 {
@@ -5386,7 +5511,8 @@ RCS_checkin (RCSNode *rcs, const char *update_dir, const char *workfile_in,
     RCSVers *delta, *commitpt;
     Deltatext *dtext;
     Node *nodep;
-    char *tmpfile, *changefile;
+    char *prevtext, *worktext, *changetext;
+    size_t prevlen, worklen, changelen;
     int dargc = 0;
     size_t darg_allocated = 0;
     char **dargv = NULL;
@@ -5830,124 +5956,95 @@ workfile);
        Else, DELTA's change text should be a diff between LEAFNODE and
        the working file. */
 
-    tmpfile = cvs_temp_name();
-    status = RCS_checkout (rcs, NULL, commitpt->version, NULL,
-			   ((rcs->expand != NULL
-			     && STREQ (rcs->expand, "b"))
-			    ? "-kb"
-			    : "-ko"),
-			   tmpfile,
-			   NULL, NULL);
+    /* Check out COMMITPT into memory, to diff against the working file.  */
+#ifdef PRESERVE_PERMISSIONS_SUPPORT
+    /* Special files are diffed as if they were empty, as by diff_exec.  */
+    if (preserve_perms
+	&& (findnode (commitpt->other_delta, "symlink") != NULL
+	    || findnode (commitpt->other_delta, "special") != NULL))
+    {
+	prevtext = xstrdup ("");
+	prevlen = 0;
+	status = 0;
+    }
+    else
+#endif
+    status = RCS_checkout_buffer (rcs, commitpt->version, NULL,
+				  ((rcs->expand != NULL
+				    && STREQ (rcs->expand, "b"))
+				   ? "-kb"
+				   : "-ko"),
+				  &prevtext, &prevlen);
     if (status != 0)
 	error (1, 0,
 	       "could not check out revision %s of `%s'",
 	       commitpt->version, rcs->print_path);
 
-    bufsize = 0;
-    changefile = cvs_temp_name();
-
     /* Diff options should include --binary if the RCS file has -kb set
        in its `expand' field. */
     run_add_arg_p (&dargc, &darg_allocated, &dargv, "-a");
     run_add_arg_p (&dargc, &darg_allocated, &dargv, "-n");
     if (rcs->expand != NULL && STREQ (rcs->expand, "b"))
 	run_add_arg_p (&dargc, &darg_allocated, &dargv, "--binary");
+    if (config->HistogramDiff)
+	run_add_arg_p (&dargc, &darg_allocated, &dargv, "--histogram");
+
+    worktext = NULL;
+    worklen = 0;
+    bufsize = 0;
+#ifdef PRESERVE_PERMISSIONS_SUPPORT
+    if (preserve_perms && !S_ISREG (sb.st_mode))
+	/* Pretend file is empty.  */
+	;
+    else
+#endif
+    get_file (workfile, workfile,
+	      rcs->expand != NULL && STREQ (rcs->expand, "b") ? "rb" : "r",
+	      &worktext, &bufsize, &worklen);
 
     if (STREQ (commitpt->version, rcs->head) &&
 	numdots (delta->version) == 1)
     {
 	/* If this revision is being inserted on the trunk, the change text
-	   for the new delta should be the contents of the working file ... */
-	bufsize = 0;
-#ifdef PRESERVE_PERMISSIONS_SUPPORT
-	if (preserve_perms && !S_ISREG (sb.st_mode))
-	    /* Pretend file is empty.  */
-	    ;
-	else
-#endif
-	get_file (workfile, workfile,
-		  rcs->expand != NULL && STREQ (rcs->expand, "b") ? "rb" : "r",
-		  &dtext->text, &bufsize, &dtext->len);
-
-	/* ... and the change text for the old delta should be a diff. */
+	   for the new delta should be the contents of the working file,
+	   and the change text for the old delta should be a diff.  */
+	if (diff_exec_buffers (worktext ? worktext : "", worklen,
+			       prevtext, prevlen,
+			       dargc, dargv, &changetext, &changelen) > 1)
+	    /* FIXME-update-dir: message does not include update_dir.  */
+	    error (1, 0, "error diffing %s", workfile);
+	dtext->text = worktext;
+	dtext->len = worklen;
+	worktext = NULL;
+
+	/* If CHANGETEXT is NULL, there are no differences between
+	   revisions.  In that event, we want to force RCS_rewrite to write
+	   an empty string for COMMITPT's change text.  Leaving the change
+	   text field set NULL won't work, since that means "preserve the
+	   original change text for this delta." */
 	commitpt->text = xmalloc (sizeof (Deltatext));
 	memset (commitpt->text, 0, sizeof (Deltatext));
-
-	bufsize = 0;
-	switch (diff_exec (workfile, tmpfile, NULL, NULL,
-			   dargc, dargv, changefile))
-	{
-	    case 0:
-	    case 1:
-		break;
-	    case -1:
-		/* FIXME-update-dir: message does not include update_dir.  */
-		error (1, errno, "error diffing %s", workfile);
-		break;
-	    default:
-		/* FIXME-update-dir: message does not include update_dir.  */
-		error (1, 0, "error diffing %s", workfile);
-		break;
-	}
-
-	/* OK, the text file case here is really dumb.  Logically
-	   speaking we want diff to read the files in text mode,
-	   convert them to the canonical form found in RCS files
-	   (which, we hope at least, is independent of OS--always
-	   bare linefeeds), and then work with change texts in that
-	   format.  However, diff_exec both generates change
-	   texts and produces output for user purposes (e.g. patch.c),
-	   and there is no way to distinguish between the two cases.
-	   So we actually implement the text file case by writing the
-	   change text as a text file, then reading it as a text file.
-	   This should cause no harm, but doesn't strike me as
-	   immensely clean.  */
-	get_file (changefile, changefile, "r",
-		  &commitpt->text->text, &bufsize, &commitpt->text->len);
-
-	/* If COMMITPT->TEXT->TEXT is NULL, it means that CHANGEFILE
-	   was empty and that there are no differences between revisions.
-	   In that event, we want to force RCS_rewrite to write an empty
-	   string for COMMITPT's change text.  Leaving the change text
-	   field set NULL won't work, since that means "preserve the original
-	   change text for this delta." */
-	if (commitpt->text->text == NULL)
-	{
-	    commitpt->text->text = xstrdup ("");
-	    commitpt->text->len = 0;
-	}
+	commitpt->text->text = changetext ? changetext : xstrdup ("");
+	commitpt->text->len = changelen;
     }
     else
     {
 	/* This file is not being inserted at the head, but on a side
 	   branch somewhere.  Make a diff from the previous revision
 	   to the working file. */
-	switch (diff_exec (tmpfile, workfile, NULL, NULL,
-			   dargc, dargv, changefile))
-	{
-	    case 0:
-	    case 1:
-		break;
-	    case -1:
-		/* FIXME-update-dir: message does not include update_dir.  */
-		error (1, errno, "error diffing %s", workfile);
-		break;
-	    default:
-		/* FIXME-update-dir: message does not include update_dir.  */
-		error (1, 0, "error diffing %s", workfile);
-		break;
-	}
-	/* See the comment above, at the other get_file invocation,
-	   regarding binary vs. text.  */
-	get_file (changefile, changefile, "r",
-		  &dtext->text, &bufsize, &dtext->len);
-	if (dtext->text == NULL)
-	{
-	    dtext->text = xstrdup ("");
-	    dtext->len = 0;
-	}
+	if (diff_exec_buffers (prevtext, prevlen,
+			       worktext ? worktext : "", worklen,
+			       dargc, dargv, &changetext, &changelen) > 1)
+	    /* FIXME-update-dir: message does not include update_dir.  */
+	    error (1, 0, "error diffing %s", workfile);
+	dtext->text = changetext ? changetext : xstrdup ("");
+	dtext->len = changelen;
     }
 
+    if (worktext != NULL)
+	free (worktext);
+    free (prevtext);
+
     run_arg_free_p (dargc, dargv);
     free (dargv);
 
@@ -6002,12 +6099,6 @@ workfile);
 	    /* FIXME-update-dir: message does not include update_dir.  */
 	    error (1, errno, "cannot remove %s", workfile);
     }
-    if (unlink_file (tmpfile) < 0)
-	error (0, errno, "cannot remove %s", tmpfile);
-    free (tmpfile);
-    if (unlink_file (changefile) < 0)
-	error (0, errno, "cannot remove %s", changefile);
-    free (changefile);
 
  checkin_done:
     free (workfile);
@@ -6033,58 +6124,483 @@ workfile);
 
 
 
-/* This structure is passed between RCS_cmp_file and cmp_file_buffer.  */
-struct cmp_file_data
+/* How much of a file RCS_cmp_file reads at once.  */
+#define CMP_BUF_SIZE (8 * 1024)
+
+
+
+/* Return the name of the file which holds the cache in DIR for RCS, in
+ * newly allocated storage.  DIR is relative to the directory containing
+ * the archive.
+ */
+static char *
+rcs_cache_path (RCSNode *rcs, const char *dir)
 {
-    const char *filename;
-    FILE *fp;
-    int different;
-};
+    const char *base = last_component (rcs->path);
 
-/* Compare the contents of revision REV1 of RCS file RCS with the
-   contents of REV2 if given, otherwise, compare with the contents of
-   the file FILENAME.  OPTIONS is a string for the keyword
-   expansion options.  Return 0 if the contents of the revision are
-   the same as the contents of the file, 1 if they are different.  */
-int
-RCS_cmp_file (RCSNode *rcs, const char *arg_rev1, const char *rev1,
-	      char **rev1_cache, const char *rev2, const char *options,
-	      const char *filename)
+    return Xasprintf ("%.*s%s/%s", (int)(base - rcs->path), rcs->path,
+		      dir, base);
+}
+
+
+
+/* Open a temporary file to write a new version of the cache file PATH to,
+ * creating the cache directory if need be.  Failing to is not worth
+ * bothering the user about.
+ *
+ * OUTPUTS
+ *   tmp	The name of the temporary file, in newly allocated storage.
+ *
+ * RETURNS
+ *   The open file, or NULL if the cache is not to be written.
+ */
+static FILE *
+rcs_cache_create (const char *path, char **tmp)
 {
-    int binary;
+    FILE *fp;
+    mode_t omask;
 
-    TRACE (TRACE_FUNCTION, "RCS_cmp_file( %s, %s, %s, %s, %s )",
-           rcs->path ? rcs->path : "(null)",
-	   rev1 ? rev1 : "(null)", rev2 ? rev2 : "(null)",
-	   options ? options : "(null)", filename ? filename : "(null)");
+    if (noexec || readonlyfs)
+	return NULL;
 
-    if (options != NULL && options[0] != '\0')
-	binary = STREQ (options, "-kb");
-    else
+    *tmp = Xasprintf ("%s.%ld", path, (long) getpid ());
+
+    omask = umask (cvsumask);
+    fp = CVS_FOPEN (*tmp, FOPEN_BINARY_WRITE);
+    if (fp == NULL && existence_error (errno))
     {
-	char *expand;
+	char *dir = xstrdup (*tmp);
 
-	expand = RCS_getexpand (rcs);
-	if (expand != NULL && STREQ (expand, "b"))
-	    binary = 1;
-	else
-	    binary = 0;
+	*(char *) last_component (dir) = '\0';
+	if (cvs_mkdirs (dir, 0777, NULL, MD_REPO | MD_QUIET | MD_EXIST_OK))
+	    fp = CVS_FOPEN (*tmp, FOPEN_BINARY_WRITE);
+	free (dir);
+    }
+    (void) umask (omask);
+    if (fp == NULL)
+    {
+	TRACE (TRACE_DATA, "rcs_cache_create: cannot write %s", *tmp);
+	free (*tmp);
     }
+    return fp;
+}
 
-#ifdef PRESERVE_PERMISSIONS_SUPPORT
-    /* If CVS is to deal properly with special files (when
-       PreservePermissions is on), the best way is to check out the
-       revision to a temporary file and call `xcmp' on the two disk
-       files.  xcmp needs to handle non-regular files properly anyway,
-       so calling it simplifies RCS_cmp_file.  We *could* just yank
-       the delta node out of the version tree and look for device
-       numbers, but writing to disk and calling xcmp is a better
-       abstraction (therefore probably more robust). -twp */
 
-    if (preserve_perms)
-    {
-	char *tmp;
-	int retcode;
+
+/* Close FP, which was opened by rcs_cache_create to write the cache file
+ * PATH to as TMP, and move it into place.  TMP is freed.
+ */
+static void
+rcs_cache_finish (FILE *fp, char *tmp, const char *path)
+{
+    bool ok;
+
+    ok = !ferror (fp);
+    if (fclose (fp) < 0)
+	ok = false;
+    if (!ok || CVS_RENAME (tmp, path) < 0)
+    {
+	TRACE (TRACE_DATA, "rcs_cache_finish: cannot write %s", path);
+	if (CVS_UNLINK (tmp) < 0 && !existence_error (errno))
+	    error (0, errno, "cannot remove %s", tmp);
+    }
+    free (tmp);
+}
+
+
+
+/* The digest cache.
+ *
+ * When the DigestCache config option is set, RCS_cmp_file remembers the
+ * length and MD5 digest of the text of each revision it checks out to
+ * compare with a file, with keywords expanded, in a file named after the
+ * archive in CVSREP_DIGEST.  The first line of the file gives the size,
+ * modification time and inode of the archive the entries were made from,
+ * and each of the others a digest of everything the expansion depends on,
+ * followed by the length and digest of the text:
+ *
+ *	2041 1178020800 131075
+ *	0cc175b9c0f1b6a831c399e269772661 1534 92eb5ffee6ae2fec3ad71c777531578f
+ *
+ * Any change to the archive, such as a new log message for a revision,
+ * means none of the entries are used.
+ */
+
+/* The most entries kept for one archive.  */
+#define DIGEST_CACHE_MAX 16
+
+/* The length of a digest written out in hex.  */
+#define DIGEST_HEX_LEN 32
+
+
+
+static void
+digest_to_hex (const unsigned char *digest, char *hex)
+{
+    int i;
+
+    for (i = 0; i < DIGEST_HEX_LEN / 2; i++)
+	sprintf (hex + 2 * i, "%02x", digest[i]);
+}
+
+
+
+/* Return the first line of a digest cache file for RCS as it is now, in
+ * newly allocated storage, or NULL if the archive cannot be looked at.
+ */
+static char *
+digest_cache_stamp (RCSNode *rcs)
+{
+    struct stat sb;
+
+    if (stat (rcs->path, &sb) < 0)
+	return NULL;
+    return Xasprintf ("%lu %ld %lu", (unsigned long) sb.st_size,
+		      (long) sb.st_mtime, (unsigned long) sb.st_ino);
+}
+
+
+
+/* Add the keyword table from CVSROOT/config to CONTEXT.  */
+static void
+digest_keywords (struct md5_ctx *context)
+{
+    const struct rcs_keyword *keyword;
+    char *buf;
+
+    if (!config->keywords) config->keywords = new_keywords ();
+
+    for (keyword = config->keywords; keyword->string; keyword++)
+    {
+	buf = Xasprintf ("%s %d %d\n", keyword->string, keyword->expandit,
+			 keyword->expandto);
+	md5_process_bytes (buf, strlen (buf), context);
+	free (buf);
+    }
+}
+
+
+
+/* Set KEY to the digest of everything the text of revision VERS of RCS
+ * depends on when it is checked out with OPTIONS, besides the archive.
+ */
+static void
+digest_cache_key (RCSNode *rcs, RCSVers *vers, const char *options,
+		  char *key)
+{
+    struct md5_ctx context;
+    unsigned char digest[DIGEST_HEX_LEN / 2];
+    Node *lock;
+    char *buf;
+
+    lock = findnode (RCS_getlocks (rcs), vers->version);
+    buf = Xasprintf ("%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%lu %d\n",
+		     vers->version, vers->date,
+		     vers->author ? vers->author : "",
+		     vers->state ? vers->state : "",
+		     options ? options : "",
+		     rcs->expand ? rcs->expand : "",
+		     rcs->print_path,
+		     current_parsed_root->directory
+		     ? current_parsed_root->directory : "",
+		     lock ? (char *) lock->data : "",
+		     rcs->comment ? rcs->comment : "",
+		     (unsigned long) config->MaxCommentLeaderLength,
+		     config->UseArchiveCommentLeader);
+    md5_init_ctx (&context);
+    md5_process_bytes (buf, strlen (buf), &context);
+    free (buf);
+    digest_keywords (&context);
+    md5_finish_ctx (&context, digest);
+    digest_to_hex (digest, key);
+    key[DIGEST_HEX_LEN] = '\0';
+}
+
+
+
+/* Return a digest, written out in hex, which names the text of revision REV
+ * of RCS as checked out with TAG and OPTIONS.  It covers where the archive
+ * is, when it was last changed and how large it is, as stat reports them,
+ * and everything else the expansion depends on, so looking it up costs no
+ * more than a stat.  CVS rewrites an archive by renaming a new file over
+ * it, which gives it a new inode, so a name made from an older archive is
+ * never returned again.
+ *
+ * RETURNS
+ *   The digest, in newly allocated storage, or NULL if the archive could
+ *   not be looked at.
+ */
+char *
+RCS_checkout_key (RCSNode *rcs, const char *rev, const char *tag,
+		  const char *options)
+{
+    struct md5_ctx context;
+    unsigned char digest[DIGEST_HEX_LEN / 2];
+    struct stat sb;
+    char *buf, *key;
+
+    if (stat (rcs->path, &sb) < 0)
+	return NULL;
+
+    buf = Xasprintf ("%s\n%" PRIuMAX " %" PRIuMAX " %" PRIuMAX " %ld %ld\n"
+		     "%s\n%s\n%s\n%s\n%s\n%lu %d\n",
+		     rcs->path, (uintmax_t) sb.st_dev, (uintmax_t) sb.st_ino,
+		     (uintmax_t) sb.st_size, (long) sb.st_mtime,
+		     (long) sb.st_ctime,
+		     rev, tag ? tag : "", options ? options : "",
+		     rcs->print_path,
+		     current_parsed_root->directory
+		     ? current_parsed_root->directory : "",
+		     (unsigned long) config->MaxCommentLeaderLength,
+		     config->UseArchiveCommentLeader);
+    md5_init_ctx (&context);
+    md5_process_bytes (buf, strlen (buf), &context);
+    free (buf);
+    digest_keywords (&context);
+    md5_finish_ctx (&context, digest);
+
+    key = xmalloc (DIGEST_HEX_LEN + 1);
+    digest_to_hex (digest, key);
+    key[DIGEST_HEX_LEN] = '\0';
+    return key;
+}
+
+
+
+/* Read the digest cache for RCS, if it was made from the archive described
+ * by STAMP, calling FN with each entry and CLOSURE until it returns false.
+ */
+static void
+digest_cache_read (RCSNode *rcs, const char *stamp,
+		   bool (*fn) (char *, void *), void *closure)
+{
+    char *path = rcs_cache_path (rcs, CVSREP_DIGEST);
+    char *line = NULL;
+    size_t linesize = 0;
+    ssize_t n;
+    FILE *fp;
+
+    fp = CVS_FOPEN (path, FOPEN_BINARY_READ);
+    if (fp == NULL)
+    {
+	if (!existence_error (errno))
+	    error (0, errno, "cannot open %s", path);
+	free (path);
+	return;
+    }
+
+    n = getline (&line, &linesize, fp);
+    if (n > 0 && line[n - 1] == '\n')
+	line[--n] = '\0';
+    if (n > 0 && STREQ (line, stamp))
+	while ((n = getline (&line, &linesize, fp)) > 0)
+	{
+	    if (line[n - 1] == '\n')
+		line[--n] = '\0';
+	    if (!fn (line, closure))
+		break;
+	}
+    if (ferror (fp))
+	error (0, errno, "cannot read %s", path);
+    if (fclose (fp) < 0)
+	error (0, errno, "cannot close %s", path);
+
+    if (line)
+	free (line);
+    free (path);
+}
+
+
+
+struct digest_cache_find_data
+{
+    const char *key;
+    bool found;
+    size_t len;
+    char digest[DIGEST_HEX_LEN + 1];
+};
+
+/* Look for DATA->key in the digest cache entry LINE.  */
+static bool
+digest_cache_find_proc (char *line, void *closure)
+{
+    struct digest_cache_find_data *data = closure;
+    unsigned long len;
+    char *cp;
+
+    if (strncmp (line, data->key, DIGEST_HEX_LEN)
+	|| line[DIGEST_HEX_LEN] != ' ')
+	return true;
+
+    len = strtoul (line + DIGEST_HEX_LEN + 1, &cp, 10);
+    if (*cp++ != ' ' || strlen (cp) != DIGEST_HEX_LEN)
+	return false;
+    data->found = true;
+    data->len = len;
+    strcpy (data->digest, cp);
+    return false;
+}
+
+
+
+struct digest_cache_copy_data
+{
+    FILE *fp;
+    const char *key;
+    int entries;
+};
+
+/* Copy the digest cache entry LINE to DATA->fp, unless it is the one for
+ * DATA->key or there is no room left.
+ */
+static bool
+digest_cache_copy_proc (char *line, void *closure)
+{
+    struct digest_cache_copy_data *data = closure;
+
+    if (data->entries >= DIGEST_CACHE_MAX)
+	return false;
+    if (strncmp (line, data->key, DIGEST_HEX_LEN))
+    {
+	fprintf (data->fp, "%s\n", line);
+	data->entries++;
+    }
+    return true;
+}
+
+
+
+/* Write an entry for KEY, whose text is LEN bytes long with digest DIGEST,
+ * to the digest cache for RCS, which is in the state described by STAMP,
+ * followed by the other entries which are still valid.
+ */
+static void
+digest_cache_write (RCSNode *rcs, const char *stamp, const char *key,
+		    size_t len, const char *digest)
+{
+    struct digest_cache_copy_data data;
+    char *path, *tmp;
+    FILE *fp;
+
+    path = rcs_cache_path (rcs, CVSREP_DIGEST);
+    fp = rcs_cache_create (path, &tmp);
+    if (fp == NULL)
+    {
+	free (path);
+	return;
+    }
+
+    fprintf (fp, "%s\n%s %lu %s\n", stamp, key, (unsigned long) len, digest);
+    data.fp = fp;
+    data.key = key;
+    data.entries = 1;
+    digest_cache_read (rcs, stamp, digest_cache_copy_proc, &data);
+
+    rcs_cache_finish (fp, tmp, path);
+    free (path);
+}
+
+
+
+/* Compare FILENAME with text of length LEN whose digest is DIGEST.
+ *
+ * RETURNS
+ *   0 if they are the same, 1 if they differ.
+ */
+static int
+digest_cmp_file (const char *filename, int binary, size_t len,
+		 const char *digest)
+{
+    struct md5_ctx context;
+    unsigned char sum[DIGEST_HEX_LEN / 2];
+    char hex[DIGEST_HEX_LEN + 1];
+    char *buf;
+    size_t n, total;
+    FILE *fp;
+
+    fp = CVS_FOPEN (filename, binary ? FOPEN_BINARY_READ : "r");
+    if (fp == NULL)
+	/* FIXME-update-dir: should include update_dir in message.  */
+	error (1, errno, "cannot open file %s for comparing", filename);
+
+    buf = xmalloc (CMP_BUF_SIZE);
+    md5_init_ctx (&context);
+    total = 0;
+    while ((n = fread (buf, 1, CMP_BUF_SIZE, fp)) > 0 && total + n <= len)
+    {
+	md5_process_bytes (buf, n, &context);
+	total += n;
+    }
+    if (ferror (fp))
+	error (1, errno, "cannot read file %s for comparing", filename);
+    fclose (fp);
+    free (buf);
+
+    if (n > 0 || total != len)
+	return 1;
+    md5_finish_ctx (&context, sum);
+    digest_to_hex (sum, hex);
+    return !STREQ (hex, digest);
+}
+
+
+
+/* This structure is passed between RCS_cmp_file and cmp_file_buffer.  */
+struct cmp_file_data
+{
+    const char *filename;
+    FILE *fp;
+    int different;
+    /* The digest and length of the text so far, if it is to be cached.  */
+    bool digest;
+    struct md5_ctx context;
+    size_t len;
+};
+
+/* Compare the contents of revision REV1 of RCS file RCS with the
+   contents of REV2 if given, otherwise, compare with the contents of
+   the file FILENAME.  OPTIONS is a string for the keyword
+   expansion options.  Return 0 if the contents of the revision are
+   the same as the contents of the file, 1 if they are different.  */
+int
+RCS_cmp_file (RCSNode *rcs, const char *arg_rev1, const char *rev1,
+	      char **rev1_cache, const char *rev2, const char *options,
+	      const char *filename)
+{
+    int binary;
+
+    TRACE (TRACE_FUNCTION, "RCS_cmp_file( %s, %s, %s, %s, %s )",
+           rcs->path ? rcs->path : "(null)",
+	   rev1 ? rev1 : "(null)", rev2 ? rev2 : "(null)",
+	   options ? options : "(null)", filename ? filename : "(null)");
+
+    if (options != NULL && options[0] != '\0')
+	binary = STREQ (options, "-kb");
+    else
+    {
+	char *expand;
+
+	expand = RCS_getexpand (rcs);
+	if (expand != NULL && STREQ (expand, "b"))
+	    binary = 1;
+	else
+	    binary = 0;
+    }
+
+#ifdef PRESERVE_PERMISSIONS_SUPPORT
+    /* If CVS is to deal properly with special files (when
+       PreservePermissions is on), the best way is to check out the
+       revision to a temporary file and call `xcmp' on the two disk
+       files.  xcmp needs to handle non-regular files properly anyway,
+       so calling it simplifies RCS_cmp_file.  We *could* just yank
+       the delta node out of the version tree and look for device
+       numbers, but writing to disk and calling xcmp is a better
+       abstraction (therefore probably more robust). -twp */
+
+    if (preserve_perms)
+    {
+	char *tmp;
+	int retcode;
 
 	tmp = cvs_temp_name();
 	retcode = RCS_checkout(rcs, NULL, rev, NULL, options, tmp, NULL, NULL);
@@ -6104,6 +6620,29 @@ RCS_cmp_file (RCSNode *rcs, const char *arg_rev1, const char *rev1,
 	struct cmp_file_data data;
 	const char *use_file1;
 	char *tmpfile = NULL;
+	char *stamp = NULL;
+	char key[DIGEST_HEX_LEN + 1];
+	Node *vn;
+
+	/* If we have compared a file with this revision before, we may
+	   only need to read the file.  */
+	if (rev2 == NULL && config && config->DigestCache && rev1 != NULL
+	    && (vn = findnode (rcs->versions, rev1)) != NULL
+	    && (stamp = digest_cache_stamp (rcs)) != NULL)
+	{
+	    struct digest_cache_find_data find;
+
+	    digest_cache_key (rcs, vn->data, options, key);
+	    find.key = key;
+	    find.found = false;
+	    digest_cache_read (rcs, stamp, digest_cache_find_proc, &find);
+	    if (find.found)
+	    {
+		free (stamp);
+		return digest_cmp_file (filename, binary, find.len,
+					find.digest);
+	    }
+	}
 
 	if (rev2 != NULL)
 	{
@@ -6131,6 +6670,12 @@ RCS_cmp_file (RCSNode *rcs, const char *arg_rev1, const char *rev1,
         data.filename = use_file1;
         data.fp = fp;
         data.different = 0;
+	data.digest = stamp != NULL;
+	if (data.digest)
+	{
+	    md5_init_ctx (&data.context);
+	    data.len = 0;
+	}
 	
         if (RCS_checkout (rcs, NULL, rev2 ? rev2 : rev1, NULL, options,
                           RUN_TTY, cmp_file_buffer, &data ))
@@ -6147,6 +6692,16 @@ RCS_cmp_file (RCSNode *rcs, const char *arg_rev1, const char *rev1,
         }
 	
         fclose (fp);
+	if (data.digest)
+	{
+	    unsigned char sum[DIGEST_HEX_LEN / 2];
+	    char digest[DIGEST_HEX_LEN + 1];
+
+	    md5_finish_ctx (&data.context, sum);
+	    digest_to_hex (sum, digest);
+	    digest_cache_write (rcs, stamp, key, data.len, digest);
+	    free (stamp);
+	}
 	if (rev1_cache == NULL && tmpfile)
 	{
 	    if (CVS_UNLINK (tmpfile ) < 0)
@@ -6162,14 +6717,18 @@ RCS_cmp_file (RCSNode *rcs, const char *arg_rev1, const char *rev1,
 
 /* This is a subroutine of RCS_cmp_file.  It is passed to
    RCS_checkout.  */
-#define CMP_BUF_SIZE (8 * 1024)
-
 static void
 cmp_file_buffer (void *callerdat, const char *buffer, size_t len)
 {
     struct cmp_file_data *data = callerdat;
     char *filebuf;
 
+    if (data->digest)
+    {
+	md5_process_bytes (buffer, len, &data->context);
+	data->len += len;
+    }
+
     /* If we've already found a difference, we don't need to check
        further.  */
     if (data->different)
@@ -6249,10 +6808,14 @@ RCS_settag (RCSNode *rcs, const char *tag, const char *rev)
 	symbols = getlist ();
 	rcs->symbols = symbols;
     }
+    symbols_byrev_free (rcs);
     node = findnode (symbols, tag);
     if (node != NULL)
     {
-	free (node->data);
+	if (node->flags & NODE_DATA_POOLED)
+	    node->flags &= ~NODE_DATA_POOLED;
+	else
+	    free (node->data);
 	node->data = xstrdup (rev);
     }
     else
@@ -6287,6 +6850,7 @@ RCS_deltag (RCSNode *rcs, const char *tag)
     if (node == NULL)
 	return 1;
 
+    symbols_byrev_free (rcs);
     delnode (node);
 
     return 0;
@@ -6616,33 +7180,112 @@ RCS_getaccess (RCSNode *rcs)
 
 
 
-/* Return a nonzero value if the revision specified by ARG is found.  */
+/* qsort comparison function for symbols_byrev_search.  */
 static int
-findtag (Node *node, void *arg)
+symbols_byrev_cmp (const void *p, const void *q)
 {
-    char *rev = arg;
+    const Node *a = *(const Node *const *) p;
+    const Node *b = *(const Node *const *) q;
+    return strcmp (a->data, b->data);
+}
 
-    if (STREQ (node->data, rev))
-	return 1;
-    else
-	return 0;
+
+
+/* Discard RCS->symbols_byrev, for when RCS->symbols changes.  */
+static void
+symbols_byrev_free (RCSNode *rcs)
+{
+    if (rcs->symbols_byrev != NULL)
+    {
+	free (rcs->symbols_byrev);
+	rcs->symbols_byrev = NULL;
+	rcs->nsymbols_byrev = 0;
+    }
 }
 
 
 
-/* Return a nonzero value if a magic tag rooted at ARG is found.  */
-static int
-findmagictag (Node *node, void *arg)
+/*
+ * Find the first tag in RCS whose revision does not sort before the first
+ * LEN bytes of REV, building the sorted index of the symbols first if
+ * necessary.  Since tags with a common revision prefix sort together, the
+ * tags whose revisions start with REV follow from there.  When LEN includes
+ * the terminating NUL, only tags exactly on REV match.
+ *
+ * RETURNS
+ *   An index into RCS->symbols_byrev, which may be RCS->nsymbols_byrev.
+ */
+static size_t
+symbols_byrev_search (RCSNode *rcs, const char *rev, size_t len)
 {
-    char *rev = arg;
-    char *dat = node->data;
-    size_t len = strlen (rev);
+    size_t lo, hi;
 
-    if (STRNEQ (dat, rev, len)
-	&& STRNEQ (dat + len, ".0.", 3))
-	return 1;
-    else
-	return 0;
+    if (rcs->symbols_byrev == NULL)
+    {
+	List *symbols = RCS_symbols (rcs);
+	Node *head, *p;
+	size_t n = 0;
+
+	if (symbols == NULL)
+	    return 0;
+
+	head = symbols->list;
+	for (p = head->next; p != head; p = p->next)
+	    n++;
+	rcs->symbols_byrev = xnmalloc (n ? n : 1, sizeof (Node *));
+	n = 0;
+	for (p = head->next; p != head; p = p->next)
+	    rcs->symbols_byrev[n++] = p;
+	qsort (rcs->symbols_byrev, n, sizeof (Node *), symbols_byrev_cmp);
+	rcs->nsymbols_byrev = n;
+	TRACE (TRACE_DATA, "symbols_byrev_search: indexed %lu symbols of %s",
+	       (unsigned long) n, rcs->print_path);
+    }
+
+    lo = 0;
+    hi = rcs->nsymbols_byrev;
+    while (lo < hi)
+    {
+	size_t mid = lo + (hi - lo) / 2;
+
+	if (strncmp (rcs->symbols_byrev[mid]->data, rev, len) < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+
+
+/* Return true if any tag in RCS has a revision starting with the first LEN
+ * bytes of REV.
+ */
+static bool
+symbols_byrev_exists (RCSNode *rcs, const char *rev, size_t len)
+{
+    size_t i = symbols_byrev_search (rcs, rev, len);
+
+    return i < rcs->nsymbols_byrev
+	   && STRNEQ (rcs->symbols_byrev[i]->data, rev, len);
+}
+
+
+
+/* Return true if REV in RCS is tagged or has a magic branch rooted at it.  */
+static bool
+rev_has_tags (RCSNode *rcs, const char *rev)
+{
+    char *magic;
+    bool retval;
+
+    if (symbols_byrev_exists (rcs, rev, strlen (rev) + 1))
+	return true;
+
+    magic = Xasprintf ("%s.%d.", rev, RCS_MAGIC_BRANCH);
+    retval = symbols_byrev_exists (rcs, magic, strlen (magic));
+    free (magic);
+    return retval;
 }
 
 
@@ -6901,9 +7544,7 @@ RCS_delete_revs (RCSNode *rcs, char *tag1, char *tag2, int inclusive)
 
 	    /* Doing this only for the :: syntax is for compatibility.
 	       See cvs.texinfo for somewhat more discussion.  */
-	    if (!inclusive &&
-		(walklist (RCS_symbols (rcs), findtag, revp->version) ||
-		 walklist (RCS_symbols (rcs), findmagictag, revp->version)))
+	    if (!inclusive && rev_has_tags (rcs, revp->version))
 	    {
 		/* We don't print which file this happens to on the theory
 		   that the caller will print the name of the file in a
@@ -7099,7 +7740,7 @@ RCS_delete_revs (RCSNode *rcs, char *tag1, char *tag2, int inclusive)
 	   list.  Otherwise, BEFORE is on the same branch as AFTER, and
 	   we can just change BEFORE's `next' field to point to AFTER.
 	   (This should be safe: since findnode manages its lists via
-	   the `hashnext' and `hashprev' fields, rather than `next' and
+	   the list's hash table, rather than `next' and
 	   `prev', mucking with `next' and `prev' should not corrupt the
 	   delta tree's internal structure.  Much. -twp) */
 
@@ -7210,7 +7851,7 @@ RCS_exist_rev (RCSNode *rcs, char *rev)
     if (findnode(rcs->versions, rev) != 0)
 	return 1;
 
-    if (walklist (RCS_symbols(rcs), findtag, rev) != 0)
+    if (symbols_byrev_exists (rcs, rev, strlen (rev) + 1))
 	return 1;
 
     return 0;
@@ -7356,36 +7997,6 @@ linevector_add (struct linevector *vec, const char *text, size_t len,
 
 
 
-/* Copy FROM to TO, copying the vectors but not the lines pointed to.  */
-static void
-linevector_copy (struct linevector *to, struct linevector *from)
-{
-    unsigned int ln;
-
-    for (ln = 0; ln < to->nlines; ++ln)
-    {
-	if (--to->vector[ln]->refcount == 0)
-	    free (to->vector[ln]);
-    }
-    if (from->nlines > to->lines_alloced)
-    {
-	if (to->lines_alloced == 0)
-	    to->lines_alloced = 10;
-	while (from->nlines > to->lines_alloced)
-	    to->lines_alloced *= 2;
-	to->vector = xnrealloc (to->vector,
-				to->lines_alloced,
-				sizeof (*to->vector));
-    }
-    memcpy (to->vector, from->vector,
-	    xtimes (from->nlines, sizeof (*to->vector)));
-    to->nlines = from->nlines;
-    for (ln = 0; ln < to->nlines; ++ln)
-	++to->vector[ln]->refcount;
-}
-
-
-
 /* Free storage associated with linevector.  */
 static void
 linevector_free (struct linevector *vec)
@@ -7430,8 +8041,15 @@ month_printname (const char *month)
  * length DIFFLEN holding the change text from an RCS file (the output
  * of diff -n).  NAME is used in error messages.  The VERS field of
  * any line added is set to ADDVERS.  The VERS field of any line
- * deleted is set to DELVERS, unless DELVERS is NULL, in which case
- * the VERS field of deleted lines is unchanged.
+ * deleted is set to DELVERS if it is not yet set, unless DELVERS is NULL,
+ * in which case the VERS field of deleted lines is unchanged.
+ *
+ * If KEEP is not NULL, the old vector of ORIG_LINES is moved to *KEEP
+ * rather than freed, which saves the caller copying it beforehand.
+ *
+ * OUTPUTS
+ *   attributed	If not NULL, incremented once for each deleted line which
+ *		is still referenced elsewhere and had its VERS field set.
  *
  * RETURNS
  *   Non-zero if the change text is applied successfully to ORIG_LINES.
@@ -7448,7 +8066,8 @@ month_printname (const char *month)
 static int
 apply_rcs_changes (struct linevector *orig_lines, const char *diffbuf,
 		   size_t difflen, const char *name, RCSVers *addvers,
-		   RCSVers *delvers)
+		   RCSVers *delvers, struct linevector *keep,
+		   unsigned int *attributed)
 {
     const char *p;
     const char *q;
@@ -7467,8 +8086,9 @@ apply_rcs_changes (struct linevector *orig_lines, const char *diffbuf,
     struct deltafrag *dfhead;
     struct deltafrag **dftail;
     struct deltafrag *df;
-    unsigned long numlines, offset;
+    unsigned long numlines, nlines, offset;
     struct linevector lines;
+    unsigned int ln;
     int err;
 
     dfhead = NULL;
@@ -7539,6 +8159,47 @@ apply_rcs_changes (struct linevector *orig_lines, const char *diffbuf,
 	}
     }
 
+    /* Check that the changes fit ORIG_LINES before touching any lines, so
+       that nothing needs undoing if they do not.  */
+    offset = 0;
+    nlines = 0;
+    err = 0;
+    for (df = dfhead; df != NULL && !err; df = df->next)
+    {
+	unsigned long newpos = df->pos - offset;
+
+	if (newpos < nlines || newpos > numlines)
+	    err = 1;
+	else if (df->type == FRAG_ADD)
+	{
+	    if (newpos + df->nlines > numlines)
+		err = 1;
+	    nlines = newpos + df->nlines;
+	    offset -= df->nlines;
+	}
+	else
+	{
+	    if (df->pos + df->nlines > orig_lines->nlines)
+		err = 1;
+	    nlines = newpos;
+	    offset += df->nlines;
+	}
+    }
+
+    if (err)
+    {
+	/* No reason to try and move a half-mutated and known invalid
+	 * text into the output buffer.
+	 */
+	while (dfhead != NULL)
+	{
+	    df = dfhead->next;
+	    free (dfhead);
+	    dfhead = df;
+	}
+	return 0;
+    }
+
     /* New temp data structure to hold new org before
        copy back into original structure. */
     lines.lines_alloced = numlines;
@@ -7549,116 +8210,104 @@ apply_rcs_changes (struct linevector *orig_lines, const char *diffbuf,
     lines.nlines = 0; 
 
     /* offset created when adding/removing lines
-       between new and original structure */
+       between new and original structure.  Unless the old vector is
+       being kept, the lines we carry over simply change hands, so their
+       reference counts stay as they are.  */
     offset = 0; 
-    err = 0;
     for (df = dfhead; df != NULL; )
     {
-	unsigned int ln;
 	unsigned long newpos = df->pos - offset;
 
-	if (newpos < lines.nlines || newpos > numlines)
-	    err = 1;
+	/* Here we need to get to the line where the next change will
+	   begin, which is DF->pos in ORIG_LINES.  We will fill up to
+	   DF->pos - OFFSET in LINES with original items.  */
+	memcpy (lines.vector + lines.nlines,
+		orig_lines->vector + lines.nlines + offset,
+		(newpos - lines.nlines) * sizeof *lines.vector);
+	if (keep)
+	    for (ln = lines.nlines; ln < newpos; ++ln)
+		lines.vector[ln]->refcount++;
+	lines.nlines = newpos;
 
-	/* On error, just free the rest of the list.  */
-	if (!err)
+	switch (df->type)
 	{
-	    /* Here we need to get to the line where the next change will
-	       begin, which is DF->pos in ORIG_LINES.  We will fill up to
-	       DF->pos - OFFSET in LINES with original items.  */
-	    while (lines.nlines < newpos)
+	    case FRAG_ADD:
 	    {
-		/* we need to copy from the orig structure into new one */
-		lines.vector[lines.nlines] =
-			orig_lines->vector[lines.nlines + offset];
-		lines.vector[lines.nlines]->refcount++;
-		lines.nlines++;
-	    }
-
-	    switch (df->type)
-	    {
-		case FRAG_ADD:
+		const char *textend, *p;
+		const char *nextline_text;
+		struct line *q;
+		int nextline_newline;
+		size_t nextline_len;
+
+		textend = df->new_lines + df->len;
+		nextline_newline = 0;
+		nextline_text = df->new_lines;
+		for (p = df->new_lines; p < textend; ++p)
 		{
-		    const char *textend, *p;
-		    const char *nextline_text;
-		    struct line *q;
-		    int nextline_newline;
-		    size_t nextline_len;
-
-		    if (newpos + df->nlines > numlines)
+		    if (*p == '\n')
 		    {
-			err = 1;
-			break;
-		    }
-		    textend = df->new_lines + df->len;
-		    nextline_newline = 0;
-		    nextline_text = df->new_lines;
-		    for (p = df->new_lines; p < textend; ++p)
-		    {
-			if (*p == '\n')
+			nextline_newline = 1;
+			if (p + 1 == textend)
 			{
-			    nextline_newline = 1;
-			    if (p + 1 == textend)
-			    {
-				/* If there are no characters beyond the
-				   last newline, we don't consider it
-				   another line. */
-				break;
-			    }
+			    /* If there are no characters beyond the
+			       last newline, we don't consider it
+			       another line. */
+			    break;
+			}
 
-			    nextline_len = p - nextline_text;
-			    q = xmalloc (sizeof *q + nextline_len);
-			    q->vers = addvers;
-			    q->text = (char *)(q + 1);
-			    q->len = nextline_len;
-			    q->has_newline = nextline_newline;
-			    q->refcount = 1;
-			    memcpy (q->text, nextline_text, nextline_len);
-			    lines.vector[lines.nlines++] = q;
+			nextline_len = p - nextline_text;
+			q = xmalloc (sizeof *q + nextline_len);
+			q->vers = addvers;
+			q->text = (char *)(q + 1);
+			q->len = nextline_len;
+			q->has_newline = nextline_newline;
+			q->refcount = 1;
+			memcpy (q->text, nextline_text, nextline_len);
+			lines.vector[lines.nlines++] = q;
 		    
-			    nextline_text = (char *)p + 1;
-			    nextline_newline = 0;
-			}
+			nextline_text = (char *)p + 1;
+			nextline_newline = 0;
 		    }
-		    nextline_len = p - nextline_text;
-		    q = xmalloc (sizeof *q + nextline_len);
-		    q->vers = addvers;
-		    q->text = (char *)(q + 1);
-		    q->len = nextline_len;
-		    q->has_newline = nextline_newline;
-		    q->refcount = 1;
-		    memcpy (q->text, nextline_text, nextline_len);
-		    lines.vector[lines.nlines++] = q;
-
-		    /* For each line we add the offset between the #'s
-		       decreases. */
-		    offset -= df->nlines;
-		    break;
 		}
+		nextline_len = p - nextline_text;
+		q = xmalloc (sizeof *q + nextline_len);
+		q->vers = addvers;
+		q->text = (char *)(q + 1);
+		q->len = nextline_len;
+		q->has_newline = nextline_newline;
+		q->refcount = 1;
+		memcpy (q->text, nextline_text, nextline_len);
+		lines.vector[lines.nlines++] = q;
+
+		/* For each line we add the offset between the #'s
+		   decreases. */
+		offset -= df->nlines;
+		break;
+	    }
+
+	    case FRAG_DELETE:
+		/* we are removing this many lines from the source. */
+		offset += df->nlines;
 
-		case FRAG_DELETE:
-		    /* we are removing this many lines from the source. */
-		    offset += df->nlines;
+		for (ln = df->pos; ln < df->pos + df->nlines; ++ln)
+		{
+		    struct line *l = orig_lines->vector[ln];
 
-		    if (df->pos + df->nlines > orig_lines->nlines)
-			err = 1;
-		    else if (delvers)
+		    /* Annotate needs this but, since the original
+		     * vector is disposed of before returning from
+		     * this function unless it is kept, we only need
+		     * keep track if there are multiple references.
+		     */
+		    if (delvers && (keep || l->refcount > 1) && l->vers == NULL)
 		    {
-			for (ln = df->pos; ln < df->pos + df->nlines; ++ln)
-			{
-			    if (orig_lines->vector[ln]->refcount > 1)
-			    {
-				/* Annotate needs this but, since the original
-				 * vector is disposed of before returning from
-				 * this function, we only need keep track if
-				 * there are multiple references.
-				 */
-				orig_lines->vector[ln]->vers = delvers;
-			    }
-			}
+			l->vers = delvers;
+			if (attributed)
+			    ++*attributed;
 		    }
-		    break;
-	    }
+		    if (!keep && --l->refcount == 0)
+			free (l);
+		}
+		break;
 	}
 
 	df = df->next;
@@ -7666,33 +8315,28 @@ apply_rcs_changes (struct linevector *orig_lines, const char *diffbuf,
 	dfhead = df;
     }
 
-    if (err)
+    /* add the rest of the remaining lines to the data vector */
+    memcpy (lines.vector + lines.nlines,
+	    orig_lines->vector + lines.nlines + offset,
+	    (numlines - lines.nlines) * sizeof *lines.vector);
+    if (keep)
+	for (ln = lines.nlines; ln < numlines; ++ln)
+	    lines.vector[ln]->refcount++;
+    lines.nlines = numlines;
+
+    /* Move the lines vector to the original structure for output,
+     * first deleting or keeping the old.
+     */
+    if (keep)
     {
-	/* No reason to try and move a half-mutated and known invalid
-	 * text into the output buffer.
-	 */
-	linevector_free (&lines);
+	linevector_free (keep);
+	*keep = *orig_lines;
     }
     else
-    {
-	/* add the rest of the remaining lines to the data vector */
-	while (lines.nlines < numlines)
-	{
-	    /* we need to copy from the orig structure into new one */
-	    lines.vector[lines.nlines] = orig_lines->vector[lines.nlines
-							   + offset];
-	    lines.vector[lines.nlines]->refcount++;
-	    lines.nlines++;
-	}
-
-	/* Move the lines vector to the original structure for output,
-	 * first deleting the old.
-	 */
-	linevector_free (orig_lines);
-	*orig_lines = lines;
-    }
+	free (orig_lines->vector);
+    *orig_lines = lines;
 
-    return !err;
+    return 1;
 }
 
 
@@ -7721,7 +8365,8 @@ rcs_change_text (const char *name, char *textbuf, size_t textlen,
     if (! linevector_add (&lines, textbuf, textlen, NULL, 0))
 	error (1, 0, "cannot initialize line vector");
 
-    if (! apply_rcs_changes (&lines, diffbuf, difflen, name, NULL, NULL))
+    if (! apply_rcs_changes (&lines, diffbuf, difflen, name, NULL, NULL,
+			     NULL, NULL))
     {
 	error (0, 0, "invalid change text in %s", name);
 	ret = 0;
@@ -7761,6 +8406,257 @@ rcs_change_text (const char *name, char *textbuf, size_t textlen,
 
 
 
+/* The annotate cache.
+ *
+ * When the AnnotateCache config option is set, RCS_deltas remembers which
+ * revision each line of an annotated revision came from, in a file named
+ * after the archive in the CVSREP_ANNOTATE directory beside it.  Each entry
+ * in the file is a line giving the annotated revision, its date, and the
+ * number of runs of lines from the same revision, followed by a line for
+ * each run giving its length and the revision the lines came from:
+ *
+ *	1.3 2007.05.01.12.00.00 2
+ *	10 1.1
+ *	2 1.3
+ *
+ * Annotating that revision again needs only its text, and annotating a
+ * later revision only needs the deltas back to it.  An entry is ignored
+ * unless its revision still has the same date and every revision it names
+ * is still in the archive, so outdated and recreated revisions are not
+ * mistaken for the ones they replace.
+ */
+
+/* The most entries kept for one archive.  */
+#define ANNOTATE_CACHE_MAX 16
+
+struct annotate_run
+{
+    unsigned int count;
+    RCSVers *vers;
+};
+
+struct annotate_map
+{
+    char *date;
+    unsigned int nlines;
+    size_t nruns;
+    struct annotate_run *runs;
+};
+
+
+
+static void
+annotate_map_delproc (Node *p)
+{
+    struct annotate_map *map = p->data;
+
+    free (map->date);
+    if (map->runs)
+	free (map->runs);
+    free (map);
+}
+
+
+
+/* Read the annotate cache for RCS.
+ *
+ * RETURNS
+ *   A list of struct annotate_map, keyed by revision, holding the entries
+ *   which are still valid.
+ */
+static List *
+annotate_cache_read (RCSNode *rcs)
+{
+    List *maps = getlist ();
+    char *path = rcs_cache_path (rcs, CVSREP_ANNOTATE);
+    char *line = NULL;
+    size_t linesize = 0;
+    FILE *fp;
+
+    fp = CVS_FOPEN (path, FOPEN_BINARY_READ);
+    if (fp == NULL)
+    {
+	if (!existence_error (errno))
+	    error (0, errno, "cannot open %s", path);
+	free (path);
+	return maps;
+    }
+
+    while (getline (&line, &linesize, fp) > 0)
+    {
+	struct annotate_map *map;
+	size_t runsize = 0;
+	unsigned long nruns;
+	char *date, *cp;
+	Node *vn, *p;
+	bool valid;
+
+	/* A malformed entry means the rest of the file cannot be trusted
+	 * either.
+	 */
+	if ((date = strchr (line, ' ')) == NULL)
+	    break;
+	*date++ = '\0';
+	if ((cp = strchr (date, ' ')) == NULL)
+	    break;
+	*cp++ = '\0';
+	nruns = strtoul (cp, NULL, 10);
+
+	vn = findnode (rcs->versions, line);
+	valid = vn && STREQ (((RCSVers *) vn->data)->date, date);
+
+	map = xmalloc (sizeof *map);
+	map->date = xstrdup (date);
+	map->nlines = 0;
+	map->nruns = 0;
+	map->runs = NULL;
+	p = getnode ();
+	p->type = NT_UNKNOWN;
+	p->key = xstrdup (line);
+	p->data = map;
+	p->delproc = annotate_map_delproc;
+
+	while (map->nruns < nruns && getline (&line, &linesize, fp) > 0)
+	{
+	    struct annotate_run *run;
+	    unsigned long count = strtoul (line, &cp, 10);
+
+	    if (*cp++ != ' ' || count == 0)
+		break;
+	    cp[strcspn (cp, "\n")] = '\0';
+	    vn = findnode (rcs->versions, cp);
+	    if (vn == NULL)
+		valid = false;
+	    expand_string ((char **) &map->runs, &runsize,
+			   (map->nruns + 1) * sizeof *map->runs);
+	    run = &map->runs[map->nruns++];
+	    run->count = count;
+	    run->vers = vn ? vn->data : NULL;
+	    map->nlines += count;
+	}
+	if (map->nruns < nruns)
+	{
+	    freenode (p);
+	    break;
+	}
+
+	if (!valid || addnode (maps, p))
+	    freenode (p);
+    }
+    if (ferror (fp))
+	error (0, errno, "cannot read %s", path);
+    if (fclose (fp) < 0)
+	error (0, errno, "cannot close %s", path);
+
+    if (line)
+	free (line);
+    free (path);
+    return maps;
+}
+
+
+
+/* Set the revision each line of LINES, which is the text of revision
+ * VERS, came from, from the entry for VERS in MAPS.  When ALL is false,
+ * only lines whose revision is not yet known are set.
+ *
+ * RETURNS
+ *   true if MAPS has an entry for VERS which matches LINES.
+ */
+static bool
+annotate_cache_apply (List *maps, RCSVers *vers, struct linevector *lines,
+		      bool all)
+{
+    struct annotate_map *map;
+    unsigned int ln;
+    size_t i;
+    Node *p;
+
+    p = findnode (maps, vers->version);
+    if (p == NULL)
+	return false;
+    map = p->data;
+    if (map->nlines != lines->nlines)
+	return false;
+
+    ln = 0;
+    for (i = 0; i < map->nruns; i++)
+    {
+	unsigned int n;
+
+	for (n = 0; n < map->runs[i].count; n++, ln++)
+	    if (all || lines->vector[ln]->vers == NULL)
+		lines->vector[ln]->vers = map->runs[i].vers;
+    }
+    return true;
+}
+
+
+
+/* Write an entry for the annotated revision VERS, whose lines are LINES,
+ * to the annotate cache for RCS, followed by the other entries in MAPS.
+ * Failing to write the cache is not worth bothering the user about.
+ */
+static void
+annotate_cache_write (RCSNode *rcs, List *maps, RCSVers *vers,
+		      struct linevector *lines)
+{
+    char *path, *tmp;
+    FILE *fp;
+    unsigned int ln, count;
+    int entries;
+    Node *head, *p;
+
+    path = rcs_cache_path (rcs, CVSREP_ANNOTATE);
+    fp = rcs_cache_create (path, &tmp);
+    if (fp == NULL)
+    {
+	free (path);
+	return;
+    }
+
+    /* Count the runs first, since they follow the count in the file.  */
+    count = 0;
+    for (ln = 0; ln < lines->nlines; ln++)
+	if (ln == 0 || lines->vector[ln]->vers != lines->vector[ln - 1]->vers)
+	    count++;
+    fprintf (fp, "%s %s %u\n", vers->version, vers->date, count);
+    for (ln = 0; ln < lines->nlines; ln += count)
+    {
+	RCSVers *v = lines->vector[ln]->vers;
+
+	for (count = 1;
+	     ln + count < lines->nlines && lines->vector[ln + count]->vers == v;
+	     count++)
+	    ;
+	fprintf (fp, "%u %s\n", count, v->version);
+    }
+
+    /* Then as many of the older entries as there is room for.  */
+    entries = 1;
+    head = maps->list;
+    for (p = head->next; p != head && entries < ANNOTATE_CACHE_MAX;
+	 p = p->next)
+    {
+	struct annotate_map *map = p->data;
+	size_t i;
+
+	if (STREQ (p->key, vers->version))
+	    continue;
+	fprintf (fp, "%s %s %lu\n", p->key, map->date,
+		 (unsigned long) map->nruns);
+	for (i = 0; i < map->nruns; i++)
+	    fprintf (fp, "%u %s\n", map->runs[i].count,
+		     map->runs[i].vers->version);
+	entries++;
+    }
+
+    rcs_cache_finish (fp, tmp, path);
+    free (path);
+}
+
+
+
 /* Walk the deltas in RCS to get to revision VERSION.
 
    If OP is RCS_ANNOTATE, then write annotations using cvs_output.
@@ -7798,7 +8694,15 @@ RCS_deltas (RCSNode *rcs, FILE *fp, struct rcsbuffer *rcsbuf,
     struct linevector headlines;
     struct linevector curlines;
     struct linevector trunklines;
+    /* Where the next call to apply_rcs_changes should move the vector it
+       replaces, if anywhere.  */
+    struct linevector *keep = NULL;
+    /* The number of lines of the version we want whose origin is still
+       unknown, once we have found it.  */
+    unsigned int unknown = 0;
     int foundhead;
+    List *annotate_maps = NULL;
+    bool annotate_cached = false;
 
     assert (version);
 
@@ -7824,6 +8728,9 @@ RCS_deltas (RCSNode *rcs, FILE *fp, struct rcsbuffer *rcsbuf,
     linevector_init (&headlines);
     linevector_init (&trunklines);
 
+    if (op == RCS_ANNOTATE && config && config->AnnotateCache)
+	annotate_maps = annotate_cache_read (rcs);
+
     /* We set BRANCHVERSION to the version we are currently looking
        for.  Initially, this is the version on the trunk from which
        VERSION branches off.  If VERSION is not a branch, then
@@ -7903,11 +8810,17 @@ RCS_deltas (RCSNode *rcs, FILE *fp, struct rcsbuffer *rcsbuf,
 		}
 		else if (isnext)
 		{
+		    unsigned int attributed = 0;
+
 		    if (! apply_rcs_changes (&curlines, value, vallen,
 					     rcs->path,
 					     onbranch ? vers : NULL,
-					     onbranch ? NULL : prev_vers))
+					     onbranch ? NULL : prev_vers,
+					     keep, &attributed))
 			error (1, 0, "invalid change text in %s", rcs->print_path);
+		    keep = NULL;
+		    if (foundhead)
+			unknown -= attributed;
 		}
 		break;
 	    }
@@ -7919,9 +8832,23 @@ RCS_deltas (RCSNode *rcs, FILE *fp, struct rcsbuffer *rcsbuf,
                branchpoint to the version we want.  */
 	    if (STREQ (branchversion, version))
 	    {
+		struct linevector *lines;
+		unsigned int ln;
+
 	        /* This is the version we want.  */
-		linevector_copy (&headlines, &curlines);
 		foundhead = 1;
+		if (op == RCS_FETCH
+		    || (annotate_maps
+			&& annotate_cache_apply (annotate_maps, vers,
+						 &curlines, true)))
+		{
+		    /* Either we only wanted the text, or we already know
+		       where all its lines came from.  */
+		    annotate_cached = op == RCS_ANNOTATE;
+		    headlines = curlines;
+		    linevector_init (&curlines);
+		    break;
+		}
 		if (onbranch)
 		{
 		    /* We have found this version by tracking up a
@@ -7931,8 +8858,22 @@ RCS_deltas (RCSNode *rcs, FILE *fp, struct rcsbuffer *rcsbuf,
 		    onbranch = 0;
 		    vers = trunk_vers;
 		    next = vers->next;
-		    linevector_copy (&curlines, &trunklines);
+		    headlines = curlines;
+		    curlines = trunklines;
+		    linevector_init (&trunklines);
+		}
+		else
+		{
+		    /* Rather than copying the lines, have the next change
+		       hand them over once it is done with them.  */
+		    keep = &headlines;
 		}
+
+		/* Lines added on a branch are already accounted for.  */
+		lines = keep ? &curlines : &headlines;
+		for (ln = 0; ln < lines->nlines; ++ln)
+		    if (lines->vector[ln]->vers == NULL)
+			++unknown;
 	    }
 	    else
 	    {
@@ -7949,7 +8890,7 @@ RCS_deltas (RCSNode *rcs, FILE *fp, struct rcsbuffer *rcsbuf,
                        lines so that we can restore them when we
                        continue tracking down the trunk.  */
 		    trunk_vers = vers;
-		    linevector_copy (&trunklines, &curlines);
+		    keep = &trunklines;
 
 		    /* Reset the version information we have
                        accumulated so far.  It only applies to the
@@ -7997,8 +8938,28 @@ RCS_deltas (RCSNode *rcs, FILE *fp, struct rcsbuffer *rcsbuf,
 	}
 	if (op == RCS_FETCH && foundhead)
 	    break;
+
+	/* Once we are back on the trunk below the version we want, the
+	   lines whose origin is still unknown are lines of this version,
+	   so a cached annotation of it tells us the rest.  */
+	if (annotate_maps && foundhead && isnext && !onbranch
+	    && !STREQ (vers->version, version)
+	    && annotate_cache_apply (annotate_maps, vers, &curlines, false))
+	    break;
+
+	/* Nor is there any point going further once we know where every
+	   line came from.  */
+	if (foundhead && unknown == 0)
+	    break;
     } while (next != NULL);
 
+    if (keep == &headlines)
+    {
+	/* Nothing came along to hand the lines over.  */
+	headlines = curlines;
+	linevector_init (&curlines);
+    }
+
     free (branchversion);
 
     rcsbuf_cache (rcs, rcsbuf);
@@ -8007,6 +8968,24 @@ RCS_deltas (RCSNode *rcs, FILE *fp, struct rcsbuffer *rcsbuf,
         error (1, 0, "could not find desired version %s in %s",
 	       version, rcs->print_path);
 
+    if (annotate_maps)
+    {
+	if (!annotate_cached)
+	{
+	    unsigned int ln;
+
+	    /* Lines which made it all the way down came from the last
+	       version we looked at.  */
+	    for (ln = 0; ln < headlines.nlines; ++ln)
+		if (headlines.vector[ln]->vers == NULL)
+		    headlines.vector[ln]->vers = vers;
+	    annotate_cache_write (rcs, annotate_maps,
+				  findnode (rcs->versions, version)->data,
+				  &headlines);
+	}
+	dellist (&annotate_maps);
+    }
+
     /* Now print out or return the data we have just computed.  */
     switch (op)
     {
@@ -8287,7 +9266,8 @@ unable to parse %s; `state' not in the expected place", rcsfile);
 	    vnode->other_delta = getlist ();
 	kv = getnode ();
 	kv->type = rcsbuf_get_node_type (rcsbuf);
-	kv->key = xstrdup (key);
+	kv->key = list_strdup (vnode->other_delta, key);
+	kv->flags = NODE_KEY_POOLED;
 	kv->data = rcsbuf_valcopy (rcsbuf, value, kv->type != RCSCMPFLD,
 				   &kv->len);
 	if (addnode (vnode->other_delta, kv) != 0)
@@ -9280,6 +10260,7 @@ RCS_setlocalid (const char *infopath, unsigned int ln,
     if (!*keywords_in)
 	*keywords_in = new_keywords ();
     keywords = *keywords_in;
+    ((struct rcs_keywords *) keywords)->indexed = false;
 
     copy = xstrdup (arg);
     next = copy;
@@ -9346,6 +10327,7 @@ RCS_setincexc (void **keywords_in, const char *arg)
     if (!*keywords_in)
 	*keywords_in = new_keywords ();
     keywords = *keywords_in;
+    ((struct rcs_keywords *) keywords)->indexed = false;
 
     copy = xstrdup(arg);
     next = copy;
@@ -9454,6 +10436,8 @@ findnextmagicrev (RCSNode *rcs, char *rev, int defaultrv)
     int rv = defaultrv;
     struct findnextmagicrev_info info;
     Node *p;
+    char *prefix;
+    size_t i;
   
     /* Tell the walklist proc how many dots we're looking for,
      * which is the number of dots in the existing rev, plus
@@ -9465,8 +10449,15 @@ findnextmagicrev (RCSNode *rcs, char *rev, int defaultrv)
     info.min_rev = defaultrv;
     info.rev_list = getlist ();
   
-    /* walk the symbols list to find the highest revision. */
-    (void) walklist (RCS_symbols (rcs), findnextmagicrev_proc, &info);
+    /* look through the tags on revisions below REV, which sort together */
+    prefix = Xasprintf ("%s.", rev);
+    for (i = symbols_byrev_search (rcs, prefix, info.target_rev_len + 1);
+	 i < rcs->nsymbols_byrev
+	 && STRNEQ (rcs->symbols_byrev[i]->data, prefix,
+		    info.target_rev_len + 1);
+	 i++)
+	(void) findnextmagicrev_proc (rcs->symbols_byrev[i], &info);
+    free (prefix);
 
     if (! list_isempty (info.rev_list))
     {
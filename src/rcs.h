@@ -88,7 +88,8 @@ struct rcsnode
     char *branch;
 
     /* Raw data on symbolic revisions.  The first time that RCS_symbols is
-       called, we parse these into ->symbols, and free ->symbols_data.  */
+       called, we parse these into ->symbols, which takes over the storage,
+       and set ->symbols_data to NULL.  */
     char *symbols_data;
 
     /* Value for expand keyword from RCS header, or NULL if omitted.  */
@@ -98,6 +99,13 @@ struct rcsnode
        of which is the numeric revision that it corresponds to (malloc'd).  */
     List *symbols;
 
+    /* The nodes of ->symbols sorted by revision, so that the tags on a
+       revision, or on the branches sprouting from it, can be found by
+       binary search.  Built on demand and discarded, by setting it to
+       NULL, whenever ->symbols changes.  */
+    Node **symbols_byrev;
+    size_t nsymbols_byrev;
+
     /* List of nodes (type RCSVERS), the key of which the numeric revision
        number, and the data of which is an RCSVers * for the revision.  */
     List *versions;
@@ -232,17 +240,33 @@ typedef struct rcsversnode RCSVers;
 /* The type of a function passed to RCS_checkout.  */
 typedef void (*RCSCHECKOUTPROC) (void *, const char *, size_t);
 
+/* The type of a function passed to RCS_walk_deltatexts.  */
+typedef void (*RCSDELTATEXTPROC) (RCSNode *, RCSVers *, void *);
+
 struct rcsbuffer;
 
 /* What RCS_deltas is supposed to do.  */
 enum rcs_delta_op {RCS_ANNOTATE, RCS_FETCH};
 
+/* Where RCS_deltas keeps the line origins of annotated revisions, in a file
+ * named after the archive, when the AnnotateCache config option is set.
+ * This is relative to the directory containing the archive.
+ */
+#define CVSREP_ANNOTATE "CVS/annotate"
+
+/* Where RCS_cmp_file keeps digests of the expanded text of revisions, in a
+ * file named after the archive, when the DigestCache config option is set.
+ * This is relative to the directory containing the archive.
+ */
+#define CVSREP_DIGEST "CVS/digest"
+
 /*
  * exported interfaces
  */
 RCSNode *RCS_parse (const char *file, const char *repos);
 RCSNode *RCS_parsercsfile (const char *rcsfile);
 void RCS_fully_parse (RCSNode *);
+void RCS_walk_deltatexts (RCSNode *, RCSDELTATEXTPROC, void *);
 void RCS_reparsercsfile (RCSNode *, FILE **, struct rcsbuffer *);
 extern int RCS_setattic (RCSNode *, int);
 
@@ -275,6 +299,9 @@ char *RCS_getexpand (RCSNode *);
 void RCS_setexpand (RCSNode *, const char *);
 int RCS_checkout (RCSNode *, const char *, const char *, const char *,
                   const char *, const char *, RCSCHECKOUTPROC, void *);
+int RCS_checkout_buffer (RCSNode *, const char *, const char *, const char *,
+			 char **, size_t *);
+char *RCS_checkout_key (RCSNode *, const char *, const char *, const char *);
 bool RCS_get_openpgp_signatures (struct file_info *finfo, const char *rev,
 				 char **out, size_t *len);
 bool RCS_has_openpgp_signatures (struct file_info *finfo, const char *rev);
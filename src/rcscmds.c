@@ -159,6 +159,25 @@ diff_exec (const char *file1, const char *file2, const char *label1,
     return call_diff (out);
 }
 
+
+
+/* Like diff_exec, but show the differences between the LEN1 bytes at TEXT1
+   and the LEN2 bytes at TEXT2, returning them in a newly malloc'd *OUT of
+   *OUTLEN bytes (*OUT is NULL when there are none) rather than writing them
+   to a file.  */
+
+int
+diff_exec_buffers (const char *text1, size_t len1, const char *text2,
+		   size_t len2, int dargc, char * const *dargv, char **out,
+		   size_t *outlen)
+{
+    TRACE (TRACE_FUNCTION, "diff_exec_buffers (%lu bytes, %lu bytes)",
+	   (unsigned long) len1, (unsigned long) len2);
+
+    call_diff_setup ("diff", dargc, dargv);
+    return call_diff_buffers (text1, len1, text2, len2, out, outlen);
+}
+
 /* Print the options passed to DIFF, in the format used by rcsdiff.
    The rcsdiff code that produces this output is extremely hairy, and
    it is not clear how rcsdiff decides which options to print and
@@ -1195,6 +1195,17 @@ addlist (List **listp, char *key)
 	freenode (p);
 }
 
+/*
+ * Free the list of files hung off a directory node by addfile.
+ */
+static void
+filelist_delproc (Node *p)
+{
+    List *fl = p->data;
+
+    dellist (&fl);
+}
+
 static void
 addfile (List **listp, char *dir, char *file)
 {
@@ -1212,6 +1223,7 @@ addfile (List **listp, char *dir, char *file)
     }
 
     n->type = DIRS;
+    n->delproc = filelist_delproc;
     fl = n->data;
     addlist (&fl, file);
     n->data = fl;
@@ -2240,7 +2240,7 @@ if test x"$*" = x; then
 	tests="${tests} status"
 	# Branching, tagging, removing, adding, multiple directories
 	tests="${tests} rdiff rdiff-short"
-	tests="${tests} rdiff2 diff diffnl death death2 death-rtag"
+	tests="${tests} rdiff2 diff diffnl diffhist diffjobs death death2 death-rtag"
 	tests="${tests} rm-update-message rmadd rmadd2 rmadd3 resurrection"
 	tests="${tests} dirs dirs2 branches branches2 branches3"
 	tests="${tests} branches4 branches5 tagc tagf tag-log tag-space"
@@ -2256,7 +2256,8 @@ if test x"$*" = x; then
 	# Checking out various places (modules, checkout -d, &c)
 	tests="${tests} modules modules2 modules3 modules4 modules5 modules6"
 	tests="${tests} modules7 mkmodules co-d"
-	tests="${tests} cvsadm emptydir abspath abspath2 toplevel toplevel2"
+	tests="${tests} cvsadm entidx entlog emptydir abspath abspath2"
+	tests="${tests} toplevel toplevel2"
         tests="${tests} rstar-toplevel trailingslashes checkout_repository"
 	# Log messages, error messages.
 	tests="${tests} mflag editor env errmsg1 errmsg2 adderrmsg opterrmsg"
@@ -2267,11 +2268,13 @@ if test x"$*" = x; then
 	tests="${tests} devcom devcom2 devcom3 watch4 watch5 watch6-0 watch6"
         tests="${tests} edit-check"
 	tests="${tests} unedit-without-baserev"
-	tests="${tests} ignore ignore-on-branch binfiles binfiles2 binfiles3"
+	tests="${tests} ignore ignore-on-branch fsmonitor prefetch cocache"
+	tests="${tests} binfiles binfiles2 binfiles3 binfiles4"
 	tests="${tests} binwrap binwrap2"
 	tests="${tests} binwrap3 mwrap info taginfo posttag"
 	tests="$tests config config2 config3 config4 compression"
-	tests="${tests} serverpatch log log2 logopt ann ann-id"
+	tests="${tests} serverpatch log log2 logopt ann ann-id anncache"
+	tests="${tests} digestcache"
 	# Repository Storage (RCS file format, CVS lock files, creating
 	# a repository without "cvs init", &c).
 	tests="${tests} crerepos crerepos-extssh rcs rcs2 rcs3 rcs4 rcs5 rcs6"
@@ -6004,8 +6007,48 @@ File: t3file           	Status: Up-to-date
    Sticky Date:		(none)
    Sticky Options:	(none)"
 
+		# A clean merge leaves "Result of merge" as the timestamp,
+		# which is not a time at all.  Make sure a file dated one
+		# second before the epoch, which is what a failed parse of
+		# such a timestamp yields, is still not taken for unmodified.
+		cd ../../second-dir
+		echo one >mfile
+		echo two >>mfile
+		dotest status-init-14 "$testcvs -Q add mfile"
+		dotest status-init-15 "$testcvs -q ci -m add mfile" \
+"$CVSROOT_DIRNAME/first-dir/mfile,v  <--  mfile
+initial revision: 1\.1"
+		cd ../first-dir
+		dotest status-init-16 "$testcvs -q update mfile" "U mfile"
+		cd ../second-dir
+		echo three >>mfile
+		dotest status-init-17 "$testcvs -q ci -m modify mfile" \
+"$CVSROOT_DIRNAME/first-dir/mfile,v  <--  mfile
+new revision: 1\.2; previous revision: 1\.1"
+		cd ../first-dir
+		echo zero >mfile
+		echo one >>mfile
+		echo two >>mfile
+		dotest status-init-18 "$testcvs -q update mfile" \
+"Merging differences between 1\.1 and 1\.2 into \`mfile'
+M mfile"
+		dotest status-7 "grep mfile CVS/Entries" \
+"/mfile/1\.2/Result of merge//"
+		if touch -d @-1 mfile >/dev/null 2>&1; then
+		  dotest status-8 "$testcvs status mfile" \
+"===================================================================
+File: mfile            	Status: Locally Modified
+
+   Working revision:	1\.2.*
+   Repository revision:	1\.2	$CVSROOT_DIRNAME/first-dir/mfile,v
+   Commit Identifier:	${commitid}
+   Sticky Tag:		(none)
+   Sticky Date:		(none)
+   Sticky Options:	(none)"
+		fi
+
 		dokeep
-		cd ../../..
+		cd ../..
 		rm -rf status
 		modify_repo rm -rf $CVSROOT_DIRNAME/first-dir \
 				   $CVSROOT_DIRNAME/fourth-dir
@@ -6479,6 +6522,232 @@ new revision: 1\.4; previous revision: 1\.3"
 
 
 
+	diffhist)
+	  # Test the histogram diff algorithm and the DiffAlgorithm config
+	  # option.
+	  mkdir diffhist; cd diffhist
+	  dotest diffhist-init-1 "$testcvs -Q co -l ."
+	  mkdir first-dir
+	  dotest diffhist-init-2 "$testcvs -Q add first-dir"
+	  cd first-dir
+	  echo "{
+d
+c
+c" >abc
+	  dotest diffhist-init-3 "$testcvs -Q add abc"
+	  dotest diffhist-init-4 "$testcvs -Q ci -m initial"
+
+	  echo "c
+b
+}
+b
+{" >abc
+	  dotest_fail diffhist-1 "$testcvs diff abc" \
+"diff -r1\.1 abc
+1,3d0
+< {
+< d
+< c
+4a2,5
+> b
+> }
+> b
+> {"
+	  # The histogram algorithm anchors on the only line of the old
+	  # revision which is unique, rather than on the longest match.
+	  dotest_fail diffhist-2 "$testcvs diff --histogram abc" \
+"diff --histogram -r1\.1 abc
+0a1,4
+> c
+> b
+> }
+> b
+2,4d5
+< d
+< c
+< c"
+
+	  cd ../..
+	  mkdir config; cd config
+	  dotest diffhist-3 "$testcvs -Q co CVSROOT"
+	  cd CVSROOT
+	  echo "DiffAlgorithm=histogram" >>config
+	  dotest diffhist-4 "$testcvs -Q ci -mhistogram"
+	  cd ../../diffhist/first-dir
+
+	  # Now it is the default, for the stored deltas and for diffs the
+	  # server makes.  A client diffing against its base files uses its
+	  # own options.
+	  if $remote; then
+	    dotest_fail diffhist-5r "$testcvs diff abc" \
+"diff -r1\.1 abc
+1,3d0
+< {
+< d
+< c
+4a2,5
+> b
+> }
+> b
+> {"
+	  else
+	    dotest_fail diffhist-5 "$testcvs diff abc" \
+"diff --histogram -r1\.1 abc
+0a1,4
+> c
+> b
+> }
+> b
+2,4d5
+< d
+< c
+< c"
+	  fi
+	  dotest diffhist-6 "$testcvs -Q ci -m second"
+	  dotest diffhist-7 "$testcvs -q update -p -r1.1 abc" \
+"{
+d
+c
+c"
+	  dotest diffhist-8 "$testcvs -q update -p -r1.2 abc" \
+"c
+b
+}
+b
+{"
+
+	  dokeep
+	  cd ../..
+	  restore_adm
+	  rm -r diffhist config
+	  modify_repo rm -rf $CVSROOT_DIRNAME/first-dir
+	  ;;
+
+
+
+	diffjobs)
+	  # Test the DiffJobs config option, which lets diff and rdiff run
+	  # several diffs at once.  The output must come out in the same
+	  # order as it would one file at a time.
+	  mkdir diffjobs; cd diffjobs
+	  dotest diffjobs-init-1 "$testcvs -Q co -l ."
+	  mkdir first-dir
+	  dotest diffjobs-init-2 "$testcvs -Q add first-dir"
+	  cd first-dir
+	  mkdir sub
+	  dotest diffjobs-init-3 "$testcvs -Q add sub"
+	  for f in a b c d e f; do
+	    case $f in e|f) p=sub/$f;; *) p=$f;; esac
+	    echo "$f" >$p
+	  done
+	  dotest diffjobs-init-4 "$testcvs -Q add a b c d sub/e sub/f"
+	  dotest diffjobs-init-5 "$testcvs -Q ci -m initial"
+	  dotest diffjobs-init-6 "$testcvs -Q tag first"
+
+	  cd ../..
+	  mkdir config; cd config
+	  dotest diffjobs-init-7 "$testcvs -Q co CVSROOT"
+	  cd CVSROOT
+	  echo "DiffJobs=3" >>config
+	  dotest diffjobs-init-8 "$testcvs -Q ci -mdiffjobs"
+	  cd ../../diffjobs/first-dir
+
+	  for f in a c d e f; do
+	    case $f in e|f) p=sub/$f;; *) p=$f;; esac
+	    echo "new $f" >>$p
+	  done
+	  dotest_fail diffjobs-1 "$testcvs -q diff -u" \
+"diff -u -r1\.1 a
+--- a	$RFCDATE	1\.1
++++ a$LOCAL_RFCDATE
+@@ -1 ${PLUS}1,2 @@
+ a
+${PLUS}new a
+diff -u -r1\.1 c
+--- c	$RFCDATE	1\.1
++++ c$LOCAL_RFCDATE
+@@ -1 ${PLUS}1,2 @@
+ c
+${PLUS}new c
+diff -u -r1\.1 d
+--- d	$RFCDATE	1\.1
++++ d$LOCAL_RFCDATE
+@@ -1 ${PLUS}1,2 @@
+ d
+${PLUS}new d
+diff -u -r1\.1 sub/e
+--- sub/e	$RFCDATE	1\.1
++++ sub/e$LOCAL_RFCDATE
+@@ -1 ${PLUS}1,2 @@
+ e
+${PLUS}new e
+diff -u -r1\.1 sub/f
+--- sub/f	$RFCDATE	1\.1
++++ sub/f$LOCAL_RFCDATE
+@@ -1 ${PLUS}1,2 @@
+ f
+${PLUS}new f"
+	  dotest diffjobs-2 "$testcvs -Q ci -m second"
+
+	  dotest_fail diffjobs-3 "$testcvs -q diff -r first -r HEAD b c d" \
+"diff -r1\.1 -r1\.2 c
+1a2
+> new c
+diff -r1\.1 -r1\.2 d
+1a2
+> new d"
+	  dotest diffjobs-4 "$testcvs -q rdiff -u -r first first-dir" \
+"Index: first-dir/a
+diff -u first-dir/a:1\.1 first-dir/a:1\.2
+--- first-dir/a:1\.1	${DATE}
++++ first-dir/a	${DATE}
+@@ -1 ${PLUS}1,2 @@
+ a
+${PLUS}new a
+Index: first-dir/c
+diff -u first-dir/c:1\.1 first-dir/c:1\.2
+--- first-dir/c:1\.1	${DATE}
++++ first-dir/c	${DATE}
+@@ -1 ${PLUS}1,2 @@
+ c
+${PLUS}new c
+Index: first-dir/d
+diff -u first-dir/d:1\.1 first-dir/d:1\.2
+--- first-dir/d:1\.1	${DATE}
++++ first-dir/d	${DATE}
+@@ -1 ${PLUS}1,2 @@
+ d
+${PLUS}new d
+Index: first-dir/sub/e
+diff -u first-dir/sub/e:1\.1 first-dir/sub/e:1\.2
+--- first-dir/sub/e:1\.1	${DATE}
++++ first-dir/sub/e	${DATE}
+@@ -1 ${PLUS}1,2 @@
+ e
+${PLUS}new e
+Index: first-dir/sub/f
+diff -u first-dir/sub/f:1\.1 first-dir/sub/f:1\.2
+--- first-dir/sub/f:1\.1	${DATE}
++++ first-dir/sub/f	${DATE}
+@@ -1 ${PLUS}1,2 @@
+ f
+${PLUS}new f"
+	  dotest diffjobs-5 "$testcvs -q rdiff -s -r first first-dir" \
+"File first-dir/a changed from revision 1\.1 to 1\.2
+File first-dir/c changed from revision 1\.1 to 1\.2
+File first-dir/d changed from revision 1\.1 to 1\.2
+File first-dir/sub/e changed from revision 1\.1 to 1\.2
+File first-dir/sub/f changed from revision 1\.1 to 1\.2"
+
+	  dokeep
+	  cd ../..
+	  restore_adm
+	  rm -r diffjobs config
+	  modify_repo rm -rf $CVSROOT_DIRNAME/first-dir
+	  ;;
+
+
+
 	death)
 		# next dive.  test death support.
 
@@ -7285,6 +7554,10 @@ ${SPROG} add: use .${SPROG} commit. to add this file permanently"
 
 	  # Now make CVS write val-tags for real.
 	  dotest rmadd-20 "$testcvs -q update -r mynonbranch file1" 'U file1'
+	  # Writing val-tags also rebuilds its index, which rmadd-18 must
+	  # have ignored once val-tags was replaced behind its back.
+	  dotest rmadd-20a \
+"test -f $CVSROOT_DIRNAME/CVSROOT/val-tags.idx"
 
 	  # Oops - CVS isn't distinguishing between a branch tag and
 	  # a non-branch tag.
@@ -14962,6 +15235,21 @@ U one/file1"
 "$testcvs -Q up -pr1.1 checkoutlist >checkoutlist"
 	  dotest mkmodules-cleanup-2 "$testcvs -Q ci -m. checkoutlist"
 
+	  # mkmodules also writes a hashed index of the modules file.  It
+	  # must be ignored as soon as the text file changes behind its back.
+	  echo "idxmod1 first-dir" >>modules
+	  dotest mkmodules-index-1 "$testcvs -Q ci -m. modules"
+	  dotest mkmodules-index-1a "test -f $CVSROOT_DIRNAME/CVSROOT/modules.idx"
+	  dotest mkmodules-index-2 "$testcvs -q co -c" "idxmod1 *first-dir"
+	  chmod u+w $CVSROOT_DIRNAME/CVSROOT/modules
+	  echo "idxmod2 first-dir" >>$CVSROOT_DIRNAME/CVSROOT/modules
+	  dotest mkmodules-index-3 "$testcvs -q co -c" \
+"idxmod1 *first-dir
+idxmod2 *first-dir"
+
+	  dotest mkmodules-cleanup-3 "$testcvs -Q up -pr1.1 modules >modules"
+	  dotest mkmodules-cleanup-4 "$testcvs -Q ci -m. modules"
+
 	  dokeep
 	  cd ../..
 	  rm -rf 1
@@ -16178,6 +16466,107 @@ U dir/dir2/dir2d2/sub2d2/file2"
 
 
 
+	entidx)
+	  # Test the binary index of large CVS/Entries files.
+	  mkdir entidx; cd entidx
+	  dotest entidx-init-1 "$testcvs -Q co -l ."
+	  mkdir first-dir
+	  dotest entidx-init-2 "$testcvs -Q add first-dir"
+	  cd first-dir
+	  mkdir small
+	  dotest entidx-init-3 "$testcvs -Q add small"
+	  touch small/file
+	  i=0
+	  while test $i -lt 100; do
+	    echo $i >file$i
+	    i=`expr $i + 1`
+	  done
+	  dotest entidx-init-4 "$testcvs -Q add small/file file*"
+	  dotest entidx-init-5 "$testcvs -Q ci -m add"
+
+	  # Only large directories get an index.
+	  dotest entidx-1 "test -f CVS/Entries.idx"
+	  dotest_fail entidx-2 "test -f small/CVS/Entries.idx"
+	  dotest entidx-3 "$testcvs -q up"
+	  echo more >>file10
+	  dotest entidx-4 "$testcvs -q up -l" "M file10"
+	  dotest entidx-5 "$testcvs -Q ci -m mod file10"
+	  dotest entidx-6 "$testcvs -q status file10" \
+"===================================================================
+File: file10           	Status: Up-to-date
+
+   Working revision:	1\.2.*
+   Repository revision:	1\.2	$CVSROOT_DIRNAME/first-dir/file10,v
+   Commit Identifier:	${commitid}
+   Sticky Tag:		(none)
+   Sticky Date:		(none)
+   Sticky Options:	(none)"
+
+	  # Changes to CVS/Entries made by others, such as older versions of
+	  # CVS, make the index stale.
+	  echo "/gone/0/dummy timestamp//" >>CVS/Entries
+	  dotest entidx-7 "$testcvs -n -q up -l" \
+"$SPROG update: warning: new-born \`gone' has disappeared"
+	  dotest entidx-8 "$testcvs -q up -l" \
+"$SPROG update: warning: new-born \`gone' has disappeared"
+	  dotest entidx-9 "$testcvs -q up -l"
+
+	  # As does any damage to the index itself.
+	  echo garbage >CVS/Entries.idx
+	  dotest entidx-10 "$testcvs -q rm -f file11" \
+"$SPROG remove: use \`$SPROG commit' to remove this file permanently"
+	  dotest entidx-11 "$testcvs -q up -l" "R file11"
+	  dotest entidx-12 "$testcvs -q up -l" "R file11"
+
+	  # Entries loaded from the index belong to the list's pool, so
+	  # replacing all of them at once must not free any of them.
+	  sleep 1
+	  touch file*
+	  dotest entidx-13 "$testcvs -q up -l" "R file11"
+	  dotest entidx-14 "$testcvs -q up -l" "R file11"
+
+	  dokeep
+	  cd ../..
+	  rm -r entidx
+	  modify_repo rm -rf $CVSROOT_DIRNAME/first-dir
+	  ;;
+
+
+
+	entlog)
+	  # Test that the Entries.Log of a large directory is only folded
+	  # back into its Entries file once the log has grown large, too.
+	  mkdir entlog; cd entlog
+	  mkdir imp; cd imp
+	  i=0
+	  while test $i -lt 1500; do
+	    echo $i >file$i
+	    i=`expr $i + 1`
+	  done
+	  dotest entlog-init-1 \
+"$testcvs -Q import -m import first-dir vendor release"
+	  cd ..
+	  rm -r imp
+	  dotest entlog-init-2 "$testcvs -Q co first-dir"
+	  cd first-dir
+
+	  dotest_fail entlog-1 "test -f CVS/Entries.Log"
+	  dotest entlog-2 "$testcvs -Q rm -f file5"
+	  dotest entlog-3 "cat CVS/Entries.Log" "A /file5/-1\.1\.1\.1/[^/]*//"
+	  dotest entlog-4 "grep /file5/ CVS/Entries" "/file5/1\.1\.1\.1/[^/]*//"
+	  dotest entlog-5 "$testcvs -q up file5" "R file5"
+	  dotest entlog-6 "$testcvs -Q rm -f file1*"
+	  dotest_fail entlog-7 "test -f CVS/Entries.Log"
+	  dotest entlog-8 "grep -c /-1 CVS/Entries" "612"
+
+	  dokeep
+	  cd ../..
+	  rm -r entlog
+	  modify_repo rm -rf $CVSROOT_DIRNAME/first-dir
+	  ;;
+
+
+
 	emptydir)
 	  # Various tests of the Emptydir (CVSNULLREPOS) code.  See also:
 	  #   cvsadm: tests of Emptydir in various module definitions
@@ -17624,6 +18013,17 @@ initial revision: 1\.1"
 "${SPROG} add: \`file1' already exists, with version number 1\.1"
 	  dotest_fail adderrmsg-8 "${testcvs} -q add file1" ""
 
+	  # a new directory together with a file in it
+	  mkdir sdir
+	  touch sdir/file2
+	  if $remote; then
+	    dotest_fail adderrmsg-9r "$testcvs -Q add sdir sdir/file2" \
+"? sdir/file2
+$SPROG add: Nothing known about \`sdir/file2'"
+	  else
+	    dotest adderrmsg-9 "$testcvs -Q add sdir sdir/file2"
+	  fi
+
 	  # clean up
 	  dokeep
 	  cd ../..
@@ -18862,6 +19262,22 @@ ${QUESTION} first-dir/rootig.c
 ${QUESTION} second-dir/.cvsignore
 ${QUESTION} second-dir/notig.c"
 
+	  # Names, prefixes, suffixes and other wildcards are each matched
+	  # in their own way.
+	  echo 'pre* *.suf exact [xy]?z' >first-dir/.cvsignore
+	  touch first-dir/pre1 first-dir/apre first-dir/a.suf first-dir/suf \
+		first-dir/exact first-dir/exactly first-dir/xaz first-dir/xz
+	  dotest_sort ignore-13a "${testcvs} -qn update first-dir" \
+"${QUESTION} first-dir/.cvsignore
+${QUESTION} first-dir/apre
+${QUESTION} first-dir/exactly
+${QUESTION} first-dir/notig.c
+${QUESTION} first-dir/suf
+${QUESTION} first-dir/xz"
+	  rm first-dir/pre1 first-dir/apre first-dir/a.suf first-dir/suf \
+	     first-dir/exact first-dir/exactly first-dir/xaz first-dir/xz
+	  echo notig.c >first-dir/.cvsignore
+
 	  echo yes | dotest ignore-14 "${testcvs} release -d first-dir" \
 "${QUESTION} \.cvsignore
 You have \[0\] altered files in this repository.
@@ -18945,6 +19361,250 @@ $SPROG update: \`file2' is no longer in the repository"
 
 
 
+	fsmonitor)
+	  # Test the CVS_FSMONITOR environment variable, which names a
+	  # command telling CVS what has changed since it last ran.
+	  mkdir fsmonitor; cd fsmonitor
+	  cat >hook <<EOF
+#!$TESTSHELL
+expr "0\$1" + 1
+cat $TESTDIR/fsmonitor/changes
+EOF
+	  chmod +x hook
+	  : >changes
+	  mkdir 1; cd 1
+	  dotest fsmonitor-init-1 "$testcvs -Q co -l ."
+	  mkdir first-dir
+	  dotest fsmonitor-init-2 "$testcvs -Q add first-dir"
+	  cd first-dir
+	  mkdir sub
+	  echo one >file1
+	  dotest fsmonitor-init-3 "$testcvs -Q add file1 sub"
+	  echo two >sub/file2
+	  dotest fsmonitor-init-4 "$testcvs -Q add sub/file2"
+	  dotest fsmonitor-init-5 "$testcvs -Q ci -m add"
+
+	  CVS_FSMONITOR=$TESTDIR/fsmonitor/hook; export CVS_FSMONITOR
+	  dotest fsmonitor-1 "$testcvs -q up"
+	  dotest fsmonitor-2 "sed -n 1p CVS/FSMonitor" "1"
+	  dotest fsmonitor-3 "sed 1,2d CVS/FSMonitor |sort" \
+"\.
+sub"
+
+	  # Changes which the command doesn't report go unnoticed...
+	  echo junk >junk
+	  echo more >>file1
+	  touch -t 200001010000 file1
+	  dotest fsmonitor-4 "$testcvs -q up"
+	  # ...until it does.
+	  echo junk >../../changes
+	  echo ./file1 >>../../changes
+	  dotest fsmonitor-5 "$testcvs -q up" \
+"M file1
+? junk" \
+"? junk
+M file1"
+	  # Directories which aren't clean are looked at the next time, too.
+	  echo sub/new >../../changes
+	  echo new >sub/new
+	  dotest fsmonitor-6 "$testcvs -q up" \
+"M file1
+? junk
+? sub/new" \
+"? junk
+? sub/new
+M file1"
+	  dotest fsmonitor-7 "sed 1,2d CVS/FSMonitor" ""
+
+	  # A line with just a slash means everything may have changed.
+	  rm junk sub/new
+	  dotest fsmonitor-8 "$testcvs -Q up -C file1"
+	  echo / >../../changes
+	  dotest fsmonitor-9 "$testcvs -q up"
+	  dotest fsmonitor-10 "sed 1,2d CVS/FSMonitor |sort" \
+"\.
+sub"
+
+	  # With -n, the command still runs but CVS/FSMonitor is left alone.
+	  cp CVS/FSMonitor ../../saved
+	  echo ./file1 >../../changes
+	  dotest fsmonitor-10a "$testcvs -n -q up"
+	  dotest fsmonitor-10b "cmp CVS/FSMonitor ../../saved"
+
+	  # If the command fails, every file is looked at.
+	  echo more >>sub/file2
+	  touch -t 200001010000 sub/file2
+	  CVS_FSMONITOR=false
+	  dotest fsmonitor-11 "$testcvs -q up" \
+"$CPROG update: .false. failed; looking at every file
+M sub/file2"
+	  unset CVS_FSMONITOR
+
+	  dokeep
+	  cd ../../..
+	  rm -r fsmonitor
+	  modify_repo rm -rf $CVSROOT_DIRNAME/first-dir
+	  ;;
+
+
+
+	prefetch)
+	  # Test that the client asks the system to read ahead the files it
+	  # is about to send, and only those which look modified.
+	  if $remote; then :; else
+	    remoteonly prefetch
+	    continue
+	  fi
+
+	  mkdir prefetch; cd prefetch
+	  dotest prefetch-init-1 "$testcvs -Q co -l ."
+	  mkdir first-dir
+	  dotest prefetch-init-2 "$testcvs -Q add first-dir"
+	  cd first-dir
+	  mkdir sub
+	  dotest prefetch-init-3 "$testcvs -Q add sub"
+	  for i in 1 2 3; do
+	    echo $i >file$i
+	    echo $i >sub/file$i
+	  done
+	  dotest prefetch-init-4 "$testcvs -Q add file* sub/file*"
+	  dotest prefetch-init-5 "$testcvs -Q ci -m add"
+
+	  # Without arguments, update looks at each directory and reads ahead
+	  # the files whose time stamps have changed.
+	  echo more >>file2
+	  echo more >>sub/file1
+	  touch -t 200001010000 file2 sub/file1
+	  dotest prefetch-1 \
+"$testcvs -t -t -t -q up 2>&1 |sed -n 's/^.*reading ahead //p'" \
+".file2.
+.file1."
+
+	  # Commit names the files it sends, and those are read ahead.
+	  echo more >>file3
+	  touch -t 200001010000 file3
+	  dotest_sort prefetch-2 \
+"$testcvs -t -t -t -q ci -m mod 2>&1 |sed -n 's/^.*reading ahead //p'" \
+".file2.
+.file3.
+.sub/file1."
+	  dotest prefetch-3 "$testcvs -q status file3" \
+"===================================================================
+File: file3            	Status: Up-to-date
+
+   Working revision:	1\.2.*
+   Repository revision:	1\.2	$CVSROOT_DIRNAME/first-dir/file3,v
+   Commit Identifier:	${commitid}
+   Sticky Tag:		(none)
+   Sticky Date:		(none)
+   Sticky Options:	(none)"
+
+	  dokeep
+	  cd ../..
+	  rm -r prefetch
+	  modify_repo rm -rf $CVSROOT_DIRNAME/first-dir
+	  ;;
+
+
+
+	cocache)
+	  # Test $CVS_CHECKOUT_CACHE, which names a directory where base
+	  # files are kept for other checkouts.
+	  test_uses_keywords
+	  mkdir cocache; cd cocache
+	  mkdir cache; chmod go-w cache
+	  mkdir 1; cd 1
+	  dotest cocache-init-1 "$testcvs -Q co -l ."
+	  mkdir first-dir
+	  dotest cocache-init-2 "$testcvs -Q add first-dir"
+	  cd first-dir
+	  echo '$''Id$' >file1
+	  echo two >file2
+	  dotest cocache-init-3 "$testcvs -Q add file1 file2"
+	  dotest cocache-init-4 "$testcvs -Q ci -m add"
+	  cd ../..
+	  CVS_CHECKOUT_CACHE=$TESTDIR/cocache/cache
+	  export CVS_CHECKOUT_CACHE
+
+	  # Each user has a private directory in the cache.
+	  dotest cocache-1 "$testcvs -Q co -d 2 first-dir"
+	  dotest cocache-1a "ls cache" "`$ID -u`"
+	  dotest cocache-1b "ls -ld cache/*" "drwx------ .*"
+	  dotest cocache-2 "ls cache/* |wc -l |tr -d ' '" "2"
+	  dotest cocache-3 "$testcvs -Q co -d 3 first-dir"
+	  dotest cocache-4 "ls cache/* |wc -l |tr -d ' '" "2"
+	  dotest cocache-5 "cat 3/file1" \
+'\$'"Id: file1,v 1\.1 ${RCSKEYDATE} ${username} Exp "'\$'
+
+	  # Checking out the same revision again in another mode replaces the
+	  # base file rather than writing through it into the cache.
+	  cd 3
+	  dotest cocache-6 "$testcvs -Q up -kk file1"
+	  dotest cocache-7 "cat file1" '\$'"Id"'\$'
+	  cd ..
+	  dotest cocache-8 "$testcvs -Q co -d 4 first-dir"
+	  dotest cocache-9 "cat 4/file1" \
+'\$'"Id: file1,v 1\.1 ${RCSKEYDATE} ${username} Exp "'\$'
+
+	  # A change to the archive leaves its old entries unused.
+	  cd 2
+	  echo more >>file2
+	  dotest cocache-10 "$testcvs -Q ci -m more file2"
+	  cd ../3
+	  dotest cocache-11 "$testcvs -q up file2" "[UP] file2"
+	  dotest cocache-12 "cat file2" "two
+more"
+	  dotest cocache-13 "$testcvs -Q up -r1.1 file2"
+	  dotest cocache-14 "cat file2" "two"
+	  cd ..
+
+	  # Copies which could have been written to are not used.
+	  for f in cache/*/*; do
+	    chmod u+w $f; echo bad >$f
+	  done
+	  dotest cocache-15 "$testcvs -Q co -d 5 first-dir"
+	  dotest cocache-16 "cat 5/file1" \
+'\$'"Id: file1,v 1\.1 ${RCSKEYDATE} ${username} Exp "'\$'
+	  dotest cocache-17 "cat 5/file2" "two
+more"
+
+	  # Nor is a cache which others could change.
+	  chmod g+w,o+w cache
+	  dotest cocache-18 "$testcvs -Q co -d 6 first-dir" \
+"$SPROG [a-z]*: warning: not using checkout cache .$TESTDIR/cocache/cache., which others may change"
+	  chmod go-w cache
+
+	  # Nor is a relative one.
+	  CVS_CHECKOUT_CACHE=cache
+	  dotest cocache-19 "$testcvs -Q co -d 6a first-dir" \
+"$SPROG [a-z]*: warning: cannot use checkout cache .cache."
+	  CVS_CHECKOUT_CACHE=$TESTDIR/cocache/cache
+
+	  # Once an hour, the least recently used copies are removed to keep
+	  # the cache within $CVS_CHECKOUT_CACHE_SIZE.
+	  CVS_CHECKOUT_CACHE_SIZE=1
+	  export CVS_CHECKOUT_CACHE_SIZE
+	  echo junk >cache/`$ID -u`/0123456789abcdef0123456789abcdef
+	  dotest cocache-20 "$testcvs -Q co -d 7 first-dir"
+	  dotest cocache-21 \
+"test -f cache/*/0123456789abcdef0123456789abcdef"
+	  touch -t 200001010000 cache/*/.pruned
+	  dotest cocache-22 "$testcvs -Q co -d 8 first-dir"
+	  dotest_fail cocache-23 \
+"test -f cache/*/0123456789abcdef0123456789abcdef"
+	  dotest cocache-24 "cat 8/file1" \
+'\$'"Id: file1,v 1\.1 ${RCSKEYDATE} ${username} Exp "'\$'
+	  unset CVS_CHECKOUT_CACHE CVS_CHECKOUT_CACHE_SIZE
+	  test_uses_keywords_done
+
+	  dokeep
+	  cd ..
+	  rm -r cocache
+	  modify_repo rm -rf $CVSROOT_DIRNAME/first-dir
+	  ;;
+
+
+
 	binfiles)
 	  # Test cvs's ability to handle binary files.
 	  # List of binary file tests:
@@ -19497,6 +20157,46 @@ done"
 
 
 
+	binfiles4)
+	  # Test sending files larger than the block size send_modified
+	  # reads at a time.
+	  mkdir binfiles4; cd binfiles4
+	  mkdir 1; cd 1
+	  dotest binfiles4-init-1 "$testcvs -Q co -l ."
+	  mkdir first-dir
+	  dotest binfiles4-init-2 "$testcvs -Q add first-dir"
+	  cd first-dir
+	  awk 'BEGIN { for (i = 0; i < 20000; i++) print "line " i }' </dev/null \
+	    >text
+	  tr 'l' '\000' <text >binary
+	  dotest binfiles4-init-3 "$testcvs -Q add text"
+	  dotest binfiles4-init-4 "$testcvs -Q add -kb binary"
+	  dotest binfiles4-1 "$testcvs -Q ci -m add"
+	  echo more >>text
+	  echo more >>binary
+	  dotest binfiles4-2 "$testcvs -Q -z3 ci -m more"
+	  cp text ../../text
+	  cp binary ../../binary
+	  cd ../..
+
+	  mkdir 2; cd 2
+	  dotest binfiles4-3 "$testcvs -Q co first-dir"
+	  dotest binfiles4-4 "cmp ../text first-dir/text"
+	  dotest binfiles4-5 "cmp ../binary first-dir/binary"
+	  dotest binfiles4-6 "wc -l <first-dir/text |tr -d ' '" "20001"
+	  # And receiving them.
+	  dotest binfiles4-7 "$testcvs -Q -z3 co -d z first-dir"
+	  dotest binfiles4-8 "cmp ../text z/text"
+	  dotest binfiles4-9 "cmp ../binary z/binary"
+
+	  dokeep
+	  cd ../..
+	  rm -r binfiles4
+	  modify_repo rm -rf $CVSROOT_DIRNAME/first-dir
+	  ;;
+
+
+
 	mcopy)
 	  # See comment at "mwrap" test for list of other wrappers tests.
 	  # Test cvs's ability to handle nonmergeable files specified with
@@ -23231,6 +23931,48 @@ ${CVSROOT_DIRNAME}/first-dir/file1,v"
 ${SPROG} log: Logging first-dir
 ${CVSROOT_DIRNAME}/first-dir/file1,v"
 
+	  # Selecting by state reads the whole file before printing.
+	  cd first-dir
+	  echo ho >>file1
+	  dotest logopt-8 "$testcvs -q ci -m mod file1" \
+"$CVSROOT_DIRNAME/first-dir/file1,v  <--  file1
+new revision: 1\.2; previous revision: 1\.1"
+	  dotest logopt-9 "$testcvs log -s Exp file1" \
+"
+RCS file: $CVSROOT_DIRNAME/first-dir/file1,v
+Working file: file1
+head: 1\.2
+branch:
+locks: strict
+access list:
+symbolic names:
+keyword substitution: kv
+total revisions: 2;	selected revisions: 2
+description:
+----------------------------
+revision 1\.2
+date: ${ISO8601DATE};  author: $username;  state: Exp;  lines: +1 -0;  commitid: ${commitid};
+${log_keyid}mod
+----------------------------
+revision 1\.1
+date: ${ISO8601DATE};  author: $username;  state: Exp;  commitid: ${commitid};
+${log_keyid}add
+============================================================================="
+	  dotest logopt-10 "$testcvs log -s dead file1" \
+"
+RCS file: $CVSROOT_DIRNAME/first-dir/file1,v
+Working file: file1
+head: 1\.2
+branch:
+locks: strict
+access list:
+symbolic names:
+keyword substitution: kv
+total revisions: 2;	selected revisions: 0
+description:
+============================================================================="
+	  cd ..
+
 	  dokeep
 	  cd ..
 	  rm -r 1
@@ -23504,6 +24246,175 @@ Annotations for $file
 
 
 
+	anncache)
+	  # Test the AnnotateCache config option, which keeps the line
+	  # origins of annotated revisions in the repository.
+	  mkdir anncache; cd anncache
+	  dotest anncache-init-1 "$testcvs -Q co -l ."
+	  mkdir first-dir
+	  dotest anncache-init-2 "$testcvs -Q add first-dir"
+	  cd first-dir
+	  echo "one
+two
+three" >file1
+	  dotest anncache-init-3 "$testcvs -Q add file1"
+	  dotest anncache-init-4 "$testcvs -Q ci -m add file1"
+	  echo "one
+two changed
+three" >file1
+	  dotest anncache-init-5 "$testcvs -Q ci -m modify file1"
+
+	  cd ../..
+	  mkdir config; cd config
+	  dotest anncache-init-6 "$testcvs -Q co CVSROOT"
+	  cd CVSROOT
+	  echo "AnnotateCache=yes" >>config
+	  dotest anncache-init-7 "$testcvs -Q ci -mannotatecache"
+	  cd ../../anncache/first-dir
+
+	  dotest anncache-1 "$testcvs -Q ann file1" \
+"
+Annotations for file1
+\*\*\*\*\*\*\*\*\*\*\*\*\*\*\*
+1\.1          (${username8} *[0-9a-zA-Z-]*): one
+1\.2          (${username8} *[0-9a-zA-Z-]*): two changed
+1\.1          (${username8} *[0-9a-zA-Z-]*): three"
+	  dotest anncache-2 "test -f $CVSROOT_DIRNAME/first-dir/CVS/annotate/file1,v"
+	  # Once more from the cache.
+	  dotest anncache-3 "$testcvs -Q ann file1" \
+"
+Annotations for file1
+\*\*\*\*\*\*\*\*\*\*\*\*\*\*\*
+1\.1          (${username8} *[0-9a-zA-Z-]*): one
+1\.2          (${username8} *[0-9a-zA-Z-]*): two changed
+1\.1          (${username8} *[0-9a-zA-Z-]*): three"
+
+	  # A new revision picks up where the cached one leaves off.
+	  echo four >>file1
+	  dotest anncache-4 "$testcvs -Q ci -m add-line file1"
+	  dotest anncache-5 "$testcvs -Q ann file1" \
+"
+Annotations for file1
+\*\*\*\*\*\*\*\*\*\*\*\*\*\*\*
+1\.1          (${username8} *[0-9a-zA-Z-]*): one
+1\.2          (${username8} *[0-9a-zA-Z-]*): two changed
+1\.1          (${username8} *[0-9a-zA-Z-]*): three
+1\.3          (${username8} *[0-9a-zA-Z-]*): four"
+	  dotest anncache-6 "$testcvs -Q ann -r1.1 file1" \
+"
+Annotations for file1
+\*\*\*\*\*\*\*\*\*\*\*\*\*\*\*
+1\.1          (${username8} *[0-9a-zA-Z-]*): one
+1\.1          (${username8} *[0-9a-zA-Z-]*): two
+1\.1          (${username8} *[0-9a-zA-Z-]*): three"
+
+	  # Outdating a revision which the cache names makes the cached
+	  # line origins useless.
+	  dotest anncache-7 "$testcvs -Q admin -o1.2 file1" \
+"deleting revision 1\.2"
+	  dotest anncache-8 "$testcvs -Q ann file1" \
+"
+Annotations for file1
+\*\*\*\*\*\*\*\*\*\*\*\*\*\*\*
+1\.1          (${username8} *[0-9a-zA-Z-]*): one
+1\.3          (${username8} *[0-9a-zA-Z-]*): two changed
+1\.1          (${username8} *[0-9a-zA-Z-]*): three
+1\.3          (${username8} *[0-9a-zA-Z-]*): four"
+
+	  # A damaged cache is ignored.
+	  echo "1.3 garbage" >$CVSROOT_DIRNAME/first-dir/CVS/annotate/file1,v
+	  dotest anncache-9 "$testcvs -Q ann file1" \
+"
+Annotations for file1
+\*\*\*\*\*\*\*\*\*\*\*\*\*\*\*
+1\.1          (${username8} *[0-9a-zA-Z-]*): one
+1\.3          (${username8} *[0-9a-zA-Z-]*): two changed
+1\.1          (${username8} *[0-9a-zA-Z-]*): three
+1\.3          (${username8} *[0-9a-zA-Z-]*): four"
+
+	  dokeep
+	  cd ../..
+	  restore_adm
+	  rm -r anncache config
+	  modify_repo rm -rf $CVSROOT_DIRNAME/first-dir
+	  ;;
+
+
+
+	digestcache)
+	  # Test the DigestCache config option, which keeps digests of the
+	  # revisions that files with new timestamps are compared with.
+	  test_uses_keywords
+	  mkdir digestcache; cd digestcache
+	  dotest digestcache-init-1 "$testcvs -Q co -l ."
+	  mkdir first-dir
+	  dotest digestcache-init-2 "$testcvs -Q add first-dir"
+	  cd first-dir
+	  echo '$''Revision$' >file1
+	  echo one >file2
+	  dotest digestcache-init-3 "$testcvs -Q add file1 file2"
+	  dotest digestcache-init-4 "$testcvs -Q ci -m add"
+	  echo two >file2
+	  dotest digestcache-init-5 "$testcvs -Q ci -m modify"
+
+	  cd ../..
+	  mkdir config; cd config
+	  dotest digestcache-init-6 "$testcvs -Q co CVSROOT"
+	  cd CVSROOT
+	  echo "DigestCache=yes" >>config
+	  dotest digestcache-init-7 "$testcvs -Q ci -mdigestcache"
+	  cd ../../digestcache/first-dir
+
+	  # Files which are only touched are still up to date, and the
+	  # revisions they were compared with are remembered.
+	  touch -t 200001010000 file1 file2
+	  dotest digestcache-1 "$testcvs -q up"
+	  dotest digestcache-2 \
+"test -f $CVSROOT_DIRNAME/first-dir/CVS/digest/file1,v"
+	  dotest digestcache-3 \
+"test -f $CVSROOT_DIRNAME/first-dir/CVS/digest/file2,v"
+	  # Once more from the cache.
+	  touch -t 200001020000 file1 file2
+	  dotest digestcache-4 "$testcvs -q up"
+	  dotest digestcache-5 "cat file1" '\$''Revision: 1\.1 \$'
+
+	  # A change which keeps the size is still noticed.
+	  echo tWo >file2
+	  touch -t 200001030000 file2
+	  dotest digestcache-6 "$testcvs -q status file2" \
+"===================================================================
+File: file2            	Status: Locally Modified
+
+   Working revision:	1\.2.*
+   Repository revision:	1\.2	$CVSROOT_DIRNAME/first-dir/file2,v
+   Commit Identifier:	${commitid}
+   Sticky Tag:		(none)
+   Sticky Date:		(none)
+   Sticky Options:	(none)"
+	  echo two >file2
+	  touch -t 200001040000 file2
+	  dotest digestcache-7 "$testcvs -q up file2"
+
+	  # As is a change to the expansion of a keyword.
+	  dotest digestcache-8 "$testcvs -Q admin -kk file1"
+	  touch -t 200001050000 file1
+	  dotest digestcache-9 "$testcvs -q up file1" "M file1"
+
+	  # A damaged cache is ignored.
+	  echo "garbage" >$CVSROOT_DIRNAME/first-dir/CVS/digest/file2,v
+	  touch -t 200001060000 file2
+	  dotest digestcache-10 "$testcvs -q up file2"
+
+	  dokeep
+	  cd ../..
+	  restore_adm
+	  rm -r digestcache config
+	  modify_repo rm -rf $CVSROOT_DIRNAME/first-dir
+	  test_uses_keywords_done
+	  ;;
+
+
+
 	crerepos)
 	  # Various tests relating to creating repositories, operating
 	  # on repositories created with old versions of CVS, etc.
@@ -24505,6 +25416,21 @@ EOF
 	  modify_repo mv $TESTDIR/file1,v $CVSROOT_DIRNAME/first-dir/file1,v
 	  dotest_fail rcs3-7 "${testcvs} log -s nostate file1" \
 "${SPROG} \[log aborted\]: unexpected '.x0' reading revision number in RCS file ${CVSROOT_DIRNAME}/first-dir/file1,v"
+	  # Without -s, the delta texts are only read once the header has
+	  # been written.
+	  dotest_fail rcs3-7a "${testcvs} log file1" \
+"
+RCS file: ${CVSROOT_DIRNAME}/first-dir/file1,v
+Working file: file1
+head: 1\.1
+branch:
+locks:
+access list:
+symbolic names:
+keyword substitution: o
+total revisions: 1;	selected revisions: 1
+description:
+${SPROG} \[log aborted\]: unexpected '.x0' reading revision number in RCS file ${CVSROOT_DIRNAME}/first-dir/file1,v"
 
 	  dokeep
 	  cd ../..
@@ -38480,7 +39406,8 @@ You have \[0\] altered files in this repository\."
     fi
 
     # Reset val-tags to a pristine state.
-    modify_repo rm -f $CVSROOT_DIRNAME/CVSROOT/val-tags
+    modify_repo rm -f $CVSROOT_DIRNAME/CVSROOT/val-tags \
+		      $CVSROOT_DIRNAME/CVSROOT/val-tags.idx
 
     verify_tmp_empty "post $what"
 
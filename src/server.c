@@ -32,6 +32,7 @@
 #include "base.h"
 #include "buffer.h"
 #include "command_line_opt.h"
+#include "difflib.h"
 #include "edit.h"
 #include "fileattr.h"
 #include "gpg.h"
@@ -5277,8 +5278,16 @@ server_updated (
 	    if (node != NULL)
 	    {
 		Entnode *entnode = node->data;
-		free (entnode->timestamp);
-		entnode->timestamp = xstrdup ("=");
+		/* An entry loaded from CVS/Entries.idx points into the
+		   list's pool, which is freed with the list.  */
+		if (node->flags & NODE_DATA_POOLED)
+		    entnode->timestamp = list_strdup (finfo->entries, "=");
+		else
+		{
+		    free (entnode->timestamp);
+		    entnode->timestamp = xstrdup ("=");
+		}
+		entnode->mtime = parse_entries_time (entnode->timestamp);
 	    }
 	}
 	else if (updated == SERVER_MERGED)
@@ -7792,6 +7801,8 @@ cvs_output (const char *str, size_t len)
 {
     if (len == 0)
 	len = strlen (str);
+    if (diff_job_capture ('M', str, len))
+	return;
 #ifdef SERVER_SUPPORT
     if (error_use_protocol)
     {
@@ -7939,6 +7950,8 @@ cvs_outerr (const char *str, size_t len)
 {
     if (len == 0)
 	len = strlen (str);
+    if (diff_job_capture ('E', str, len))
+	return;
 #ifdef SERVER_SUPPORT
     if (error_use_protocol)
     {
@@ -8003,6 +8016,9 @@ cvs_outerr (const char *str, size_t len)
 void
 cvs_flusherr (void)
 {
+    /* A diff worker's output is held back until the parent replays it.  */
+    if (diff_job_worker ())
+	return;
 #ifdef SERVER_SUPPORT
     if (error_use_protocol)
     {
@@ -8034,6 +8050,8 @@ cvs_flusherr (void)
 void
 cvs_flushout (void)
 {
+    if (diff_job_worker ())
+	return;
 #ifdef SERVER_SUPPORT
     if (error_use_protocol)
     {
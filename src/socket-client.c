@@ -37,8 +37,8 @@
    SOCK_STRERROR macros. */
 
 /* These routines implement a buffer structure which uses send and
-   recv.  The buffer is always in blocking mode so we don't implement
-   the block routine.  */
+   recv.  The socket itself is always in blocking mode; in nonblocking
+   mode the input routine polls it with select before calling recv.  */
 
 /* Note that it is important that these routines always handle errors
    internally and never return a positive errno code, since it would in
@@ -52,6 +52,9 @@ struct socket_buffer
 {
     /* The socket number.  */
     int socket;
+
+    /* Whether the buffer is in nonblocking mode.  */
+    bool nonblocking;
 };
 
 
@@ -76,6 +79,25 @@ socket_buffer_input (void *closure, char *data, size_t need, size_t size,
 
     *got = 0;
 
+    if (sb->nonblocking && need == 0)
+    {
+	fd_set readfds;
+	struct timeval timeout;
+	int numfds;
+
+	/* Return at once unless there is something to read.  */
+	FD_ZERO (&readfds);
+	FD_SET (sb->socket, &readfds);
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 0;
+	numfds = select (sb->socket + 1, &readfds, NULL, NULL, &timeout);
+	if (numfds < 0)
+	    error (1, 0, "reading from server: %s",
+		   SOCK_STRERROR (SOCK_ERRNO));
+	if (numfds == 0)
+	    return 0;
+    }
+
     do
     {
 
@@ -113,6 +135,19 @@ socket_buffer_input (void *closure, char *data, size_t need, size_t size,
 
 
 
+/* The buffer block function for a buffer built on a socket.  */
+
+static int
+socket_buffer_block (void *closure, bool block)
+{
+    struct socket_buffer *sb = closure;
+
+    sb->nonblocking = !block;
+    return 0;
+}
+
+
+
 /* The buffer output function for a buffer built on a socket.  */
 
 static int
@@ -229,10 +264,11 @@ socket_buffer_initialize (int socket, int input,
 {
     struct socket_buffer *sbuf = xmalloc (sizeof *sbuf);
     sbuf->socket = socket;
+    sbuf->nonblocking = false;
     return buf_initialize (input ? socket_buffer_input : NULL,
 			   input ? NULL : socket_buffer_output,
 			   input ? NULL : socket_buffer_flush,
-			   NULL, NULL,
+			   input ? socket_buffer_block : NULL, NULL,
 			   socket_buffer_shutdown,
 			   memory,
 			   sbuf);
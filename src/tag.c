@@ -1453,7 +1453,10 @@ val_fileproc (void *callerdat, struct file_info *finfo)
 
 /* This routine determines whether a tag appears in CVSROOT/val-tags.
  *
- * The val-tags file will be open read-only when IDB is NULL.  Since writes to
+ * The val-tags file will be open read-only when IDB is NULL, in which case
+ * its hashed index is used if it is current (see write_val_tags_index), and
+ * otherwise the parsed file is shared with earlier lookups in this process
+ * for as long as val-tags is unchanged on disk.  Since writes to
  * val-tags always append to it, the lack of locking is okay.  The worst case
  * race condition might misinterpret a partially written "foobar" matched, for
  * instance,  a request for "f", "foo", of "foob".  Such a mismatch would be
@@ -1553,6 +1556,39 @@ static int is_in_val_tags (DBM **idb, const char *name)
 
 
 
+#ifdef MY_NDBM
+/* Rebuild the hashed index of val-tags, which is named FILENAME and has just
+ * been written, so that later read-only lookups in any process need not parse
+ * the whole file.  The caller must hold the val-tags lock.  The index is only
+ * a cache, so failures are warnings and leave any old index to be ignored as
+ * stale.
+ */
+static void
+write_val_tags_index (const char *filename)
+{
+    char *temp, *index;
+    mode_t omask;
+
+    index = Xasprintf ("%s%s", filename, MYDBM_INDEX_SUFFIX);
+    temp = Xasprintf ("%s.%ld", index, (long) getpid ());
+
+    omask = umask (cvsumask);
+    if (mydbm_write_index ((char *) filename, temp)
+	&& CVS_RENAME (temp, index) < 0)
+    {
+	error (0, errno, "cannot rename %s to %s", temp, index);
+	if (unlink_file (temp) < 0 && !existence_error (errno))
+	    error (0, errno, "cannot remove %s", temp);
+    }
+    umask (omask);
+
+    free (temp);
+    free (index);
+}
+#endif /* MY_NDBM */
+
+
+
 /* Add a tag to the CVSROOT/val-tags cache.  Establishes a write lock and
  * reverifies that the tag does not exist before adding it.
  */
@@ -1587,6 +1623,16 @@ static void add_to_val_tags (const char *name)
 	error (0, errno, "failed to store %s into val-tags", name);
     dbm_close (db);
 
+#ifdef MY_NDBM
+    {
+	char *valtags_filename = Xasprintf ("%s/%s/%s",
+					    current_parsed_root->directory,
+					    CVSROOTADM, CVSROOTADM_VALTAGS);
+	write_val_tags_index (valtags_filename);
+	free (valtags_filename);
+    }
+#endif /* MY_NDBM */
+
     clear_val_tags_lock ();
 }
 
@@ -17,10 +17,13 @@
 
 #include "cvs.h"
 #include "lstat.h"
+#include "quote.h"
 
 #ifdef SERVER_SUPPORT
 static void time_stamp_server (const char *, Vers_TS *, Entnode *);
 #endif
+static char *entry_time_stamp (const char *, const Entnode *);
+static bool fsmonitor_active;
 
 /* Fill in and return a Vers_TS structure for the file FINFO.
  *
@@ -277,7 +280,23 @@ Version_TS (struct file_info *finfo, const char *options, const char *tag,
 	    time_stamp_server (finfo->file, vers_ts, entdata);
 	else
 #endif
-	    vers_ts->ts_user = time_stamp (finfo->file);
+	if (fsmonitor_active)
+	{
+	    /* Only look at files which may have changed since they last
+	       matched their entries.  */
+	    if (vers_ts->ts_rcs != NULL && vers_ts->ts_conflict == NULL
+		&& fsmonitor_unchanged (finfo->update_dir))
+		vers_ts->ts_user = xstrdup (vers_ts->ts_rcs);
+	    else
+	    {
+		vers_ts->ts_user = entry_time_stamp (finfo->file, entdata);
+		if (vers_ts->ts_user == NULL || vers_ts->ts_rcs == NULL
+		    || !STREQ (vers_ts->ts_user, vers_ts->ts_rcs))
+		    fsmonitor_dirty (finfo->update_dir);
+	    }
+	}
+	else
+	    vers_ts->ts_user = entry_time_stamp (finfo->file, entdata);
     }
 
     return vers_ts;
@@ -388,6 +407,102 @@ entries_time (time_t unixtime)
 
 
 
+/* The inverse of entries_time: given TIMESTAMP from the Entries file, return
+ * the seconds since the epoch it stands for.
+ *
+ * RETURNS
+ *   The time, or -1 if TIMESTAMP is not exactly what entries_time would
+ *   return for it.  This includes every timestamp on systems where
+ *   entries_time has to use local time.
+ */
+time_t
+parse_entries_time (const char *timestamp)
+{
+    static const char days[] = "ThuFriSatSunMonTueWed";
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    static const int mdays[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    static int utc = -1;
+    const char *cp = timestamp;
+    int i, mon, mday, hour, min, sec, year, y, yoe, doy;
+    long era, ndays;
+    intmax_t secs;
+    time_t t;
+
+    if (utc < 0)
+    {
+	time_t zero = 0;
+	utc = gmtime (&zero) != NULL;
+    }
+    if (!utc)
+	return -1;
+
+    /* "Www Mmm dd hh:mm:ss yyyy", where the day may have a leading space
+       instead of a leading zero.  */
+    for (i = 0; i < 24; i++)
+    {
+	switch (i)
+	{
+	    case 3: case 7: case 10: case 19:
+		if (cp[i] != ' ')
+		    return -1;
+		break;
+	    case 13: case 16:
+		if (cp[i] != ':')
+		    return -1;
+		break;
+	    case 0: case 1: case 2: case 4: case 5: case 6:
+		if (!cp[i])
+		    return -1;
+		break;
+	    case 8:
+		if (cp[i] != ' ' && !isdigit ((unsigned char) cp[i]))
+		    return -1;
+		break;
+	    default:
+		if (!isdigit ((unsigned char) cp[i]))
+		    return -1;
+		break;
+	}
+    }
+    if (cp[24])
+	return -1;
+
+    for (mon = 0; mon < 12; mon++)
+	if (STRNEQ (cp + 4, months + 3 * mon, 3))
+	    break;
+    mday = (cp[8] == ' ' ? 0 : cp[8] - '0') * 10 + cp[9] - '0';
+    hour = (cp[11] - '0') * 10 + cp[12] - '0';
+    min = (cp[14] - '0') * 10 + cp[15] - '0';
+    sec = (cp[17] - '0') * 10 + cp[18] - '0';
+    year = atoi (cp + 20);
+    if (mon == 12 || mday < 1 || mday > mdays[mon]
+	|| (cp[8] == '0') || (cp[8] == ' ' && mday > 9)
+	|| hour > 23 || min > 59 || sec > 59)
+	return -1;
+    if (mon == 1 && mday == 29
+	&& (year % 4 || (year % 100 == 0 && year % 400)))
+	return -1;
+
+    /* Count the days since the epoch, with years starting in March so that
+       leap days come last.  */
+    y = year - (mon < 2);
+    era = y / 400;
+    yoe = y - era * 400;
+    doy = (153 * ((mon + 10) % 12) + 2) / 5 + mday - 1;
+    ndays = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+    if (ndays < 0 || !STRNEQ (cp, days + 3 * (ndays % 7), 3))
+	return -1;
+
+    secs = (intmax_t) ndays * 86400 + hour * 3600 + min * 60 + sec;
+    t = secs;
+    if (t != secs)
+	/* Doesn't fit.  */
+	return -1;
+    return t;
+}
+
+
+
 time_t
 unix_time_stamp (const char *file)
 {
@@ -430,6 +545,25 @@ time_stamp (const char *file)
 
 
 
+/* Like time_stamp, but when FILE still has the time stamp ENTDATA records,
+ * which is the usual case, copy that instead of formatting it again.  An
+ * entry whose timestamp is not a time, such as "Result of merge", has an
+ * mtime of -1, which must not match a file that happens to have that time.
+ */
+static char *
+entry_time_stamp (const char *file, const Entnode *entdata)
+{
+    time_t mtime = unix_time_stamp (file);
+
+    if (!mtime)
+	return NULL;
+    if (entdata && entdata->mtime != (time_t) -1 && entdata->mtime == mtime)
+	return xstrdup (entdata->timestamp);
+    return entries_time (mtime);
+}
+
+
+
 /*
  * free up a Vers_TS struct
  */
@@ -459,3 +593,361 @@ freevers_ts (Vers_TS **versp)
     free ((char *) *versp);
     *versp = NULL;
 }
+
+
+
+/*
+ * Working directory change monitor.
+ *
+ * When FSMONITOR_ENV names a command, CVS runs it at startup, in the
+ * directory it was started in, with the token it printed the last time as
+ * its argument.  It is expected to print a new token, followed by the paths,
+ * relative to that directory, of everything which has changed since the old
+ * token, one per line.  A watcher like inotify or watchman can answer that
+ * without looking at the working directory at all.
+ *
+ * CVS/FSMonitor keeps the token, the ignore list in effect and the
+ * directories whose files all matched their entries, with nothing unknown
+ * beside them, when last looked at.  As long as nothing in such a directory
+ * has changed since, Version_TS takes the time stamps of its files from
+ * CVS/Entries instead of stating them, and ignore_files doesn't list it.
+ */
+
+/* What we know about a directory.  */
+struct fsmonitor_dir
+{
+    bool clean;		/* Clean as of the last run.  */
+    bool changed;	/* Something in it changed since the last run.  */
+    bool dirty;		/* A file in it didn't match its entry this run.  */
+    bool scanned;	/* ignore_files listed it this run.  */
+};
+
+static char *fsmonitor_file;	/* Where to save the state, or NULL if the
+				 * last run's token was no good.  */
+static char *fsmonitor_token;	/* The token for this run.  */
+static char *fsmonitor_ignores;	/* The ignore list of the last run.  */
+static bool fsmonitor_ignores_changed;
+static List *fsmonitor_dirs;	/* struct fsmonitor_dirs by update_dir.  */
+
+
+
+/* Return the node for the directory UPDATE_DIR, creating it if need be.  */
+static struct fsmonitor_dir *
+fsmonitor_dir (const char *update_dir)
+{
+    Node *p;
+
+    if (STREQ (update_dir, "."))
+	update_dir = "";
+    p = findnode_fn (fsmonitor_dirs, update_dir);
+    if (p == NULL)
+    {
+	p = getnode ();
+	p->key = xstrdup (update_dir);
+	p->data = xzalloc (sizeof (struct fsmonitor_dir));
+	addnode (fsmonitor_dirs, p);
+    }
+    return p->data;
+}
+
+
+
+/* Mark the directory containing PATH as changed.  Since anything under a CVS
+ * directory is about the directory containing that, look past it as well.
+ */
+static void
+fsmonitor_changed (char *path)
+{
+    char *slash;
+
+    while (path[0] == '.' && path[1] == '/')
+	path += 2;
+    strip_trailing_slashes (path);
+    fsmonitor_dir (path)->changed = true;
+    slash = strrchr (path, '/');
+    if (slash == NULL)
+	path[0] = '\0';
+    else
+	*slash = '\0';
+    fsmonitor_dir (path)->changed = true;
+    if (STREQ (last_component (path), CVSADM))
+	fsmonitor_changed (path);
+}
+
+
+
+/* Forget that a directory was clean.  This is called via walklist.  */
+static int
+fsmonitor_forget_proc (Node *p, void *closure)
+{
+    ((struct fsmonitor_dir *) p->data)->clean = false;
+    return 0;
+}
+
+
+
+/*
+ * Ask the command named by FSMONITOR_ENV, if any, what has changed in the
+ * working directory since the last run.
+ */
+void
+fsmonitor_setup (void)
+{
+    const char *hook = getenv (FSMONITOR_ENV);
+    char *line = NULL;
+    size_t line_allocated = 0;
+    char *cwd, *cmdline, *escaped;
+    char *old_token = NULL;
+    ssize_t len;
+    FILE *fp;
+    int status;
+
+    if (hook == NULL || *hook == '\0' || !isdir (CVSADM))
+	return;
+
+    cwd = xgetcwd ();
+    if (cwd == NULL)
+	return;
+    fsmonitor_file = Xasprintf ("%s/%s", cwd, CVSADM_FSMONITOR);
+    free (cwd);
+    fsmonitor_dirs = getlist ();
+
+    /* Read what we knew at the end of the last run.  */
+    fp = CVS_FOPEN (fsmonitor_file, "r");
+    if (fp != NULL)
+    {
+	int lineno = 0;
+
+	while ((len = getline (&line, &line_allocated, fp)) >= 0)
+	{
+	    if (len > 0 && line[len - 1] == '\n')
+		line[--len] = '\0';
+	    if (lineno == 0)
+		old_token = xstrdup (line);
+	    else if (lineno == 1)
+		fsmonitor_ignores = xstrdup (line);
+	    else
+		fsmonitor_dir (line)->clean = true;
+	    lineno++;
+	}
+	if (ferror (fp))
+	    error (0, errno, "cannot read %s", fsmonitor_file);
+	if (fclose (fp) < 0)
+	    error (0, errno, "cannot close %s", fsmonitor_file);
+	if (lineno < 2)
+	    walklist (fsmonitor_dirs, fsmonitor_forget_proc, NULL);
+    }
+    else if (!existence_error (errno))
+	error (0, errno, "cannot open %s", fsmonitor_file);
+
+    /* Ask for the changes since then.  This changes nothing, so unlike
+       run_popen, run it even with -n.  */
+    escaped = xmalloc (2 * strlen (old_token ? old_token : "") + 1);
+    shell_escape (escaped, old_token ? old_token : "");
+    cmdline = Xasprintf ("%s \"%s\"", hook, escaped);
+    free (escaped);
+
+    TRACE (TRACE_FUNCTION, "fsmonitor_setup: running %s", cmdline);
+    fp = popen (cmdline, "r");
+    if (fp == NULL)
+	error (0, errno, "cannot run %s", quote (hook));
+    else
+    {
+	while ((len = getline (&line, &line_allocated, fp)) >= 0)
+	{
+	    if (len > 0 && line[len - 1] == '\n')
+		line[--len] = '\0';
+	    if (fsmonitor_token == NULL)
+		fsmonitor_token = xstrdup (line);
+	    else if (STREQ (line, "/"))
+		/* Everything may have changed.  */
+		walklist (fsmonitor_dirs, fsmonitor_forget_proc, NULL);
+	    else if (line[0] != '\0')
+		fsmonitor_changed (line);
+	}
+	status = pclose (fp);
+	if (status != 0)
+	{
+	    error (0, 0, "%s failed; looking at every file", quote (hook));
+	    if (fsmonitor_token != NULL)
+	    {
+		free (fsmonitor_token);
+		fsmonitor_token = NULL;
+	    }
+	}
+    }
+    free (cmdline);
+    free (line);
+
+    if (old_token == NULL || fsmonitor_token == NULL)
+	walklist (fsmonitor_dirs, fsmonitor_forget_proc, NULL);
+    if (old_token != NULL)
+	free (old_token);
+
+    if (fsmonitor_token == NULL)
+    {
+	dellist (&fsmonitor_dirs);
+	free (fsmonitor_file);
+	fsmonitor_file = NULL;
+	return;
+    }
+
+    fsmonitor_active = true;
+}
+
+
+
+/* Return true if the files in UPDATE_DIR are known to match their entries
+ * without looking at them.
+ */
+bool
+fsmonitor_unchanged (const char *update_dir)
+{
+    Node *p;
+    struct fsmonitor_dir *d;
+
+    if (!fsmonitor_active)
+	return false;
+
+    /* The monitor only knows about what is under the directory we were
+       started in.  */
+    if (ISABSOLUTE (update_dir) || strstr (update_dir, "..") != NULL)
+	return false;
+
+    if (STREQ (update_dir, "."))
+	update_dir = "";
+    p = findnode_fn (fsmonitor_dirs, update_dir);
+    if (p == NULL)
+	return false;
+    d = p->data;
+    return d->clean && !d->changed && !d->dirty;
+}
+
+
+
+/* Return true if IGNORES, the ignore list of this run, is the same as the
+ * one the directories were last found clean with, so that ignore_files can
+ * skip those still unchanged.  IGNORES may be NULL if it isn't known.
+ */
+bool
+fsmonitor_same_ignores (const char *ignores)
+{
+    static bool checked;
+
+    if (!fsmonitor_active)
+	return false;
+
+    if (!checked)
+    {
+	checked = true;
+	if (ignores == NULL || fsmonitor_ignores == NULL
+	    || !STREQ (ignores, fsmonitor_ignores))
+	{
+	    if (fsmonitor_ignores != NULL)
+		free (fsmonitor_ignores);
+	    fsmonitor_ignores = ignores ? xstrdup (ignores) : NULL;
+	    fsmonitor_ignores_changed = true;
+	}
+    }
+    return !fsmonitor_ignores_changed;
+}
+
+
+
+/* Note that a file in UPDATE_DIR did not match its entry.  */
+void
+fsmonitor_dirty (const char *update_dir)
+{
+    if (fsmonitor_active)
+	fsmonitor_dir (update_dir)->dirty = true;
+}
+
+
+
+/* Note that ignore_files has been through UPDATE_DIR, and whether it found
+ * nothing to report there.
+ */
+void
+fsmonitor_scanned (const char *update_dir, bool clean)
+{
+    struct fsmonitor_dir *d;
+
+    if (!fsmonitor_active)
+	return;
+
+    d = fsmonitor_dir (update_dir);
+    if (clean)
+	d->scanned = true;
+    else
+	d->dirty = true;
+}
+
+
+
+/* Write a directory to the state file if it is clean.  This is called via
+ * walklist.
+ */
+static int
+fsmonitor_save_proc (Node *p, void *closure)
+{
+    FILE *fp = closure;
+    struct fsmonitor_dir *d = p->data;
+
+    if (d->dirty || strchr (p->key, '\n') != NULL)
+	return 0;
+    if (d->scanned
+	|| (d->clean && !d->changed && !fsmonitor_ignores_changed))
+    {
+	fputs (p->key[0] == '\0' ? "." : p->key, fp);
+	putc ('\n', fp);
+    }
+    return 0;
+}
+
+
+
+/*
+ * Save the token for the next run and the directories which are known to
+ * be clean now in CVS/FSMonitor.  With -n, CVS/FSMonitor is left alone, so
+ * the next run asks the command for the changes since the same old token.
+ */
+void
+fsmonitor_finish (void)
+{
+    char *tmp;
+    FILE *fp;
+
+    if (!fsmonitor_active)
+	return;
+    fsmonitor_active = false;
+
+    if (!noexec)
+    {
+	tmp = Xasprintf ("%s.tmp", fsmonitor_file);
+	fp = CVS_FOPEN (tmp, "w");
+	if (fp == NULL)
+	    error (0, errno, "cannot write %s", tmp);
+	else
+	{
+	    fprintf (fp, "%s\n%s\n", fsmonitor_token,
+		     fsmonitor_ignores ? fsmonitor_ignores : "");
+	    if (fsmonitor_ignores != NULL)
+		walklist (fsmonitor_dirs, fsmonitor_save_proc, fp);
+	    if (fclose (fp) == EOF)
+		error (0, errno, "cannot close %s", tmp);
+	    else if (CVS_RENAME (tmp, fsmonitor_file) < 0)
+		error (0, errno, "cannot rename %s to %s", tmp,
+		       fsmonitor_file);
+	}
+	free (tmp);
+    }
+
+    dellist (&fsmonitor_dirs);
+    free (fsmonitor_file);
+    fsmonitor_file = NULL;
+    free (fsmonitor_token);
+    fsmonitor_token = NULL;
+    if (fsmonitor_ignores != NULL)
+	free (fsmonitor_ignores);
+    fsmonitor_ignores = NULL;
+}
@@ -98,4 +98,11 @@ Vers_TS *Version_TS (struct file_info *finfo, const char *options,
 void freevers_ts (Vers_TS **versp);
 char *time_stamp (const char *file);
 
+void fsmonitor_setup (void);
+bool fsmonitor_unchanged (const char *update_dir);
+bool fsmonitor_same_ignores (const char *ignores);
+void fsmonitor_dirty (const char *update_dir);
+void fsmonitor_scanned (const char *update_dir, bool clean);
+void fsmonitor_finish (void);
+
 #endif /* VERS_TS_H */
@@ -20,6 +20,8 @@
 #include "wrapper.h"
 
 /* CVS headers.  */
+#include "ignore.h"
+
 #include "cvs.h"
 
 
@@ -84,6 +86,11 @@ static int wrap_saved_count=0;
 
 static int wrap_saved_tempcount=0;
 
+/* The wildcards of WRAP_LIST compiled for wrap_match, or NULL if the list
+ * has changed since.
+ */
+static struct wildcard_set *wrap_set=NULL;
+
 #define WRAPPER_GROW	8
 
 void wrap_add_entry (WrapperEntry *e,int temp);
@@ -299,6 +306,9 @@ wrap_kill_temp(void)
 {
     WrapperEntry **temps=wrap_list+wrap_count;
 
+    wildcard_set_free (wrap_set);
+    wrap_set = NULL;
+
     while(wrap_tempcount)
 	wrap_free_entry(temps[--wrap_tempcount]);
 }
@@ -331,6 +341,8 @@ wrap_restore_saved(void)
     wrap_kill();
 
     free(wrap_list);
+    wildcard_set_free (wrap_set);
+    wrap_set = NULL;
 
     wrap_list=wrap_saved_list;
     wrap_count=wrap_saved_count;
@@ -462,6 +474,10 @@ void
 wrap_add_entry (WrapperEntry *e, int temp)
 {
     int x;
+
+    wildcard_set_free (wrap_set);
+    wrap_set = NULL;
+
     if (wrap_count + wrap_tempcount >= wrap_size)
     {
 	wrap_size += WRAPPER_GROW;
@@ -479,15 +495,35 @@ wrap_add_entry (WrapperEntry *e, int temp)
     *wrap_list[x] = *e;
 }
 
+/* Return the index in WRAP_LIST of the first wrapper whose wildcard matches
+ * NAME, or -1 if there is none.
+ */
+static int
+wrap_match (const char *name)
+{
+    int x,count=wrap_count+wrap_tempcount;
+
+    if (count == 0)
+	return -1;
+
+    if (wrap_set == NULL)
+    {
+	wrap_set = wildcard_set_new ();
+	for(x=0;x<count;++x)
+	    wildcard_set_add (wrap_set, wrap_list[x]->wildCard);
+    }
+
+    return wildcard_set_match (wrap_set, name);
+}
+
 /* Return 1 if the given filename is a wrapper filename */
 int
 wrap_name_has (const char *name, WrapMergeHas has)
 {
-    int x,count=wrap_count+wrap_tempcount;
+    int x = wrap_match (name);
     char *temp;
 
-    for(x=0;x<count;++x)
-	if (CVS_FNMATCH (wrap_list[x]->wildCard, name, 0) == 0){
+    if (x >= 0){
 	    switch(has){
 	    case WRAP_TOCVS:
 		temp=wrap_list[x]->tocvsFilter;
@@ -514,12 +550,9 @@ static WrapperEntry *wrap_matching_entry (const char *);
 static WrapperEntry *
 wrap_matching_entry (const char *name)
 {
-    int x,count=wrap_count+wrap_tempcount;
+    int x = wrap_match (name);
 
-    for(x=0;x<count;++x)
-	if (CVS_FNMATCH (wrap_list[x]->wildCard, name, 0) == 0)
-	    return wrap_list[x];
-    return NULL;
+    return x >= 0 ? wrap_list[x] : NULL;
 }
 
 /* Return the RCS options for FILENAME in a newly malloc'd string.  If